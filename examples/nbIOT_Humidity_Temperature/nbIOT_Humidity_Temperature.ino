@@ -2,6 +2,7 @@
 #include <Wire.h>
 // #include <SoftwareSerial.h> // Uno
 #include <Sodaq_nbIOT.h>
+#include <Sodaq_PayloadCodec.h>
 #include <Sodaq_HTS221.h>
 
 #if defined(ARDUINO_AVR_LEONARDO)
@@ -29,6 +30,15 @@ SoftwareSerial softSerial(10, 11); // RX, TX
 Sodaq_nbIOT nbiot;
 Sodaq_HTS221 humiditySensor;
 
+// The payload: the temperature with 2 decimals and the humidity with 1 decimal,
+// both relative to the previous report. See Sodaq_PayloadCodec.h for the format.
+const Sodaq_PayloadField payloadFields[] = {
+    { 100, true }, // temperature (C)
+    { 10, true },  // humidity (%)
+};
+
+Sodaq_PayloadEncoder payloadEncoder(payloadFields, 2);
+
 void setup()
 {
     while ((!DEBUG_STREAM) && (millis() < 10000)) {
@@ -67,14 +77,20 @@ void setup()
 void loop()
 {
     // Create the message
-    String message = String(humiditySensor.readTemperature()) + "C" +
-        ",  " + String(humiditySensor.readHumidity()) + "%";
+    float values[] = { humiditySensor.readTemperature(), humiditySensor.readHumidity() };
+    uint8_t payload[16];
+    size_t size = payloadEncoder.encode(values, payload, sizeof(payload));
 
     // Print the message we want to send
-    DEBUG_STREAM.println(message);
+    DEBUG_STREAM.print(values[0]);
+    DEBUG_STREAM.print("C, ");
+    DEBUG_STREAM.print(values[1]);
+    DEBUG_STREAM.print("% as ");
+    DEBUG_STREAM.print(size);
+    DEBUG_STREAM.println(" bytes");
 
     // Send the message
-    nbiot.sendMessage(message);
+    nbiot.sendMessage(payload, size);
 
     // Wait some time between messages
     delay(10000); // 1000 = 1 sec
@@ -1,5 +1,6 @@
 #include <Wire.h>
 #include <Sodaq_nbIOT.h>
+#include <Sodaq_PayloadCodec.h>
 #include <Sodaq_LPS22HB.h>
 
 #if defined(ARDUINO_AVR_LEONARDO)
@@ -21,6 +22,14 @@
 Sodaq_nbIOT nbiot;
 Sodaq_LPS22HB barometricSensor;
 
+// The payload: the pressure with 1 decimal, relative to the previous report.
+// See Sodaq_PayloadCodec.h for the format.
+const Sodaq_PayloadField payloadFields[] = {
+    { 10, true }, // pressure (hPa)
+};
+
+Sodaq_PayloadEncoder payloadEncoder(payloadFields, 1);
+
 void setup()
 {
     while ((!DEBUG_STREAM) && (millis() < 10000)) {
@@ -58,13 +67,18 @@ void setup()
 void loop()
 {
     // Create the message
-    String message = String(barometricSensor.readPressureHPA()) + " mbar";
+    float values[] = { barometricSensor.readPressureHPA() };
+    uint8_t payload[8];
+    size_t size = payloadEncoder.encode(values, payload, sizeof(payload));
 
     // Print the message we want to send
-    DEBUG_STREAM.println(message);
+    DEBUG_STREAM.print(values[0]);
+    DEBUG_STREAM.print(" mbar as ");
+    DEBUG_STREAM.print(size);
+    DEBUG_STREAM.println(" bytes");
 
     // Send the message
-    nbiot.sendMessage(message);
+    nbiot.sendMessage(payload, size);
 
     // Wait some time between messages
     delay(10000); // 1000 = 1 sec
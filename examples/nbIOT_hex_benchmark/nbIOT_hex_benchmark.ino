@@ -0,0 +1,92 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+// Prints the CPU cycles per byte of the hex codec of the payload paths on the board.
+// The modem is not used. The cycles are derived from micros() and F_CPU.
+
+#include <Sodaq_HexCodec.h>
+
+#if defined(ARDUINO_SODAQ_EXPLORER) || defined(ARDUINO_SAM_ZERO) || defined(ARDUINO_SODAQ_AUTONOMO) || \
+    defined(ARDUINO_SODAQ_SARA) || defined(ARDUINO_SODAQ_SFF)
+#define DEBUG_STREAM SerialUSB
+#else
+#define DEBUG_STREAM Serial
+#endif
+
+#define PAYLOAD_SIZE 256
+#define ROUNDS 100
+
+uint8_t data[PAYLOAD_SIZE];
+char hex[2 * PAYLOAD_SIZE];
+
+// Keeps the compiler from dropping the benchmarked code.
+volatile uint8_t sink;
+
+void printCyclesPerByte(const char* name, uint32_t elapsedMicros)
+{
+    DEBUG_STREAM.print(name);
+    DEBUG_STREAM.print(": ");
+    DEBUG_STREAM.print((float)elapsedMicros * (F_CPU / 1000000) / ((uint32_t)ROUNDS * PAYLOAD_SIZE));
+    DEBUG_STREAM.println(" cycles/byte");
+}
+
+void setup()
+{
+    while ((!DEBUG_STREAM) && (millis() < 10000)) {
+        // Wait for serial monitor for 10 seconds
+    }
+
+    DEBUG_STREAM.begin(9600);
+    DEBUG_STREAM.println("\r\nSODAQ hex codec benchmark\r\n");
+
+    for (size_t i = 0; i < PAYLOAD_SIZE; i++) {
+        data[i] = i * 7;
+    }
+}
+
+void loop()
+{
+    uint32_t start = micros();
+    for (uint16_t i = 0; i < ROUNDS; i++) {
+        sodaq_hex_encode(data, PAYLOAD_SIZE, hex);
+        sink = hex[i % sizeof(hex)];
+    }
+    printCyclesPerByte("encode", micros() - start);
+
+    start = micros();
+    for (uint16_t i = 0; i < ROUNDS; i++) {
+        sodaq_hex_decode(hex, sizeof(hex), data);
+        sink = data[i % sizeof(data)];
+    }
+    printCyclesPerByte("decode", micros() - start);
+
+    // the receive paths of the driver decode per character as the data arrives
+    start = micros();
+    for (uint16_t i = 0; i < ROUNDS; i++) {
+        for (size_t j = 0; j < PAYLOAD_SIZE; j++) {
+            data[j] = (sodaq_hex_nibble(hex[2 * j]) << 4) | sodaq_hex_nibble(hex[2 * j + 1]);
+        }
+        sink = data[i % sizeof(data)];
+    }
+    printCyclesPerByte("decode per character", micros() - start);
+
+    DEBUG_STREAM.println();
+    delay(5000);
+}
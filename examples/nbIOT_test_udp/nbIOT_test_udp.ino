@@ -135,9 +135,9 @@ void sendMessageThroughUDP()
 
         while (nbiot.hasPendingUDPBytes()) {
             char data[200];
-            // read two bytes at a time
+            // read two bytes at a time (4 hex characters plus the null terminator)
             SaraN2UDPPacketMetadata p;
-            int size = nbiot.socketReceiveHex(data, 2, &p);
+            int size = nbiot.socketReceiveHex(data, 2 * 2 + 1, &p);
 
             if (size) {
                 DEBUG_STREAM.println(data);
@@ -19,16 +19,19 @@
 */
 
 #include "Sodaq_AT_Device.h"
+#include "Sodaq_HexCodec.h"
 
 //#define DEBUG
 
 #ifdef DEBUG
 #define debugPrintLn(...) { if (!this->_disableDiag && this->_diagStream) this->_diagStream->println(__VA_ARGS__); }
 #define debugPrint(...) { if (!this->_disableDiag && this->_diagStream) this->_diagStream->print(__VA_ARGS__); }
+#define debugWrite(...) { if (!this->_disableDiag && this->_diagStream) this->_diagStream->write(__VA_ARGS__); }
 #warning "Debug mode is ON"
 #else
 #define debugPrintLn(...)
 #define debugPrint(...)
+#define debugWrite(...)
 #endif
 
 #define CR "\r"
@@ -47,6 +50,8 @@
 
 #define SODAQ_AT_DEVICE_DEFAULT_INPUT_BUFFER_SIZE 250
 
+#define SODAQ_AT_DEVICE_RX_BUFFER_MASK (SODAQ_AT_DEVICE_RX_BUFFER_SIZE - 1)
+
 // Constructor
 Sodaq_AT_Device::Sodaq_AT_Device() :
     _txEnablePin(-1),
@@ -57,10 +62,19 @@ Sodaq_AT_Device::Sodaq_AT_Device() :
     _inputBuffer(0),
     _onoff(0),
     _baudRateChangeCallbackPtr(0),
+    _idleCallbackPtr(0),
     _appendCommand(false),
-    _startOn(0)
+    _startOn(0),
+    _rxHead(0),
+    _rxTail(0),
+    _asyncLineBuffer(0),
+    _asyncLineLength(0),
+    _commandNameLength(0),
+    _isCommandNameOpen(false)
 {
     this->_isBufferInitialized = false;
+
+    memset(&_rxSink, 0, sizeof(_rxSink));
 }
 
 // Turns the modem on and returns true if successful.
@@ -87,7 +101,7 @@ bool Sodaq_AT_Device::on()
     }
 
     if (timeout) {
-        debugPrintLn("Error: No Reply from Modem");
+        debugPrintLn(F("Error: No Reply from Modem"));
         return false;
     }    
 
@@ -128,20 +142,105 @@ void Sodaq_AT_Device::setTxPowerIfAvailable(bool on)
 void Sodaq_AT_Device::writeProlog()
 {
     if (!_appendCommand) {
-        debugPrint(">> ");
+        debugPrint(F(">> "));
         _appendCommand = true;
+
+        _commandNameLength = 0;
+        _isCommandNameOpen = true;
+    }
+}
+
+// Adds "c" to the name of the command that is being written, or ends the name.
+void Sodaq_AT_Device::trackCommandName(char c)
+{
+    if (!_isCommandNameOpen) {
+        return;
+    }
+
+    // "AT", then the name of an extended command: '+' and letters or digits
+    bool isNameChar;
+
+    if (_commandNameLength < 2) {
+        char upper = (_commandNameLength == 0) ? 'A' : 'T';
+
+        isNameChar = (c == upper) || (c == upper + ('a' - 'A'));
+    }
+    else if (_commandNameLength == 2) {
+        isNameChar = (c == '+');
+    }
+    else {
+        isNameChar = ((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9'));
+    }
+
+    if (isNameChar && (_commandNameLength < sizeof(_commandName))) {
+        _commandName[_commandNameLength++] = c;
+        return;
+    }
+
+    if (isNameChar) {
+        // too long to be compared
+        _commandNameLength = 0;
+    }
+
+    _isCommandNameOpen = false;
+}
+
+void Sodaq_AT_Device::trackCommandName(const char* str, size_t size)
+{
+    for (size_t i = 0; _isCommandNameOpen && (i < size); i++) {
+        trackCommandName(str[i]);
     }
 }
 
+void Sodaq_AT_Device::trackCommandName(const __FlashStringHelper* str)
+{
+    const char* p = reinterpret_cast<const char*>(str);
+    char c;
+
+    while (_isCommandNameOpen && ((c = pgm_read_byte(p++)) != '\0')) {
+        trackCommandName(c);
+    }
+}
+
+// Returns true if the line starts with the name of the command that was written last, followed by ':'.
+bool Sodaq_AT_Device::isCommandResponse(const char* buffer, size_t size) const
+{
+    // without the "AT"
+    size_t length = _commandNameLength - 2;
+
+    return (_commandNameLength > 3) && (size > length) && (buffer[length] == ':') &&
+           (memcmp(buffer, &_commandName[2], length) == 0);
+}
+
 // Write a byte, as binary data
 size_t Sodaq_AT_Device::writeByte(uint8_t value)
 {
     return _modemStream->write(value);
 }
 
+// Write a buffer (as part of a command) with a single Stream::write()
+size_t Sodaq_AT_Device::write(const uint8_t* buffer, size_t size)
+{
+    writeProlog();
+    trackCommandName(reinterpret_cast<const char*>(buffer), size);
+    debugWrite(buffer, size);
+
+    return _modemStream->write(buffer, size);
+}
+
+size_t Sodaq_AT_Device::print(const __FlashStringHelper* buffer)
+{
+    writeProlog();
+    trackCommandName(buffer);
+    debugPrint(buffer);
+
+    return _modemStream->print(buffer);
+}
+
 size_t Sodaq_AT_Device::print(const String& buffer)
 {
     writeProlog();
+    trackCommandName(buffer.c_str(), buffer.length());
     debugPrint(buffer);
 
     return _modemStream->print(buffer);
@@ -150,6 +249,7 @@ size_t Sodaq_AT_Device::print(const String& buffer)
 size_t Sodaq_AT_Device::print(const char buffer[])
 {
     writeProlog();
+    trackCommandName(buffer, strlen(buffer));
     debugPrint(buffer);
 
     return _modemStream->print(buffer);
@@ -158,6 +258,7 @@ size_t Sodaq_AT_Device::print(const char buffer[])
 size_t Sodaq_AT_Device::print(char value)
 {
     writeProlog();
+    trackCommandName(value);
     debugPrint(value);
 
     return _modemStream->print(value);
@@ -203,6 +304,22 @@ size_t Sodaq_AT_Device::print(unsigned long value, int base)
     return _modemStream->print(value, base);
 };
 
+size_t Sodaq_AT_Device::print(double value, int digits)
+{
+    writeProlog();
+    debugPrint(value, digits);
+
+    return _modemStream->print(value, digits);
+};
+
+size_t Sodaq_AT_Device::print(const Printable& value)
+{
+    writeProlog();
+    debugPrint(value);
+
+    return _modemStream->print(value);
+};
+
 size_t Sodaq_AT_Device::println(const __FlashStringHelper* ifsh)
 {
     size_t n = print(ifsh);
@@ -283,11 +400,96 @@ size_t Sodaq_AT_Device::println(void)
     return i;
 }
 
+void Sodaq_AT_Device::CommandWriter::print(const char* str)
+{
+    while (*str != '\0') {
+        print(*str++);
+    }
+}
+
+void Sodaq_AT_Device::CommandWriter::print(const __FlashStringHelper* str)
+{
+    const char* p = reinterpret_cast<const char*>(str);
+    char c;
+
+    while ((c = pgm_read_byte(p++)) != '\0') {
+        print(c);
+    }
+}
+
+void Sodaq_AT_Device::CommandWriter::print(char c)
+{
+    if (_length >= sizeof(_buffer)) {
+        flush();
+    }
+
+    _buffer[_length++] = c;
+}
+
+void Sodaq_AT_Device::CommandWriter::print(uint32_t value)
+{
+    char digits[10];
+    uint8_t count = 0;
+
+    do {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    while (count > 0) {
+        print(digits[--count]);
+    }
+}
+
+// Appends the buffer as hex characters (two per byte).
+void Sodaq_AT_Device::CommandWriter::printHex(const uint8_t* buffer, size_t size)
+{
+    while (size > 0) {
+        if (_length + 2 > sizeof(_buffer)) {
+            flush();
+        }
+
+        size_t count = min(size, (sizeof(_buffer) - _length) / 2);
+
+        sodaq_hex_encode(buffer, count, &_buffer[_length]);
+        _length += 2 * count;
+        buffer += count;
+        size -= count;
+    }
+}
+
+// Terminates the command and writes what is left in the buffer.
+// Returns the total number of bytes written for this command.
+size_t Sodaq_AT_Device::CommandWriter::println()
+{
+    print('\r');
+    flush();
+
+#ifdef DEBUG
+    if (!_device._disableDiag && _device._diagStream) {
+        _device._diagStream->println();
+    }
+#endif
+
+    _device._appendCommand = false;
+
+    return _written;
+}
+
+// Writes the contents of the buffer to the modem stream.
+void Sodaq_AT_Device::CommandWriter::flush()
+{
+    if (_length > 0) {
+        _written += _device.write(reinterpret_cast<const uint8_t*>(_buffer), _length);
+        _length = 0;
+    }
+}
+
 // Initializes the input buffer and makes sure it is only initialized once.
 // Safe to call multiple times.
 void Sodaq_AT_Device::initBuffer()
 {
-    debugPrintLn("[initBuffer]");
+    debugPrintLn(F("[initBuffer]"));
 
     // make sure the buffers are only initialized once
     if (!_isBufferInitialized) {
@@ -297,10 +499,20 @@ void Sodaq_AT_Device::initBuffer()
     }
 }
 
+// Uses the given (static) "buffer" of "size" bytes as the input buffer instead of allocating it.
+void Sodaq_AT_Device::setInputBuffer(char* buffer, size_t size)
+{
+    _inputBuffer = buffer;
+    _inputBufferSize = size;
+    _isBufferInitialized = true;
+}
+
 // Sets the modem stream.
 void Sodaq_AT_Device::setModemStream(Stream& stream)
 {
     this->_modemStream = &stream;
+
+    clearRxBuffer();
 }
 
 // Sets the optional tx enable pin.
@@ -314,21 +526,58 @@ void Sodaq_AT_Device::setTxEnablePin(int8_t txEnablePin)
     }
 }
 
-// Returns a character from the modem stream if read within _timeout ms or -1 otherwise.
-int Sodaq_AT_Device::timedRead(uint32_t timeout) const
+// Moves all the bytes available on the modem stream into the receive ring buffer.
+// Returns the number of bytes in the receive ring buffer.
+size_t Sodaq_AT_Device::fillRxBuffer()
 {
-    int c;
-    uint32_t _startMillis = millis();
+    int count = _modemStream->available();
+    size_t space = SODAQ_AT_DEVICE_RX_BUFFER_SIZE - rxAvailable();
+
+    while ((count-- > 0) && (space-- > 0)) {
+        int c = _modemStream->read();
+
+        if (c < 0) {
+            break;
+        }
+
+        _rxBuffer[_rxHead++ & SODAQ_AT_DEVICE_RX_BUFFER_MASK] = static_cast<uint8_t>(c);
+    }
+
+    return rxAvailable();
+}
+
+// Blocks until there is data in the receive ring buffer or "timeout" ms have passed,
+// calling the idle callback (if any) while waiting.
+// Returns true if there is data available.
+bool Sodaq_AT_Device::waitForRxData(uint32_t timeout)
+{
+    if (fillRxBuffer() > 0) {
+        return true;
+    }
+
+    uint32_t startMillis = millis();
 
     do {
-        c = _modemStream->read();
+        if (_idleCallbackPtr) {
+            _idleCallbackPtr();
+        }
 
-        if (c >= 0) {
-            return c;
+        if (fillRxBuffer() > 0) {
+            return true;
         }
-    } while (millis() - _startMillis < timeout);
+    } while (millis() - startMillis < timeout);
+
+    return false;
+}
+
+// Returns a character from the modem stream if read within _timeout ms or -1 otherwise.
+int Sodaq_AT_Device::timedRead(uint32_t timeout)
+{
+    if ((rxAvailable() == 0) && !waitForRxData(timeout)) {
+        return -1; // -1 indicates timeout
+    }
 
-    return -1; // -1 indicates timeout
+    return _rxBuffer[_rxTail++ & SODAQ_AT_DEVICE_RX_BUFFER_MASK];
 }
 
 // Fills the given "buffer" with characters read from the modem stream up to "length"
@@ -342,21 +591,44 @@ size_t Sodaq_AT_Device::readBytesUntil(char terminator, char* buffer, size_t len
         return 0;
     }
 
+    if (_rxSink.isArmed) {
+        return readBytesUntilWithSink(terminator, buffer, length, timeout);
+    }
+
     size_t index = 0;
 
     while (index < length) {
-        int c = timedRead(timeout);
+        size_t available = rxAvailable();
+
+        // the timeout applies to the time between characters, not to the whole line
+        if (available == 0) {
+            if (!waitForRxData(timeout)) {
+                break;
+            }
+
+            available = rxAvailable();
+        }
 
-        if (c < 0 || c == terminator) {
+        // scan the contiguous part of the ring buffer in one go
+        size_t tail = _rxTail & SODAQ_AT_DEVICE_RX_BUFFER_MASK;
+        size_t run = min(available, min(static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE - tail), length - index));
+        const uint8_t* src = &_rxBuffer[tail];
+        const uint8_t* found = static_cast<const uint8_t*>(memchr(src, terminator, run));
+        size_t count = found ? static_cast<size_t>(found - src) : run;
+
+        memcpy(&buffer[index], src, count);
+        index += count;
+
+        if (found) {
+            _rxTail += count + 1; // also consume the terminator
             break;
         }
 
-        *buffer++ = static_cast<char>(c);
-        index++;
+        _rxTail += count;
     }
 
     if (index < length) {
-        *buffer = '\0';
+        buffer[index] = '\0';
     }
 
     // TODO distinguise timeout from empty string?
@@ -364,6 +636,203 @@ size_t Sodaq_AT_Device::readBytesUntil(char terminator, char* buffer, size_t len
     return index; // return number of characters, not including null terminator
 }
 
+// Returns the number at the end of the first "index" characters of "buffer", before the
+// separating comma (the length field before a raw field), or 0 if there is none.
+static size_t parseFieldLength(const char* buffer, size_t index)
+{
+    if ((index == 0) || (buffer[index - 1] != ',')) {
+        return 0;
+    }
+
+    size_t start = index - 1;
+
+    while ((start > 0) && (buffer[start - 1] >= '0') && (buffer[start - 1] <= '9')) {
+        start--;
+    }
+
+    size_t value = 0;
+
+    for (size_t i = start; i < index - 1; i++) {
+        value = 10 * value + (buffer[i] - '0');
+    }
+
+    return value;
+}
+
+// Same as readBytesUntil(), but the characters of the field selected by armRxFieldSink()
+// are passed to the field sink instead of the buffer.
+// The first "index" characters of the line are already in the buffer.
+size_t Sodaq_AT_Device::readBytesUntilWithSink(char terminator, char* buffer, size_t length, uint32_t timeout, size_t index)
+{
+    _rxSink.quoteCount = 0;
+
+    for (size_t i = 0; i < index; i++) {
+        if (buffer[i] == '"') {
+            _rxSink.quoteCount++;
+        }
+    }
+
+    while (index < length) {
+        if ((rxAvailable() == 0) && !waitForRxData(timeout)) {
+            break;
+        }
+
+        // the contents of the field go to the sink a run of the ring buffer at a time
+        if (_rxSink.isInField && !writeRxFieldRun()) {
+            continue;
+        }
+
+        char c = static_cast<char>(_rxBuffer[_rxTail++ & SODAQ_AT_DEVICE_RX_BUFFER_MASK]);
+
+        if (_rxSink.isInField) {
+            // the field is done, it must end with its closing quote (a raw field after exactly
+            // its length, a hex field after an even number of hex digits), otherwise it cannot be trusted
+            if ((c != '"') || (_rxSink.highNibble >= 0)) {
+                failRxFieldSink();
+            }
+
+            _rxSink.isInField = false;
+            _rxSink.isArmed = false;
+
+            if (c == terminator) {
+                break;
+            }
+        }
+        else if (c == terminator) {
+            break;
+        }
+        else if ((c == '"') && (++_rxSink.quoteCount == _rxSink.openingQuote)) {
+            _rxSink.isInField = true;
+
+            if (_rxSink.isRaw) {
+                _rxSink.rawRemaining = parseFieldLength(buffer, index);
+            }
+        }
+
+        buffer[index++] = c;
+
+        if (!_rxSink.isArmed) {
+            // continue on the fast path
+            return index + readBytesUntil(terminator, &buffer[index], length - index, timeout);
+        }
+    }
+
+    if (index < length) {
+        buffer[index] = '\0';
+    }
+
+    return index;
+}
+
+// Passes the field characters of the contiguous part of the ring buffer to the field sink.
+// Returns true if the next character in the ring buffer ends the field.
+bool Sodaq_AT_Device::writeRxFieldRun()
+{
+    size_t tail = _rxTail & SODAQ_AT_DEVICE_RX_BUFFER_MASK;
+    size_t run = min(rxAvailable(), static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE - tail));
+    const char* src = reinterpret_cast<const char*>(&_rxBuffer[tail]);
+    size_t count;
+    bool isEnd;
+
+    if (_rxSink.isRaw) {
+        count = min(run, _rxSink.rawRemaining);
+        _rxSink.rawRemaining -= count;
+        isEnd = (_rxSink.rawRemaining == 0);
+    }
+    else if (_rxSink.decodeHex) {
+        // stops at the closing quote, or at any other character that is not hex (which fails the field)
+        count = sodaq_hex_span(src, run);
+        isEnd = (count < run);
+    }
+    else {
+        const char* quote = static_cast<const char*>(memchr(src, '"', run));
+        count = quote ? static_cast<size_t>(quote - src) : run;
+        isEnd = (quote != NULL);
+    }
+
+    writeRxFieldSink(src, count);
+    _rxTail += count;
+
+    return isEnd && (rxAvailable() > 0);
+}
+
+// Writes "count" field characters into the buffer of the sink, hex decoded if it decodes hex
+// (then "src" holds hex digits only). What does not fit is dropped.
+void Sodaq_AT_Device::writeRxFieldSink(const char* src, size_t count)
+{
+    if (_rxSink.isFailed || (count == 0)) {
+        return;
+    }
+
+    if (!_rxSink.decodeHex) {
+        size_t size = min(count, _rxSink.size - _rxSink.length);
+
+        memcpy(&_rxSink.buffer[_rxSink.length], src, size);
+        _rxSink.length += size;
+
+        return;
+    }
+
+    // the high nibble left over from the previous run
+    if (_rxSink.highNibble >= 0) {
+        if (_rxSink.length < _rxSink.size) {
+            _rxSink.buffer[_rxSink.length++] = (_rxSink.highNibble << 4) | sodaq_hex_nibble(*src);
+        }
+
+        _rxSink.highNibble = -1;
+        src++;
+        count--;
+    }
+
+    size_t size = min(count / 2, _rxSink.size - _rxSink.length);
+    _rxSink.length += sodaq_hex_decode(src, 2 * size, &_rxSink.buffer[_rxSink.length]);
+
+    if (count & 1) {
+        _rxSink.highNibble = sodaq_hex_nibble(src[count - 1]);
+    }
+}
+
+// Marks the field of the sink as malformed and discards what was written into its buffer.
+void Sodaq_AT_Device::failRxFieldSink()
+{
+    _rxSink.isFailed = true;
+    _rxSink.length = 0;
+}
+
+// Arms the field sink, see the header for details.
+void Sodaq_AT_Device::armRxFieldSink(uint8_t* buffer, size_t size, uint8_t fieldIndex, bool decodeHex)
+{
+    _rxSink.buffer = buffer;
+    _rxSink.size = size;
+    _rxSink.length = 0;
+    _rxSink.openingQuote = 2 * fieldIndex + 1;
+    _rxSink.quoteCount = 0;
+    _rxSink.highNibble = -1;
+    _rxSink.isArmed = true;
+    _rxSink.isInField = false;
+    _rxSink.decodeHex = decodeHex;
+    _rxSink.rawRemaining = 0;
+    _rxSink.isRaw = false;
+    _rxSink.isFailed = false;
+}
+
+// Arms the field sink for a raw field, see the header for details.
+void Sodaq_AT_Device::armRxRawFieldSink(uint8_t* buffer, size_t size, uint8_t fieldIndex)
+{
+    armRxFieldSink(buffer, size, fieldIndex, false);
+
+    _rxSink.isRaw = true;
+}
+
+// Disarms the field sink and returns the number of bytes written into its buffer.
+size_t Sodaq_AT_Device::disarmRxFieldSink()
+{
+    _rxSink.isArmed = false;
+    _rxSink.isInField = false;
+
+    return _rxSink.length;
+}
+
 // Fills the given "buffer" with up to "length" characters read from the modem stream.
 // It stops when a character read times out or "length" characters have been read.
 // Returns the number of characters written to the buffer.
@@ -372,14 +841,22 @@ size_t Sodaq_AT_Device::readBytes(uint8_t* buffer, size_t length, uint32_t timeo
     size_t count = 0;
 
     while (count < length) {
-        int c = timedRead(timeout);
+        size_t available = rxAvailable();
 
-        if (c < 0) {
-            break;
+        if (available == 0) {
+            if (!waitForRxData(timeout)) {
+                break;
+            }
+
+            available = rxAvailable();
         }
 
-        *buffer++ = static_cast<uint8_t>(c);
-        count++;
+        size_t tail = _rxTail & SODAQ_AT_DEVICE_RX_BUFFER_MASK;
+        size_t run = min(available, min(static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE - tail), length - count));
+
+        memcpy(&buffer[count], &_rxBuffer[tail], run);
+        count += run;
+        _rxTail += run;
     }
 
     // TODO distinguise timeout from empty string?
@@ -392,12 +869,35 @@ size_t Sodaq_AT_Device::readBytes(uint8_t* buffer, size_t length, uint32_t timeo
 // Returns the number of bytes read, not including the null terminator.
 size_t Sodaq_AT_Device::readLn(char* buffer, size_t size, uint32_t timeout)
 {
+    const char terminator = SODAQ_AT_DEVICE_TERMINATOR[SODAQ_AT_DEVICE_TERMINATOR_LEN - 1];
+    size_t start = 0;
+
+    // continue the partial line of readLnAsync() (e.g. of a URC that was cut by poll()),
+    // it is only the start of the line that is read now
+    if (_asyncLineLength > 0) {
+        start = min(_asyncLineLength, size - 1);
+
+        if (buffer != _asyncLineBuffer) {
+            memmove(buffer, _asyncLineBuffer, start);
+        }
+
+        _asyncLineLength = 0;
+    }
+
     // Use size-1 to leave room for a string terminator
-    size_t len = readBytesUntil(SODAQ_AT_DEVICE_TERMINATOR[SODAQ_AT_DEVICE_TERMINATOR_LEN - 1], buffer, size - 1, timeout);
+    size_t len;
+
+    if ((start > 0) && _rxSink.isArmed) {
+        len = readBytesUntilWithSink(terminator, buffer, size - 1, timeout, start);
+    }
+    else {
+        len = start + readBytesUntil(terminator, &buffer[start], size - 1 - start, timeout);
+    }
 
     // check if the terminator is more than 1 characters, then check if the first character of it exists
     // in the calculated position and terminate the string there
-    if ((SODAQ_AT_DEVICE_TERMINATOR_LEN > 1) && (buffer[len - (SODAQ_AT_DEVICE_TERMINATOR_LEN - 1)] == SODAQ_AT_DEVICE_TERMINATOR[0])) {
+    if ((SODAQ_AT_DEVICE_TERMINATOR_LEN > 1) && (len >= SODAQ_AT_DEVICE_TERMINATOR_LEN - 1) &&
+            (buffer[len - (SODAQ_AT_DEVICE_TERMINATOR_LEN - 1)] == SODAQ_AT_DEVICE_TERMINATOR[0])) {
         len -= SODAQ_AT_DEVICE_TERMINATOR_LEN - 1;
     }
 
@@ -406,3 +906,44 @@ size_t Sodaq_AT_Device::readLn(char* buffer, size_t size, uint32_t timeout)
 
     return len;
 }
+
+// Collects a line from the receive ring buffer into the "buffer", without blocking.
+// Returns true when a complete line is available, with its length in "length".
+bool Sodaq_AT_Device::readLnAsync(char* buffer, size_t size, size_t* length)
+{
+    const char terminator = SODAQ_AT_DEVICE_TERMINATOR[SODAQ_AT_DEVICE_TERMINATOR_LEN - 1];
+    bool isComplete = false;
+
+    _asyncLineBuffer = buffer;
+    fillRxBuffer();
+
+    while (!isComplete && (rxAvailable() > 0)) {
+        char c = static_cast<char>(_rxBuffer[_rxTail++ & SODAQ_AT_DEVICE_RX_BUFFER_MASK]);
+
+        if (c == terminator) {
+            if ((SODAQ_AT_DEVICE_TERMINATOR_LEN > 1) && (_asyncLineLength > 0) &&
+                    (buffer[_asyncLineLength - 1] == SODAQ_AT_DEVICE_TERMINATOR[0])) {
+                _asyncLineLength--;
+            }
+
+            isComplete = true;
+        }
+        else {
+            buffer[_asyncLineLength++] = c;
+
+            // Use size-1 to leave room for a string terminator.
+            // A line that is too long is returned in parts (like readLn() does).
+            isComplete = (_asyncLineLength >= size - 1);
+        }
+    }
+
+    if (!isComplete) {
+        return false;
+    }
+
+    buffer[_asyncLineLength] = '\0';
+    *length = _asyncLineLength;
+    _asyncLineLength = 0;
+
+    return true;
+}
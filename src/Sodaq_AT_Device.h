@@ -43,8 +43,28 @@ typedef uint32_t IP_t;
 // callback for changing the baudrate of the modem stream.
 typedef void (*BaudRateChangeCallbackPtr)(uint32_t newBaudrate);
 
+// callback invoked repeatedly while waiting for data from the modem (e.g. to put the MCU to sleep).
+typedef void (*IdleCallbackPtr)();
+
 #define SODAQ_AT_DEVICE_DEFAULT_READ_MS 5000 // Used in readResponse()
 
+// The size of the receive ring buffer, must be a power of two.
+#ifndef SODAQ_AT_DEVICE_RX_BUFFER_SIZE
+#define SODAQ_AT_DEVICE_RX_BUFFER_SIZE 64
+#endif
+
+#if (SODAQ_AT_DEVICE_RX_BUFFER_SIZE & (SODAQ_AT_DEVICE_RX_BUFFER_SIZE - 1)) != 0
+#error "SODAQ_AT_DEVICE_RX_BUFFER_SIZE must be a power of two"
+#endif
+
+// The size of the (stack) buffer used by CommandWriter, i.e. the chunk size of the writes.
+#ifndef SODAQ_AT_DEVICE_TX_CHUNK_SIZE
+#define SODAQ_AT_DEVICE_TX_CHUNK_SIZE 64
+#endif
+
+// The size of the buffer for the name of the last command, "AT" included (e.g. "AT+CEDRXRDP").
+#define SODAQ_AT_DEVICE_COMMAND_NAME_SIZE 12
+
 class Sodaq_AT_Device
 {
   public:
@@ -66,8 +86,8 @@ class Sodaq_AT_Device
     void setDiag(Stream* stream) { _diagStream = stream; }
 
     // Sets the size of the input buffer.
-    // Needs to be called before init().
-    void setInputBufferSize(size_t value) { this->_inputBufferSize = value; };
+    // Needs to be called before init(), it is ignored once the buffer has been allocated.
+    void setInputBufferSize(size_t value) { if (!_isBufferInitialized) { this->_inputBufferSize = value; } };
 
     // Returns the default baud rate of the modem.
     // To be used when initializing the modem stream for the first time.
@@ -77,7 +97,40 @@ class Sodaq_AT_Device
     // Needs a callback in the main application to re-initialize the stream.
     void enableBaudrateChange(BaudRateChangeCallbackPtr callback) { _baudRateChangeCallbackPtr = callback; };
 
+    // Sets the (optional) callback that is invoked while waiting for data from the modem.
+    // It may sleep until the next interrupt (e.g. __WFI()), the UART interrupt will wake it up.
+    void setIdleCallback(IdleCallbackPtr callback) { _idleCallbackPtr = callback; };
+
   protected:
+    // Renders a command into a small buffer and writes it to the modem stream in chunks
+    // of SODAQ_AT_DEVICE_TX_CHUNK_SIZE, instead of making one print() call per token.
+    // Meant to be used as a local (stack) object while composing a single command.
+    class CommandWriter
+    {
+      public:
+        CommandWriter(Sodaq_AT_Device& device) : _device(device), _length(0), _written(0) {}
+
+        void print(const char* str);
+        void print(const __FlashStringHelper* str);
+        void print(char c);
+        void print(uint32_t value);
+
+        // Appends the buffer as hex characters (two per byte).
+        void printHex(const uint8_t* buffer, size_t size);
+
+        // Terminates the command and writes what is left in the buffer.
+        // Returns the total number of bytes written for this command.
+        size_t println();
+
+        // Writes the contents of the buffer to the modem stream.
+        void flush();
+      private:
+        Sodaq_AT_Device& _device;
+        char _buffer[SODAQ_AT_DEVICE_TX_CHUNK_SIZE];
+        size_t _length;
+        size_t _written;
+    };
+
     // the (optional) tx enable pin.
     int8_t _txEnablePin;
 
@@ -104,6 +157,9 @@ class Sodaq_AT_Device
     // The callback for requesting baudrate change of the modem stream.
     BaudRateChangeCallbackPtr _baudRateChangeCallbackPtr;
 
+    // The callback invoked while waiting for data from the modem.
+    IdleCallbackPtr _idleCallbackPtr;
+
     // This flag keeps track if the next write is the continuation of the current command
     // A Carriage Return will reset this flag.
     bool _appendCommand;
@@ -111,10 +167,49 @@ class Sodaq_AT_Device
     // Keep track when connect started. Use this to record various status changes.
     uint32_t _startOn;
 
+    // The receive ring buffer. It is filled in bulk from the modem stream by fillRxBuffer()
+    // and drained by the read methods below, which scan it for the terminator.
+    uint8_t _rxBuffer[SODAQ_AT_DEVICE_RX_BUFFER_SIZE];
+
+    // Free running write (head) and read (tail) indexes of the receive ring buffer.
+    uint16_t _rxHead;
+    uint16_t _rxTail;
+
+    // The partial line collected by readLnAsync() so far, readLn() continues it.
+    char* _asyncLineBuffer;
+    size_t _asyncLineLength;
+
+    // The start ("AT" and the name) of the command that was written last, e.g. "AT+CEREG" of "AT+CEREG?".
+    // It is collected while the command is written until the first character that is not part of the name.
+    char _commandName[SODAQ_AT_DEVICE_COMMAND_NAME_SIZE];
+    uint8_t _commandNameLength;
+    bool _isCommandNameOpen;
+
+    // The state of the field sink, see armRxFieldSink().
+    struct RxFieldSink {
+        uint8_t* buffer;
+        size_t size;
+        size_t length;
+        uint8_t openingQuote; // the (1-based) number of the quote that opens the field
+        uint8_t quoteCount;   // the number of quotes seen so far on the current line
+        int8_t highNibble;    // the pending high nibble while decoding hex, or -1
+        size_t rawRemaining;  // the number of raw bytes of the field still to come, see armRxRawFieldSink()
+        bool isArmed;
+        bool isInField;
+        bool decodeHex;
+        bool isRaw;
+        bool isFailed;        // the field was malformed, see isRxFieldSinkFailed()
+    };
+    RxFieldSink _rxSink;
+
     // Initializes the input buffer and makes sure it is only initialized once.
     // Safe to call multiple times.
     void initBuffer();
 
+    // Uses the given (static) "buffer" of "size" bytes as the input buffer instead of allocating it.
+    // Needs to be called before init().
+    void setInputBuffer(char* buffer, size_t size);
+
     // Returns true if the modem is ON (and replies to "AT" commands without timing out)
     virtual bool isAlive() = 0;
 
@@ -127,8 +222,42 @@ class Sodaq_AT_Device
     // Sets the optional tx enable pin.
     void setTxEnablePin(int8_t txEnablePin);
 
+    // Moves all the bytes available on the modem stream into the receive ring buffer.
+    // Returns the number of bytes in the receive ring buffer.
+    size_t fillRxBuffer();
+
+    // Returns the number of bytes in the receive ring buffer.
+    size_t rxAvailable() const { return static_cast<uint16_t>(_rxHead - _rxTail); }
+
+    // Discards the contents of the receive ring buffer and the partial line of readLnAsync().
+    void clearRxBuffer() { _rxTail = _rxHead; _asyncLineLength = 0; }
+
+    // Blocks until there is data in the receive ring buffer or "timeout" ms have passed,
+    // calling the idle callback (if any) while waiting.
+    // Returns true if there is data available.
+    bool waitForRxData(uint32_t timeout);
+
     // Returns a character from the modem stream if read within _timeout ms or -1 otherwise.
-    int timedRead(uint32_t timeout = 1000) const;
+    int timedRead(uint32_t timeout = 1000);
+
+    // Arms the field sink: the contents of quoted field number "fieldIndex" (0-based) of the next
+    // line that has it, are written straight into "buffer" (at most "size" bytes) instead of the
+    // line buffer, hex decoded if "decodeHex" is true. The quotes themselves stay in the line,
+    // so the line parser sees an empty field. The sink captures a single field.
+    void armRxFieldSink(uint8_t* buffer, size_t size, uint8_t fieldIndex, bool decodeHex);
+
+    // Arms the field sink for a quoted field of raw (binary) bytes, preceded by its length:
+    // ...,<length>,"<data>". Exactly <length> bytes are written into "buffer" (at most "size"),
+    // quotes and line terminators among them are data, not delimiters.
+    void armRxRawFieldSink(uint8_t* buffer, size_t size, uint8_t fieldIndex);
+
+    // Disarms the field sink and returns the number of bytes written into its buffer.
+    size_t disarmRxFieldSink();
+
+    // Returns true if the field of the sink was malformed: a raw field that was not followed by its
+    // closing quote (the length did not match the data), or a hex field with a character that is not
+    // hex or an odd number of digits. Nothing is written into the buffer then.
+    bool isRxFieldSinkFailed() const { return _rxSink.isFailed; }
 
     // Fills the given "buffer" with characters read from the modem stream up to "length"
     // maximum characters and until the "terminator" character is found or a character read
@@ -136,6 +265,10 @@ class Sodaq_AT_Device
     // The buffer does not contain the "terminator" character or a null terminator explicitly.
     // Returns the number of characters written to the buffer, not including null terminator.
     size_t readBytesUntil(char terminator, char* buffer, size_t length, uint32_t timeout = 1000);
+    size_t readBytesUntilWithSink(char terminator, char* buffer, size_t length, uint32_t timeout, size_t index = 0);
+    bool writeRxFieldRun();
+    void writeRxFieldSink(const char* src, size_t count);
+    void failRxFieldSink();
 
     // Fills the given "buffer" with up to "length" characters read from the modem stream.
     // It stops when a character read times out or "length" characters have been read.
@@ -144,6 +277,7 @@ class Sodaq_AT_Device
 
     // Reads a line from the modem stream into the "buffer". The line terminator is not
     // written into the buffer. The buffer is terminated with null.
+    // A partial line collected by readLnAsync() is the start of the line.
     // Returns the number of bytes read, not including the null terminator.
     size_t readLn(char* buffer, size_t size, uint32_t timeout = 1000);
 
@@ -151,15 +285,33 @@ class Sodaq_AT_Device
     // Returns the number of bytes read.
     size_t readLn() { return readLn(_inputBuffer, _inputBufferSize); };
 
+    // Collects a line from the receive ring buffer into the "buffer", without blocking.
+    // A partial line is kept in the buffer and completed by the next calls (or by readLn()).
+    // Returns true when a complete line is available, with its length (not including the
+    // terminator) in "length". The buffer is terminated with null.
+    bool readLnAsync(char* buffer, size_t size, size_t* length);
+
     // Write a byte
     size_t writeByte(uint8_t value);
 
+    // Write a buffer (as part of a command) with a single Stream::write()
+    size_t write(const uint8_t* buffer, size_t size);
+
     // Enables or disables the tx power pin, if that is available (!=-1)
     void setTxPowerIfAvailable(bool on);
 
     // Write the command prolog (just for debugging and/or enabling tx power)
     void writeProlog();
 
+    // Passes the characters of the command that is being written to the name of the command.
+    void trackCommandName(char c);
+    void trackCommandName(const char* str, size_t size);
+    void trackCommandName(const __FlashStringHelper* str);
+
+    // Returns true if the line starts with the name of the command that was written last, followed by ':'
+    // (e.g. "+CEREG: 4,1" after "AT+CEREG?"), i.e. it is an information response of that command.
+    bool isCommandResponse(const char* buffer, size_t size) const;
+
     size_t print(const __FlashStringHelper*);
     size_t print(const String&);
     size_t print(const char[]);
@@ -0,0 +1,190 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_AT_Tokenizer.h"
+#include "Arduino.h"
+#include <string.h>
+
+Sodaq_AT_Tokenizer::Sodaq_AT_Tokenizer(const char* buffer, size_t size) :
+    _pos(buffer),
+    _end(buffer + size)
+{
+}
+
+void Sodaq_AT_Tokenizer::skipSpaces()
+{
+    while ((_pos < _end) && (*_pos == ' ')) {
+        _pos++;
+    }
+}
+
+// Consumes "str" if the input continues with it.
+bool Sodaq_AT_Tokenizer::skip(const char* str)
+{
+    const char* p = _pos;
+
+    while (*str != '\0') {
+        if ((p >= _end) || (*p != *str)) {
+            return false;
+        }
+
+        p++;
+        str++;
+    }
+
+    _pos = p;
+    return true;
+}
+
+// Consumes the flash string "str" (F("...")) if the input continues with it.
+bool Sodaq_AT_Tokenizer::skip(const __FlashStringHelper* str)
+{
+    const char* p = _pos;
+    const char* s = reinterpret_cast<const char*>(str);
+    char c;
+
+    while ((c = pgm_read_byte(s)) != '\0') {
+        if ((p >= _end) || (*p != c)) {
+            return false;
+        }
+
+        p++;
+        s++;
+    }
+
+    _pos = p;
+    return true;
+}
+
+// Consumes the character "c" if it is the next character.
+bool Sodaq_AT_Tokenizer::skip(char c)
+{
+    if (peek(c)) {
+        _pos++;
+        return true;
+    }
+
+    return false;
+}
+
+// Reads a decimal integer with an optional sign. Leading spaces are skipped.
+// Returns false if there are no digits or if the value does not fit in an int32_t.
+bool Sodaq_AT_Tokenizer::readInt(int32_t* value)
+{
+    skipSpaces();
+
+    bool negative = false;
+
+    if (skip('-')) {
+        negative = true;
+    }
+    else {
+        skip('+');
+    }
+
+    const char* start = _pos;
+    uint32_t limit = negative ? 0x80000000UL : 0x7FFFFFFFUL;
+    uint32_t result = 0;
+
+    while ((_pos < _end) && (*_pos >= '0') && (*_pos <= '9')) {
+        uint8_t digit = *_pos - '0';
+
+        if (result > (limit - digit) / 10) {
+            return false;
+        }
+
+        result = result * 10 + digit;
+        _pos++;
+    }
+
+    if (_pos == start) {
+        return false;
+    }
+
+    *value = negative ? static_cast<int32_t>(0U - result) : static_cast<int32_t>(result);
+    return true;
+}
+
+// Reads a field, which is either a quoted string or the characters up to the next ','.
+bool Sodaq_AT_Tokenizer::readString(const char** start, size_t* length)
+{
+    skipSpaces();
+
+    if (skip('"')) {
+        const char* quote = static_cast<const char*>(memchr(_pos, '"', _end - _pos));
+
+        if (!quote) {
+            return false;
+        }
+
+        *start = _pos;
+        *length = quote - _pos;
+        _pos = quote + 1;
+
+        return true;
+    }
+
+    const char* comma = static_cast<const char*>(memchr(_pos, ',', _end - _pos));
+    const char* fieldEnd = comma ? comma : _end;
+
+    *start = _pos;
+    *length = fieldEnd - _pos;
+    _pos = fieldEnd;
+
+    return true;
+}
+
+// Reads a field (see above) and copies it to "buffer" with a null terminator.
+bool Sodaq_AT_Tokenizer::readString(char* buffer, size_t size)
+{
+    const char* start;
+    size_t length;
+
+    if (!readString(&start, &length) || (length >= size)) {
+        return false;
+    }
+
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    return true;
+}
+
+// Reads a field (see above) that holds a dotted IPv4 address and copies it to "buffer".
+bool Sodaq_AT_Tokenizer::readIP(char* buffer, size_t size)
+{
+    const char* start;
+    size_t length;
+
+    if (!readString(&start, &length) || (length == 0) || (length >= size)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (((start[i] < '0') || (start[i] > '9')) && (start[i] != '.')) {
+            return false;
+        }
+    }
+
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    return true;
+}
@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_AT_TOKENIZER_h
+#define _SODAQ_AT_TOKENIZER_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+
+/*!
+ * \brief Splits a response line (e.g. +NSORF: 0,"1.2.3.4",7,4,"AABB",0) into fields.
+ *
+ * It works on the line in place; it does not allocate or copy unless asked to.
+ * All the read methods return false (and leave the position undefined) when the
+ * input does not match, so they can be chained with &&.
+ */
+class Sodaq_AT_Tokenizer
+{
+  public:
+    Sodaq_AT_Tokenizer(const char* buffer, size_t size);
+
+    // Consumes "str" if the input continues with it.
+    bool skip(const char* str);
+
+    // Consumes the flash string "str" (F("...")) if the input continues with it.
+    bool skip(const __FlashStringHelper* str);
+
+    // Consumes the character "c" if it is the next character.
+    bool skip(char c);
+
+    // Returns true if the next character is "c", without consuming it.
+    bool peek(char c) const { return (_pos < _end) && (*_pos == c); }
+
+    // Returns true if all the input has been consumed.
+    bool atEnd() const { return _pos >= _end; }
+
+    // Reads a decimal integer with an optional sign. Leading spaces are skipped.
+    // Fails if the value does not fit in an int32_t.
+    bool readInt(int32_t* value);
+
+    // Reads a decimal integer into a smaller type, failing if it does not fit.
+    template<typename T>
+    bool readInt(T* value)
+    {
+        int32_t v;
+
+        bool isUnsigned = (static_cast<T>(-1) > 0);
+
+        if (!readInt(&v) || (isUnsigned && (v < 0)) || (static_cast<int32_t>(static_cast<T>(v)) != v)) {
+            return false;
+        }
+
+        *value = static_cast<T>(v);
+        return true;
+    }
+
+    // Reads a field, which is either a quoted string or the characters up to the next ','.
+    // The quotes are consumed but not included. Leading spaces are skipped.
+    // "start" points into the input buffer, it is not null terminated.
+    bool readString(const char** start, size_t* length);
+
+    // Reads a field (see above) and copies it to "buffer" with a null terminator.
+    // Fails if it does not fit.
+    bool readString(char* buffer, size_t size);
+
+    // Reads a field (see above) that holds a dotted IPv4 address and copies it to "buffer".
+    bool readIP(char* buffer, size_t size);
+
+  private:
+    const char* _pos;
+    const char* _end;
+
+    void skipSpaces();
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_HexCodec.h"
+#include <string.h>
+
+// On 32 bit little endian targets (SAMD, ARM, x86) two bytes are converted per 32 bit word
+// ("SIMD within a register"). On 8 bit targets (AVR) the plain lookup is faster.
+#if !defined(__AVR__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SODAQ_HEX_SWAR
+#endif
+
+static const char hexChars[] = "0123456789ABCDEF";
+
+// Maps '0'..'9' to 0..9 and 'A'..'F'/'a'..'f' to 10..15 (bit 6 is only set for the letters).
+#define HEX_CHAR_TO_NIBBLE(c) (((c) & 0x0F) + (((c) >> 6) & 0x01) * 9)
+
+// Encodes "size" bytes into 2 * "size" upper case hex characters.
+void sodaq_hex_encode(const uint8_t* src, size_t size, char* dst)
+{
+#ifdef SODAQ_HEX_SWAR
+    for (; size >= 2; size -= 2, src += 2, dst += 4) {
+        // spread the 4 nibbles over the 4 bytes of the word, in output order
+        uint32_t w = (src[0] >> 4) | (static_cast<uint32_t>(src[0] & 0x0F) << 8) |
+                     (static_cast<uint32_t>(src[1] >> 4) << 16) | (static_cast<uint32_t>(src[1] & 0x0F) << 24);
+
+        // '0' + n, plus 7 more for the nibbles >= 10 to get to 'A'
+        w += 0x30303030 + (((w + 0x06060606) >> 4) & 0x01010101) * 7;
+        memcpy(dst, &w, sizeof(w));
+    }
+#endif
+
+    for (size_t i = 0; i < size; i++) {
+        *dst++ = hexChars[src[i] >> 4];
+        *dst++ = hexChars[src[i] & 0x0F];
+    }
+}
+
+// Decodes "length" hex characters (upper or lower case) into "length" / 2 bytes.
+size_t sodaq_hex_decode(const char* src, size_t length, uint8_t* dst)
+{
+    size_t count = length / 2;
+    size_t i = 0;
+
+#ifdef SODAQ_HEX_SWAR
+    for (; i + 2 <= count; i += 2) {
+        uint32_t w;
+        memcpy(&w, &src[2 * i], sizeof(w));
+
+        uint32_t n = (w & 0x0F0F0F0F) + ((w >> 6) & 0x01010101) * 9;
+
+        // dst can overlap src, but it never gets ahead of the characters still to be read
+        dst[i] = ((n & 0x0F) << 4) | ((n >> 8) & 0x0F);
+        dst[i + 1] = (((n >> 16) & 0x0F) << 4) | (n >> 24);
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = (HEX_CHAR_TO_NIBBLE(src[2 * i]) << 4) | HEX_CHAR_TO_NIBBLE(src[2 * i + 1]);
+    }
+
+    return count;
+}
+
+// Returns the value of the hex digit "c" (upper or lower case), or -1 if it is not a hex digit.
+int8_t sodaq_hex_nibble(char c)
+{
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+
+    if (((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f'))) {
+        return HEX_CHAR_TO_NIBBLE(c);
+    }
+
+    return -1;
+}
+
+// Returns the number of hex digits (upper or lower case) at the start of the "length" characters of "src".
+size_t sodaq_hex_span(const char* src, size_t length)
+{
+    size_t i = 0;
+
+#ifdef SODAQ_HEX_SWAR
+    for (; i + 4 <= length; i += 4) {
+        uint32_t w;
+        memcpy(&w, &src[i], sizeof(w));
+
+        // for 7 bit characters the additions below do not carry into the next byte
+        if (w & 0x80808080) {
+            break;
+        }
+
+        // bit 7 is set for '0'..'9' (0x30..0x39) and, with bit 5 forced, for 'a'..'f' (0x61..0x66)
+        uint32_t l = w | 0x20202020;
+        uint32_t digits = (w + 0x50505050) & ~(w + 0x46464646);
+        uint32_t letters = (l + 0x1F1F1F1F) & ~(l + 0x19191919);
+
+        if (((digits | letters) & 0x80808080) != 0x80808080) {
+            break;
+        }
+    }
+#endif
+
+    // the rest, or the word with the first character that is not a hex digit
+    while ((i < length) && (sodaq_hex_nibble(src[i]) >= 0)) {
+        i++;
+    }
+
+    return i;
+}
@@ -0,0 +1,43 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_HEXCODEC_h
+#define _SODAQ_HEXCODEC_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Encodes "size" bytes into 2 * "size" upper case hex characters.
+// The output is not null terminated.
+void sodaq_hex_encode(const uint8_t* src, size_t size, char* dst);
+
+// Decodes "length" hex characters (upper or lower case) into "length" / 2 bytes.
+// "dst" may be the same buffer as "src" (decoding in place).
+// The characters are not checked, use sodaq_hex_nibble() for input that may not be hex.
+// Returns the number of bytes written.
+size_t sodaq_hex_decode(const char* src, size_t length, uint8_t* dst);
+
+// Returns the value of the hex digit "c" (upper or lower case), or -1 if it is not a hex digit.
+int8_t sodaq_hex_nibble(char c);
+
+// Returns the number of hex digits (upper or lower case) at the start of the "length" characters of "src".
+size_t sodaq_hex_span(const char* src, size_t length);
+
+#endif
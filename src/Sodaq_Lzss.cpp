@@ -0,0 +1,190 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_Lzss.h"
+#include <string.h>
+
+#define WINDOW_SIZE 256
+#define MIN_MATCH 3
+#define MAX_MATCH (MIN_MATCH + 255)
+
+// Compresses "size" bytes of "src" into "dst".
+// Returns the compressed size, or 0 if it does not fit in "dstSize".
+size_t sodaq_lzss_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+{
+    size_t pos = 0;
+    size_t length = 0;
+    size_t flagIndex = 0;
+    uint8_t flagBit = 8; // the current group is full, a new flag byte is needed
+
+    while (pos < size) {
+        if (flagBit == 8) {
+            if (length >= dstSize) {
+                return 0;
+            }
+
+            flagIndex = length++;
+            dst[flagIndex] = 0;
+            flagBit = 0;
+        }
+
+        // find the longest match in the window, the source itself is the window
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        size_t maxLength = (size - pos < MAX_MATCH) ? size - pos : MAX_MATCH;
+
+        if (maxLength >= MIN_MATCH) {
+            size_t windowStart = (pos > WINDOW_SIZE) ? pos - WINDOW_SIZE : 0;
+
+            for (size_t candidate = windowStart; candidate < pos; candidate++) {
+                if ((src[candidate] != src[pos]) || (src[candidate + bestLength] != src[pos + bestLength])) {
+                    continue;
+                }
+
+                size_t matchLength = 1;
+
+                // the match may run into the bytes being encoded (e.g. a run of the same byte)
+                while ((matchLength < maxLength) && (src[candidate + matchLength] == src[pos + matchLength])) {
+                    matchLength++;
+                }
+
+                if (matchLength > bestLength) {
+                    bestLength = matchLength;
+                    bestOffset = pos - candidate;
+
+                    if (bestLength == maxLength) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            if (length + 2 > dstSize) {
+                return 0;
+            }
+
+            dst[flagIndex] |= (1 << flagBit);
+            dst[length++] = bestOffset - 1;
+            dst[length++] = bestLength - MIN_MATCH;
+            pos += bestLength;
+        }
+        else {
+            if (length >= dstSize) {
+                return 0;
+            }
+
+            dst[length++] = src[pos++];
+        }
+
+        flagBit++;
+    }
+
+    return length;
+}
+
+// Decompresses "size" bytes of "src" into "dst".
+// Returns the decompressed size, or 0 if the input is malformed or does not fit in "dstSize".
+size_t sodaq_lzss_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+{
+    size_t pos = 0;
+    size_t length = 0;
+
+    while (pos < size) {
+        uint8_t flags = src[pos++];
+
+        for (uint8_t flagBit = 0; (flagBit < 8) && (pos < size); flagBit++) {
+            if (flags & (1 << flagBit)) {
+                if (pos + 2 > size) {
+                    return 0;
+                }
+
+                size_t offset = src[pos++] + 1;
+                size_t matchLength = src[pos++] + MIN_MATCH;
+
+                if ((offset > length) || (length + matchLength > dstSize)) {
+                    return 0;
+                }
+
+                // byte by byte, the match may overlap the output
+                for (size_t i = 0; i < matchLength; i++, length++) {
+                    dst[length] = dst[length - offset];
+                }
+            }
+            else {
+                if (length >= dstSize) {
+                    return 0;
+                }
+
+                dst[length++] = src[pos++];
+            }
+        }
+    }
+
+    return length;
+}
+
+// Packs "size" bytes of "src" into a frame that starts with a flag byte.
+// Returns the frame size, or 0 if it does not fit.
+size_t sodaq_lzss_pack_frame(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+{
+    if (dstSize < 1) {
+        return 0;
+    }
+
+    // only use the compressed data if it is smaller
+    size_t limit = (dstSize - 1 < size) ? dstSize - 1 : size;
+    size_t length = (size > 0) ? sodaq_lzss_compress(src, size, &dst[1], limit) : 0;
+
+    if ((length > 0) && (length < size)) {
+        dst[0] = SODAQ_LZSS_FRAME_COMPRESSED;
+        return 1 + length;
+    }
+
+    if (size + 1 > dstSize) {
+        return 0;
+    }
+
+    dst[0] = SODAQ_LZSS_FRAME_RAW;
+    memcpy(&dst[1], src, size);
+
+    return 1 + size;
+}
+
+// Unpacks a frame of sodaq_lzss_pack_frame() into "dst".
+// Returns the data size, or 0 if the frame is malformed or does not fit in "dstSize".
+size_t sodaq_lzss_unpack_frame(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+{
+    if (size < 1) {
+        return 0;
+    }
+
+    if (src[0] == SODAQ_LZSS_FRAME_COMPRESSED) {
+        return sodaq_lzss_decompress(&src[1], size - 1, dst, dstSize);
+    }
+
+    if ((src[0] != SODAQ_LZSS_FRAME_RAW) || (size - 1 > dstSize)) {
+        return 0;
+    }
+
+    memcpy(dst, &src[1], size - 1);
+
+    return size - 1;
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_LZSS_h
+#define _SODAQ_LZSS_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The first byte of a frame, see sodaq_lzss_pack_frame().
+#define SODAQ_LZSS_FRAME_RAW 0x00
+#define SODAQ_LZSS_FRAME_COMPRESSED 0x01
+
+// Compresses "size" bytes of "src" into "dst" (LZSS with a 256 byte window, no extra RAM).
+// The output is a sequence of groups: a flag byte followed by 8 items, a literal byte
+// (flag bit 0) or a match of 2 bytes (flag bit 1): the offset - 1 and the length - 3.
+// Returns the compressed size, or 0 if it does not fit in "dstSize".
+size_t sodaq_lzss_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
+
+// Decompresses "size" bytes of "src" into "dst".
+// Returns the decompressed size, or 0 if the input is malformed or does not fit in "dstSize".
+size_t sodaq_lzss_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
+
+// Packs "size" bytes of "src" into a frame that starts with a flag byte, so the receiving side can
+// tell compressed frames apart: SODAQ_LZSS_FRAME_COMPRESSED followed by the compressed data, or
+// SODAQ_LZSS_FRAME_RAW followed by the data as is if compressing does not make it smaller.
+// "dst" needs room for "size" + 1 bytes. Returns the frame size, or 0 if it does not fit.
+size_t sodaq_lzss_pack_frame(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
+
+// Unpacks a frame of sodaq_lzss_pack_frame() into "dst".
+// Returns the data size, or 0 if the frame is malformed or does not fit in "dstSize".
+size_t sodaq_lzss_unpack_frame(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
+
+#endif
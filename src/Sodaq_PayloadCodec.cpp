@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_PayloadCodec.h"
+
+#define HEADER_DELTA 0x01
+#define SEQUENCE_NUMBER_MASK 0x7F
+#define VARINT_MAX_SIZE 5
+
+// Encodes "value" as a zigzag varint. Returns the number of bytes written.
+size_t sodaq_varint_encode(int32_t value, uint8_t* dst)
+{
+    uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    size_t count = 0;
+
+    while (zigzag >= 0x80) {
+        dst[count++] = (zigzag & 0x7F) | 0x80;
+        zigzag >>= 7;
+    }
+
+    dst[count++] = zigzag;
+
+    return count;
+}
+
+// Decodes a zigzag varint. Returns the number of bytes read, or 0 if the input is invalid.
+size_t sodaq_varint_decode(const uint8_t* src, size_t size, int32_t* value)
+{
+    uint32_t zigzag = 0;
+
+    for (size_t i = 0; (i < size) && (i < VARINT_MAX_SIZE); i++) {
+        zigzag |= static_cast<uint32_t>(src[i] & 0x7F) << (7 * i);
+
+        if ((src[i] & 0x80) == 0) {
+            *value = static_cast<int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// Scales and rounds "value" to an integer.
+static int32_t quantize(float value, float scale)
+{
+    float scaled = value * scale;
+
+    return static_cast<int32_t>((scaled >= 0) ? (scaled + 0.5f) : (scaled - 0.5f));
+}
+
+Sodaq_PayloadEncoder::Sodaq_PayloadEncoder(const Sodaq_PayloadField* fields, uint8_t fieldCount) :
+    _fields(fields),
+    _fieldCount((fieldCount < SODAQ_PAYLOAD_MAX_FIELDS) ? fieldCount : SODAQ_PAYLOAD_MAX_FIELDS),
+    _keyFrameInterval(10),
+    _reportCount(0),
+    _sequenceNumber(0)
+{
+}
+
+// Encodes "values" (one per field) into "buffer".
+// Returns the size of the payload, or 0 if it does not fit.
+size_t Sodaq_PayloadEncoder::encode(const float* values, uint8_t* buffer, size_t size)
+{
+    bool isDelta = (_reportCount > 0) && ((_keyFrameInterval == 0) || (_reportCount < _keyFrameInterval));
+    uint8_t encoded[1 + SODAQ_PAYLOAD_MAX_FIELDS * VARINT_MAX_SIZE];
+    int32_t current[SODAQ_PAYLOAD_MAX_FIELDS];
+    size_t length = 0;
+
+    encoded[length++] = (_sequenceNumber << 1) | (isDelta ? HEADER_DELTA : 0);
+
+    for (uint8_t i = 0; i < _fieldCount; i++) {
+        current[i] = quantize(values[i], _fields[i].scale);
+
+        // the delta is taken of the rounded values, so the rounding errors do not add up
+        int32_t value = (isDelta && _fields[i].isDelta) ? current[i] - _previous[i] : current[i];
+
+        length += sodaq_varint_encode(value, &encoded[length]);
+    }
+
+    if (length > size) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = encoded[i];
+    }
+
+    for (uint8_t i = 0; i < _fieldCount; i++) {
+        _previous[i] = current[i];
+    }
+
+    _sequenceNumber = (_sequenceNumber + 1) & SEQUENCE_NUMBER_MASK;
+    _reportCount = isDelta ? _reportCount + 1 : 1;
+
+    return length;
+}
+
+Sodaq_PayloadDecoder::Sodaq_PayloadDecoder(const Sodaq_PayloadField* fields, uint8_t fieldCount) :
+    _fields(fields),
+    _fieldCount((fieldCount < SODAQ_PAYLOAD_MAX_FIELDS) ? fieldCount : SODAQ_PAYLOAD_MAX_FIELDS),
+    _hasPrevious(false),
+    _sequenceNumber(0)
+{
+}
+
+// Decodes the payload into "values" (one per field).
+// Returns false if the payload is malformed, or if it is relative to a report that was not decoded.
+bool Sodaq_PayloadDecoder::decode(const uint8_t* buffer, size_t size, float* values)
+{
+    if (size < 1) {
+        return false;
+    }
+
+    bool isDelta = (buffer[0] & HEADER_DELTA) != 0;
+    uint8_t sequenceNumber = buffer[0] >> 1;
+
+    if (isDelta && (!_hasPrevious || (sequenceNumber != ((_sequenceNumber + 1) & SEQUENCE_NUMBER_MASK)))) {
+        _hasPrevious = false;
+        return false;
+    }
+
+    int32_t current[SODAQ_PAYLOAD_MAX_FIELDS];
+    size_t index = 1;
+
+    for (uint8_t i = 0; i < _fieldCount; i++) {
+        size_t count = sodaq_varint_decode(&buffer[index], size - index, &current[i]);
+
+        if (count == 0) {
+            return false;
+        }
+
+        index += count;
+
+        if (isDelta && _fields[i].isDelta) {
+            current[i] += _previous[i];
+        }
+    }
+
+    if (index != size) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < _fieldCount; i++) {
+        _previous[i] = current[i];
+        values[i] = current[i] / _fields[i].scale;
+    }
+
+    _hasPrevious = true;
+    _sequenceNumber = sequenceNumber;
+
+    return true;
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_PAYLOADCODEC_h
+#define _SODAQ_PAYLOADCODEC_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The maximum number of fields of a payload schema.
+#ifndef SODAQ_PAYLOAD_MAX_FIELDS
+#define SODAQ_PAYLOAD_MAX_FIELDS 8
+#endif
+
+// Encodes "value" as a zigzag varint (small negative and positive values take few bytes).
+// "dst" must have room for 5 bytes. Returns the number of bytes written.
+size_t sodaq_varint_encode(int32_t value, uint8_t* dst);
+
+// Decodes a zigzag varint from the "size" bytes of "src".
+// Returns the number of bytes read, or 0 if the input is truncated or too long.
+size_t sodaq_varint_decode(const uint8_t* src, size_t size, int32_t* value);
+
+// A field of a payload schema.
+struct Sodaq_PayloadField {
+    float scale;  // the value is multiplied by this and rounded, e.g. 100 keeps 2 decimals
+    bool isDelta; // encoded as the difference to the value of the previous report
+};
+
+/*!
+ * \brief Encodes a report of sensor values into a compact binary payload.
+ *
+ * The payload is a header byte followed by a zigzag varint per field of the schema:
+ *   bit 0 of the header: set if the delta fields are relative to the previous report
+ *   bits 7..1: the sequence number of the report, so lost reports can be detected
+ * Every "key frame interval" reports (and after reset()) all fields are sent as absolute values.
+ * Sodaq_PayloadDecoder decodes it with the same schema, it has no Arduino dependencies so it
+ * can be used on the receiving side as well.
+ */
+class Sodaq_PayloadEncoder
+{
+  public:
+    // "fields" must remain valid.
+    Sodaq_PayloadEncoder(const Sodaq_PayloadField* fields, uint8_t fieldCount);
+
+    // Sends all the fields as absolute values every "interval" reports, 1 never uses deltas.
+    // 0 only sends the first report (after reset()) as absolute values. The default is 10.
+    void setKeyFrameInterval(uint8_t interval) { _keyFrameInterval = interval; }
+
+    // Encodes "values" (one per field) into "buffer".
+    // Returns the size of the payload, or 0 if it does not fit.
+    size_t encode(const float* values, uint8_t* buffer, size_t size);
+
+    // Makes the next report absolute.
+    void reset() { _reportCount = 0; }
+
+  private:
+    const Sodaq_PayloadField* _fields;
+    uint8_t _fieldCount;
+    uint8_t _keyFrameInterval;
+    uint8_t _reportCount; // since the last key frame
+    uint8_t _sequenceNumber;
+    int32_t _previous[SODAQ_PAYLOAD_MAX_FIELDS];
+};
+
+/*!
+ * \brief Decodes the payloads of Sodaq_PayloadEncoder, see there for the format.
+ */
+class Sodaq_PayloadDecoder
+{
+  public:
+    // "fields" must remain valid.
+    Sodaq_PayloadDecoder(const Sodaq_PayloadField* fields, uint8_t fieldCount);
+
+    // Decodes the payload into "values" (one per field).
+    // Returns false if the payload is malformed, or if it is relative to a report that was not
+    // decoded (lost), in which case the next key frame is needed.
+    bool decode(const uint8_t* buffer, size_t size, float* values);
+
+  private:
+    const Sodaq_PayloadField* _fields;
+    uint8_t _fieldCount;
+    bool _hasPrevious;
+    uint8_t _sequenceNumber;
+    int32_t _previous[SODAQ_PAYLOAD_MAX_FIELDS];
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_ReceiveQueue.h"
+#include <string.h>
+
+// The metadata is copied (not cast) in and out of the slots, the buffer does not need to be aligned.
+#define SLOT_METADATA_SIZE sizeof(SaraN2UDPPacketMetadata)
+
+Sodaq_ReceiveQueue::Sodaq_ReceiveQueue(uint8_t* buffer, size_t size, size_t maxDatagramSize) :
+    _buffer(buffer),
+    _maxDatagramSize(maxDatagramSize),
+    _slotSize(SLOT_METADATA_SIZE + maxDatagramSize),
+    _capacity(0),
+    _head(0),
+    _count(0),
+    _highWaterMark(0),
+    _overflowCount(0),
+    _droppedCount(0)
+{
+    size_t capacity = (buffer && (maxDatagramSize > 0)) ? size / _slotSize : 0;
+
+    _capacity = (capacity > UINT8_MAX) ? UINT8_MAX : capacity;
+}
+
+// Copies the oldest datagram to "buffer" and removes it from the queue.
+// Returns the number of bytes copied, 0 if the queue is empty.
+size_t Sodaq_ReceiveQueue::dequeue(uint8_t* buffer, size_t size, SaraN2UDPPacketMetadata* p)
+{
+    SaraN2UDPPacketMetadata metadata;
+    const uint8_t* data = peek(&metadata);
+
+    if (!data) {
+        return 0;
+    }
+
+    size_t length = (static_cast<size_t>(metadata.length) < size) ? metadata.length : size;
+
+    memcpy(buffer, data, length);
+
+    if (p) {
+        *p = metadata;
+    }
+
+    pop();
+
+    return length;
+}
+
+// Returns the data of the oldest datagram and its metadata in "p", or NULL if the queue is empty.
+const uint8_t* Sodaq_ReceiveQueue::peek(SaraN2UDPPacketMetadata* p)
+{
+    if (_count == 0) {
+        return NULL;
+    }
+
+    uint8_t* slot = getSlot(_head);
+
+    if (p) {
+        memcpy(p, slot, SLOT_METADATA_SIZE);
+    }
+
+    return &slot[SLOT_METADATA_SIZE];
+}
+
+void Sodaq_ReceiveQueue::pop()
+{
+    if (_count == 0) {
+        return;
+    }
+
+    _head = (_head + 1) % _capacity;
+    _count--;
+}
+
+void Sodaq_ReceiveQueue::resetCounters()
+{
+    _overflowCount = 0;
+    _droppedCount = 0;
+    _highWaterMark = _count;
+}
+
+// Returns the data part of the next free slot, or NULL if the queue is full.
+uint8_t* Sodaq_ReceiveQueue::reserve()
+{
+    if (isFull()) {
+        return NULL;
+    }
+
+    return &getSlot((_head + _count) % _capacity)[SLOT_METADATA_SIZE];
+}
+
+// Adds the datagram in the slot returned by reserve().
+void Sodaq_ReceiveQueue::commit(const SaraN2UDPPacketMetadata& metadata)
+{
+    if (isFull()) {
+        return;
+    }
+
+    memcpy(getSlot((_head + _count) % _capacity), &metadata, SLOT_METADATA_SIZE);
+    _count++;
+
+    if (_count > _highWaterMark) {
+        _highWaterMark = _count;
+    }
+}
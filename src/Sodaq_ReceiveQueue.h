@@ -0,0 +1,102 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_RECEIVEQUEUE_h
+#define _SODAQ_RECEIVEQUEUE_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Sodaq_nbIOT.h"
+
+/*!
+ * \brief A fixed capacity ring of received datagrams and their metadata.
+ *
+ * It is filled by Sodaq_nbIOT (see Sodaq_nbIOT::setReceiveQueue()) with the
+ * datagrams signalled by the +NSONMI/+UUSORF URCs, so the application can
+ * dequeue them without an AT round trip. It is only filled when the application
+ * calls Sodaq_nbIOT::prefetchDatagrams() or Sodaq_nbIOT::waitForUDPResponse(),
+ * Sodaq_nbIOT::poll() does not read datagrams. The storage is provided by the
+ * application, it is split into slots of the metadata plus "maxDatagramSize"
+ * bytes of data.
+ */
+class Sodaq_ReceiveQueue
+{
+  public:
+    Sodaq_ReceiveQueue(uint8_t* buffer, size_t size, size_t maxDatagramSize);
+
+    // Returns the number of datagrams that fit in the queue.
+    uint8_t getCapacity() const { return _capacity; }
+
+    // Returns the number of datagrams in the queue.
+    uint8_t getCount() const { return _count; }
+
+    bool isEmpty() const { return _count == 0; }
+    bool isFull() const { return _count >= _capacity; }
+
+    size_t getMaxDatagramSize() const { return _maxDatagramSize; }
+
+    // Copies the oldest datagram (up to "size" bytes) to "buffer" and removes it from the queue.
+    // Returns the number of bytes copied, 0 if the queue is empty.
+    size_t dequeue(uint8_t* buffer, size_t size, SaraN2UDPPacketMetadata* p = NULL);
+
+    // Returns the data of the oldest datagram (without copying it) and its metadata in "p",
+    // or NULL if the queue is empty. Remove it with pop() when done.
+    const uint8_t* peek(SaraN2UDPPacketMetadata* p);
+
+    // Removes the oldest datagram.
+    void pop();
+
+    // Returns the number of times the prefetch found the queue full while the modem had data,
+    // i.e. the data was left in the modem (which may overflow).
+    uint32_t getOverflowCount() const { return _overflowCount; }
+
+    // Returns the number of datagrams that were dropped because they did not fit in a slot.
+    uint32_t getDroppedCount() const { return _droppedCount; }
+
+    // Returns the highest number of datagrams that have been in the queue.
+    uint8_t getHighWaterMark() const { return _highWaterMark; }
+
+    void resetCounters();
+
+    // Used by Sodaq_nbIOT to fill the queue.
+    // Returns the data part of the next free slot, or NULL if the queue is full.
+    uint8_t* reserve();
+
+    // Adds the datagram in the slot returned by reserve().
+    void commit(const SaraN2UDPPacketMetadata& metadata);
+
+    void onOverflow() { _overflowCount++; }
+    void onDropped() { _droppedCount++; }
+
+  private:
+    uint8_t* _buffer;
+    size_t _maxDatagramSize;
+    size_t _slotSize;
+    uint8_t _capacity;
+    uint8_t _head;
+    uint8_t _count;
+    uint8_t _highWaterMark;
+    uint32_t _overflowCount;
+    uint32_t _droppedCount;
+
+    uint8_t* getSlot(uint8_t index) const { return &_buffer[index * _slotSize]; }
+};
+
+#endif
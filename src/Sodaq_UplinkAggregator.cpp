@@ -0,0 +1,140 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_UplinkAggregator.h"
+#include <string.h>
+
+#define RECORD_MAX_SIZE 255
+
+Sodaq_UplinkAggregator::Sodaq_UplinkAggregator(Sodaq_nbIOT& modem, uint8_t* buffer, size_t size) :
+    _modem(modem),
+    _buffer(buffer),
+    _size(size),
+    _length(0),
+    _maxLength(0),
+    _flushSize(0),
+    _flushAge(0),
+    _firstRecordTime(0),
+    _bufferedRecordCount(0),
+    _isSocketTarget(false),
+    _socket(0),
+    _remoteIP(NULL),
+    _remotePort(0),
+    _recordCount(0),
+    _datagramCount(0),
+    _byteCount(0)
+{
+    setMessageTarget();
+}
+
+void Sodaq_UplinkAggregator::setSocketTarget(uint8_t socket, const char* remoteIP, uint16_t remotePort)
+{
+    _isSocketTarget = true;
+    _socket = socket;
+    _remoteIP = remoteIP;
+    _remotePort = remotePort;
+    _maxLength = min(_size, static_cast<size_t>(SODAQ_NBIOT_MAX_UDP_BUFFER));
+}
+
+void Sodaq_UplinkAggregator::setMessageTarget()
+{
+    _isSocketTarget = false;
+    _maxLength = min(_size, static_cast<size_t>(SODAQ_NBIOT_MAX_MESSAGE_SIZE));
+}
+
+// Adds a record, flushing first if it does not fit.
+// Returns false if the record is too large, or if it does not fit because the flush failed.
+bool Sodaq_UplinkAggregator::add(const uint8_t* record, size_t size)
+{
+    if ((size > RECORD_MAX_SIZE) || (1 + size > _maxLength)) {
+        return false;
+    }
+
+    if ((_length + 1 + size > _maxLength) && !flush()) {
+        return false;
+    }
+
+    if (_length == 0) {
+        _firstRecordTime = millis();
+    }
+
+    _buffer[_length++] = size;
+    memcpy(&_buffer[_length], record, size);
+    _length += size;
+    _bufferedRecordCount++;
+
+    if ((_flushSize > 0) && (_length >= _flushSize)) {
+        // the record has been added, a failed flush is retried by the next add() or poll()
+        flush();
+        return true;
+    }
+
+    poll();
+
+    return true;
+}
+
+// Flushes if the flush age has been reached.
+bool Sodaq_UplinkAggregator::poll()
+{
+    if ((_length > 0) && (_flushAge > 0) && ((millis() - _firstRecordTime) >= _flushAge)) {
+        return flush();
+    }
+
+    return true;
+}
+
+// Sends the buffered records as one datagram.
+// Returns true if the records were sent, or if there was nothing to send.
+bool Sodaq_UplinkAggregator::flush(Sodaq_nbIOT::ReleaseAssistance releaseAssistance)
+{
+    if (_length == 0) {
+        return true;
+    }
+
+    bool isSent;
+
+    if (_isSocketTarget) {
+        isSent = (_modem.socketSend(_socket, _remoteIP, _remotePort, _buffer, _length, releaseAssistance) == _length);
+    }
+    else {
+        isSent = _modem.sendMessage(_buffer, _length);
+    }
+
+    if (!isSent) {
+        return false;
+    }
+
+    _recordCount += _bufferedRecordCount;
+    _datagramCount++;
+    _byteCount += _length;
+
+    _length = 0;
+    _bufferedRecordCount = 0;
+
+    return true;
+}
+
+void Sodaq_UplinkAggregator::resetStatistics()
+{
+    _recordCount = 0;
+    _datagramCount = 0;
+    _byteCount = 0;
+}
@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_UPLINKAGGREGATOR_h
+#define _SODAQ_UPLINKAGGREGATOR_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Sodaq_nbIOT.h"
+
+/*!
+ * \brief Packs small records into as few datagrams as possible.
+ *
+ * The records are buffered and sent as a single datagram, through socketSend()
+ * or sendMessage(), when the flush size or age is reached, when the next record
+ * does not fit, or when flush() is called.
+ * Each record is prefixed by its length (1 byte) in the datagram:
+ *   <length 1><record 1><length 2><record 2>...
+ * The buffer is provided by the application. The datagram size is limited to its
+ * size, SODAQ_NBIOT_MAX_UDP_BUFFER for sockets and SODAQ_NBIOT_MAX_MESSAGE_SIZE for messages.
+ */
+class Sodaq_UplinkAggregator
+{
+  public:
+    Sodaq_UplinkAggregator(Sodaq_nbIOT& modem, uint8_t* buffer, size_t size);
+
+    // Sends the datagrams through the socket to the remote IP and port, see Sodaq_nbIOT::socketSend().
+    // "remoteIP" must remain valid.
+    void setSocketTarget(uint8_t socket, const char* remoteIP, uint16_t remotePort);
+
+    // Sends the datagrams as messages to the CDP, see Sodaq_nbIOT::sendMessage(). This is the default.
+    void setMessageTarget();
+
+    // Flushes as soon as the buffered datagram is at least "size" bytes.
+    // 0 (the default) only flushes when the next record does not fit.
+    void setFlushSize(size_t size) { _flushSize = size; }
+
+    // Flushes when the oldest buffered record is "age" milliseconds old, checked by add() and poll().
+    // 0 (the default) disables it.
+    void setFlushAge(uint32_t age) { _flushAge = age; }
+
+    // Adds a record of up to 255 bytes, flushing first if it does not fit.
+    // Returns false if the record is too large, or if it does not fit because the flush failed.
+    bool add(const uint8_t* record, size_t size);
+
+    // Flushes if the flush age has been reached. Should be called regularly, e.g. from loop().
+    // Returns false if the flush failed.
+    bool poll();
+
+    // Sends the buffered records as one datagram, with an optional Release Assistance Indication
+    // (sockets on the N2 only). The records are kept if sending fails.
+    // Returns true if the records were sent, or if there was nothing to send.
+    bool flush(Sodaq_nbIOT::ReleaseAssistance releaseAssistance = Sodaq_nbIOT::ReleaseAssistanceNone);
+
+    // Returns the size of the datagram buffered so far and the number of records in it.
+    size_t getBufferedSize() const { return _length; }
+    uint8_t getBufferedRecordCount() const { return _bufferedRecordCount; }
+
+    // The statistics of the sent datagrams.
+    uint32_t getRecordCount() const { return _recordCount; }
+    uint32_t getDatagramCount() const { return _datagramCount; }
+    uint32_t getByteCount() const { return _byteCount; }
+
+    // Returns the average number of records per sent datagram.
+    float getPackingRatio() const { return (_datagramCount > 0) ? (float)_recordCount / _datagramCount : 0; }
+
+    void resetStatistics();
+
+  private:
+    Sodaq_nbIOT& _modem;
+    uint8_t* _buffer;
+    size_t _size;
+    size_t _length;
+    size_t _maxLength;
+    size_t _flushSize;
+    uint32_t _flushAge;
+    uint32_t _firstRecordTime;
+    uint8_t _bufferedRecordCount;
+
+    bool _isSocketTarget;
+    uint8_t _socket;
+    const char* _remoteIP;
+    uint16_t _remotePort;
+
+    uint32_t _recordCount;
+    uint32_t _datagramCount;
+    uint32_t _byteCount;
+};
+
+#endif
@@ -19,6 +19,9 @@
 */
 
 #include "Sodaq_nbIOT.h"
+#include "Sodaq_AT_Tokenizer.h"
+#include "Sodaq_HexCodec.h"
+#include "Sodaq_ReceiveQueue.h"
 #include <Sodaq_wdt.h>
 #include "time.h"
 
@@ -27,6 +30,15 @@
 #define EPOCH_TIME_OFF      946684800  // This is 1st January 2000, 00:00:00 in epoch time
 #define EPOCH_TIME_YEAR_OFF 100        // years since 1900
 #define COPS_TIMEOUT 180000
+#define SIGNAL_QUALITY_TIMEOUT (5L * 60L * 1000)
+#define ATTACH_TIMEOUT (10L * 60L * 1000)
+#define CGATT_TIMEOUT 10000
+
+// The time between the checks of the signal quality and attach steps of a connect starts at
+// the first value and grows by the second one up to the third one (ms).
+#define CONNECT_CHECK_FIRST_DELAY 500
+#define CONNECT_CHECK_DELAY_STEP 1000
+#define CONNECT_CHECK_MAX_DELAY 5000
 
 #define STR_AT "AT"
 #define STR_RESPONSE_OK "OK"
@@ -36,13 +48,6 @@
 
 #define DEBUG_STR_ERROR "[ERROR]: "
 
-#define NIBBLE_TO_HEX_CHAR(i) ((i <= 9) ? ('0' + i) : ('A' - 10 + i))
-#define HIGH_NIBBLE(i) ((i >> 4) & 0x0F)
-#define LOW_NIBBLE(i) (i & 0x0F)
-
-#define HEX_CHAR_TO_NIBBLE(c) ((c >= 'A') ? (c - 'A' + 0x0A) : (c - '0'))
-#define HEX_PAIR_TO_BYTE(h, l) ((HEX_CHAR_TO_NIBBLE(h) << 4) + HEX_CHAR_TO_NIBBLE(l))
-
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
@@ -73,25 +78,76 @@
 
 #define SOCKET_FAIL -1
 
-#define SOCKET_COUNT 7
+// The part of the input buffer for the response line of a datagram handler read,
+// e.g. +USORF: 0,"255.255.255.255",65535,1024,"",1024; the data goes after it.
+#define DATAGRAM_LINE_SIZE 64
 
 #define NOW (uint32_t)millis()
 
+// The time (seconds) the N2 waits for a command at the new baud rate before falling back (AT+NATSPEED).
+#define SARA_N2_NATSPEED_TIMEOUT 3
+
+// The time (ms) to wait for the '@' prompt of a binary data mode AT+USOST.
+#define SARA_R4_DATA_PROMPT_TIMEOUT 1000
+
+// The time (ms) to wait after the '@' prompt before sending the data, u-blox asks for at least 50ms.
+#define SARA_R4_DATA_PROMPT_DELAY 50
+
+// The time (ms) to wait after a missing '@' prompt, for the modem to give up waiting for the data
+// (or to reject the command). Commands sent before then would end up in the datagram.
+#define SARA_R4_DATA_TIMEOUT 10000
+
 typedef struct NameValuePair {
-    const char* Name;
+    const char* Name; // in flash (PROGMEM)
     bool Value;
 } NameValuePair;
 
+static const char nConfigAutoconnect[] PROGMEM = "AUTOCONNECT";
+static const char nConfigScrambling[] PROGMEM = "CR_0354_0338_SCRAMBLING";
+static const char nConfigSiAvoid[] PROGMEM = "CR_0859_SI_AVOID";
+static const char nConfigCombineAttach[] PROGMEM = "COMBINE_ATTACH";
+static const char nConfigCellReselection[] PROGMEM = "CELL_RESELECTION";
+static const char nConfigEnableBip[] PROGMEM = "ENABLE_BIP";
+
 const uint8_t nConfigCount = 6;
 static NameValuePair nConfig[nConfigCount] = {
-    { "AUTOCONNECT", false },
-    { "CR_0354_0338_SCRAMBLING", true },
-    { "CR_0859_SI_AVOID", false },
-    { "COMBINE_ATTACH", false },
-    { "CELL_RESELECTION", false },
-    { "ENABLE_BIP", false },
+    { nConfigAutoconnect, false },
+    { nConfigScrambling, true },
+    { nConfigSiAvoid, false },
+    { nConfigCombineAttach, false },
+    { nConfigCellReselection, false },
+    { nConfigEnableBip, false },
 };
 
+#define FLASH_STRING(x) reinterpret_cast<const __FlashStringHelper*>(x)
+
+// A unit of the 3GPP TS 24.008 GPRS timers (bits 8 to 6 of the timer value).
+typedef struct PsmTimerUnit {
+    uint8_t Code;
+    uint32_t Seconds;
+} PsmTimerUnit;
+
+// The units of the periodic TAU (T3412 extended, GPRS Timer 3), ascending.
+static const PsmTimerUnit periodicTauUnits[] = {
+    { 3, 2 },
+    { 4, 30 },
+    { 5, 60 },
+    { 0, 600 },
+    { 1, 3600 },
+    { 2, 36000 },
+    { 6, 1152000 },
+};
+
+// The units of the active time (T3324, GPRS Timer 2), ascending.
+static const PsmTimerUnit activeTimeUnits[] = {
+    { 0, 2 },
+    { 1, 60 },
+    { 2, 360 },
+};
+
+#define PSM_TIMER_MAX_VALUE 31
+#define PSM_TIMER_UNKNOWN 0xFF
+
 class Sodaq_nbIotOnOff : public Sodaq_OnOffBee
 {
     public:
@@ -114,30 +170,366 @@ static inline bool is_timedout(uint32_t from, uint32_t nr_ms)
     return (millis() - from) > nr_ms;
 }
 
-Sodaq_nbIOT::Sodaq_nbIOT() :
+// The symbol of the family setting the library is built with, see SODAQ_NBIOT_BUILD_FAMILY.
+const uint8_t SODAQ_NBIOT_BUILD_FAMILY = 0;
+
+Sodaq_nbIOT::Sodaq_nbIOT(const uint8_t*) :
+    _asyncHead(0),
+    _asyncCount(0),
+    _isAsyncCommandSent(false),
+    _asyncCommandStart(0),
+    _asyncResponse(ResponseNotFound),
+    _connectState(ConnectIdle),
+    _connectStep(ConnectStepOperator),
+    _connectStepStart(0),
+    _connectCheckStart(0),
+    _connectCheckDelay(0),
+    _connectCsq(0),
+    _connectBer(0),
+    _connectAttachState(0),
+    _urcHandlerCount(0),
+    _receiveQueue(NULL),
+    _datagramHandler(NULL),
+    _datagramHandlerParameter(NULL),
+    _droppedDatagramCount(0),
     _lastRSSI(0),
     _CSQtime(0),
-    _minRSSI(-113) // dBm
+    _minRSSI(-113), // dBm
+    _isChainingSupported(true),
+    _networkRegistrationStatus(NetworkNotRegistered),
+    _isSignallingConnected(false),
+    _isNetworkEvent(false),
+    _isInPsm(false),
+    _isPsmRequested(false),
+    _grantedActiveTime(PSM_TIMER_UNKNOWN),
+    _grantedPeriodicTau(PSM_TIMER_UNKNOWN),
+    _isWarmConnect(false),
+    _skippedConnectPhases(0),
+    _upgradeBaudrate(0),
+    _currentBaudrate(0),
+    _isBinaryDataMode(false)
+{
+    memset(_sockets, 0, sizeof(_sockets));
+    _pin[0] = '\0';
+    _copsCommand[0] = '\0';
+
+    addUrcHandler(F("+UFOTAS:"), (UrcHandlerPtr)_fotaUrcHandler, this);
+    addUrcHandler(F("+NSONMI:"), (UrcHandlerPtr)_socketDataUrcHandler, this);
+    addUrcHandler(F("+UUSORF:"), (UrcHandlerPtr)_socketDataUrcHandler, this);
+    addUrcHandler(F("+UUSOCL:"), (UrcHandlerPtr)_socketClosedUrcHandler, this);
+    addUrcHandler(F("+CEREG:"), (UrcHandlerPtr)_networkUrcHandler, this);
+    addUrcHandler(F("+CSCON:"), (UrcHandlerPtr)_networkUrcHandler, this);
+    addUrcHandler(F("+CGEV:"), (UrcHandlerPtr)_networkUrcHandler, this);
+    addUrcHandler(F("+NPSMR:"), (UrcHandlerPtr)_networkUrcHandler, this);
+    addUrcHandler(F("+UUPSMR:"), (UrcHandlerPtr)_networkUrcHandler, this);
+}
+
+// Registers a handler for the URC lines starting with "prefix" (e.g. "+CEREG:").
+// Returns false if the prefix is invalid or there is no room for another handler.
+bool Sodaq_nbIOT::addUrcHandler(const char* prefix, UrcHandlerPtr handler, void* parameter)
+{
+    return registerUrcHandler(prefix, false, handler, parameter);
+}
+
+// Registers a handler for the URC lines starting with the flash string "prefix" (e.g. F("+CEREG:")).
+// Returns false if the prefix is invalid or there is no room for another handler.
+bool Sodaq_nbIOT::addUrcHandler(const __FlashStringHelper* prefix, UrcHandlerPtr handler, void* parameter)
+{
+    return registerUrcHandler(reinterpret_cast<const char*>(prefix), true, handler, parameter);
+}
+
+// Registers a handler for the URC lines starting with "prefix", which is in flash if "isFlashPrefix".
+// Returns false if the prefix is invalid or there is no room for another handler.
+bool Sodaq_nbIOT::registerUrcHandler(const char* prefix, bool isFlashPrefix, UrcHandlerPtr handler, void* parameter)
+{
+    if (!prefix || !handler) {
+        return false;
+    }
+
+    // the '+' and the two characters of the key
+    char start[3];
+
+    for (uint8_t i = 0; i < sizeof(start); i++) {
+        start[i] = isFlashPrefix ? pgm_read_byte(&prefix[i]) : prefix[i];
+
+        if (start[i] == '\0') {
+            return false;
+        }
+    }
+
+    if (start[0] != '+') {
+        return false;
+    }
+
+    if (_urcHandlerCount >= SODAQ_NBIOT_MAX_URC_HANDLERS) {
+        return false;
+    }
+
+    UrcHandler& urc = _urcHandlers[_urcHandlerCount++];
+    urc.prefix = prefix;
+    urc.prefixLength = isFlashPrefix ? strlen_P(prefix) : strlen(prefix);
+    urc.isFlashPrefix = isFlashPrefix;
+    urc.key = urcKey(start);
+    urc.handler = handler;
+    urc.parameter = parameter;
+
+    return true;
+}
+
+// Passes the line to the matching URC handler, if there is one.
+// Only the lines starting with '+' are looked up. The two characters after the '+' are
+// compared as a single key first, so the full prefix is compared at most once per line.
+// Returns true if the line was handled.
+bool Sodaq_nbIOT::handleUrc(const char* buffer, size_t size)
+{
+    if ((size < 3) || (buffer[0] != '+')) {
+        return false;
+    }
+
+    uint16_t key = urcKey(buffer);
+
+    for (uint8_t i = 0; i < _urcHandlerCount; i++) {
+        const UrcHandler& urc = _urcHandlers[i];
+
+        if ((urc.key != key) || (size < urc.prefixLength)) {
+            continue;
+        }
+
+        int compare = urc.isFlashPrefix ? strncmp_P(buffer, urc.prefix, urc.prefixLength) :
+                      strncmp(buffer, urc.prefix, urc.prefixLength);
+
+        if (compare == 0) {
+            urc.handler(buffer, size, urc.parameter);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Sodaq_nbIOT::_fotaUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self)
+{
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint16_t blkRm;
+    uint8_t transferStatus;
+
+    if (tokenizer.skip(F("+UFOTAS:")) && tokenizer.readInt(&blkRm) &&
+            tokenizer.skip(',') && tokenizer.readInt(&transferStatus)) {
+        self->onFotaUrc(blkRm, transferStatus);
+    }
+}
+
+void Sodaq_nbIOT::onFotaUrc(uint16_t blkRm, uint8_t transferStatus)
+{
+    debugPrint(F("Unsolicited: FOTA: "));
+    debugPrint(blkRm);
+    debugPrint(F(", "));
+    debugPrintLn(transferStatus);
+}
+
+// Handles both +NSONMI (N2) and +UUSORF (R4), which have the same parameters.
+void Sodaq_nbIOT::_socketDataUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self)
+{
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t socketID;
+    size_t dataLength;
+
+    if ((tokenizer.skip(F("+NSONMI:")) || tokenizer.skip(F("+UUSORF:"))) && tokenizer.readInt(&socketID) &&
+            tokenizer.skip(',') && tokenizer.readInt(&dataLength)) {
+        self->onSocketDataUrc(socketID, dataLength);
+    }
+}
+
+void Sodaq_nbIOT::onSocketDataUrc(uint8_t socketID, size_t dataLength)
+{
+    debugPrint(F("Unsolicited: Socket "));
+    debugPrint(socketID);
+    debugPrint(F(": "));
+    debugPrintLn(dataLength);
+
+    if (socketID >= SODAQ_NBIOT_SOCKET_COUNT) {
+        return;
+    }
+
+    SocketState& socket = _sockets[socketID];
+
+    if (isSaraR4XX()) {
+        // the total number of bytes that can be read
+        socket.pendingBytes = dataLength;
+        socket.datagramCount = (dataLength > 0) ? 1 : 0;
+    }
+    else {
+        // one URC per received datagram
+        socket.pendingBytes += dataLength;
+        socket.datagramCount++;
+    }
+}
+
+void Sodaq_nbIOT::_socketClosedUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self)
+{
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t socketID;
+
+    if (tokenizer.skip(F("+UUSOCL:")) && tokenizer.readInt(&socketID)) {
+        self->onSocketClosedUrc(socketID);
+    }
+}
+
+void Sodaq_nbIOT::onSocketClosedUrc(uint8_t socketID)
+{
+    debugPrint(F("Unsolicited: Socket closed: "));
+    debugPrintLn(socketID);
+
+    if (socketID < SODAQ_NBIOT_SOCKET_COUNT) {
+        _sockets[socketID].isClosed = true;
+    }
+}
+
+// Parses the string of "length" '0' and '1' characters (e.g. "01000011") into "value".
+static bool parseBits(const char* str, size_t length, uint8_t* value)
+{
+    if ((length == 0) || (length > 8)) {
+        return false;
+    }
+
+    *value = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        if ((str[i] != '0') && (str[i] != '1')) {
+            return false;
+        }
+
+        *value = (*value << 1) | (str[i] - '0');
+    }
+
+    return true;
+}
+
+// Formats the lowest "count" bits of "value" as '0' and '1' characters, null terminated.
+static void formatBits(uint8_t value, uint8_t count, char* buffer)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        buffer[i] = (value & (1 << (count - 1 - i))) ? '1' : '0';
+    }
+
+    buffer[count] = '\0';
+}
+
+// Handles +CEREG (registration), +CSCON (signalling connection), +CGEV (packet domain events)
+// and +NPSMR/+UUPSMR (power saving mode).
+// Only the URC forms are expected, this library does not query these with "?".
+void Sodaq_nbIOT::_networkUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self)
+{
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t value;
+
+    // +CEREG: <stat>[,[<tac>],[<ci>],[<AcT>][,[<cause_type>],[<reject_cause>][,[<Active-Time>],[<Periodic-TAU>]]]]
+    if (tokenizer.skip(F("+CEREG:")) && tokenizer.readInt(&value)) {
+        self->onRegistrationUrc(value);
+
+        const char* field;
+        size_t fieldLength;
+        uint8_t index = 0;
+        uint8_t activeTime = PSM_TIMER_UNKNOWN;
+        uint8_t periodicTau;
+
+        while (tokenizer.skip(',') && tokenizer.readString(&field, &fieldLength)) {
+            index++;
+
+            if ((index == 6) && !parseBits(field, fieldLength, &activeTime)) {
+                break;
+            }
+
+            if ((index == 7) && parseBits(field, fieldLength, &periodicTau)) {
+                self->onPsmTimersUrc(activeTime, periodicTau);
+            }
+        }
+    }
+    // +NPSMR: <mode> (N2), +UUPSMR: <state> (R4)
+    else if ((tokenizer.skip(F("+NPSMR:")) || tokenizer.skip(F("+UUPSMR:"))) && tokenizer.readInt(&value)) {
+        self->onPsmUrc(value == 1);
+    }
+    // +CSCON: <mode>
+    else if (tokenizer.skip(F("+CSCON:")) && tokenizer.readInt(&value)) {
+        self->onSignallingConnectionUrc(value == 1);
+    }
+    // +CGEV: NW DETACH, +CGEV: ME PDN ACT 0, ...
+    else if (tokenizer.skip(F("+CGEV:"))) {
+        tokenizer.skip(' ');
+
+        if ((tokenizer.skip(F("NW ")) || tokenizer.skip(F("ME "))) && tokenizer.skip(F("DETACH"))) {
+            self->onDetachUrc();
+        }
+        else {
+            // e.g. a PDN (de)activation, worth checking the attach state
+            self->_isNetworkEvent = true;
+        }
+    }
+}
+
+void Sodaq_nbIOT::onRegistrationUrc(uint8_t status)
+{
+    debugPrint(F("Unsolicited: Registration: "));
+    debugPrintLn(status);
+
+    _networkRegistrationStatus = (status <= NetworkRegisteredRoaming) ?
+                                 static_cast<NetworkRegistrationStatuses>(status) : NetworkStatusUnknown;
+    _isNetworkEvent = true;
+}
+
+void Sodaq_nbIOT::onSignallingConnectionUrc(bool isConnected)
+{
+    debugPrint(F("Unsolicited: Signalling connection: "));
+    debugPrintLn(isConnected);
+
+    _isSignallingConnected = isConnected;
+    _isNetworkEvent = true;
+
+    if (isConnected) {
+        _isInPsm = false;
+    }
+}
+
+void Sodaq_nbIOT::onPsmUrc(bool isInPsm)
+{
+    debugPrint(F("Unsolicited: PSM: "));
+    debugPrintLn(isInPsm);
+
+    _isInPsm = isInPsm;
+    _isNetworkEvent = true;
+}
+
+void Sodaq_nbIOT::onPsmTimersUrc(uint8_t activeTime, uint8_t periodicTau)
+{
+    _grantedActiveTime = activeTime;
+    _grantedPeriodicTau = periodicTau;
+}
+
+void Sodaq_nbIOT::onDetachUrc()
 {
+    debugPrintLn(F("Unsolicited: Detached"));
 
+    _networkRegistrationStatus = NetworkNotRegistered;
+    _isNetworkEvent = true;
 }
 
 // Returns true if the modem replies to "AT" commands without timing out.
 bool Sodaq_nbIOT::isAlive()
 {
-    println(STR_AT);
+    println(F(STR_AT));
     
     return (readResponse(NULL, 450) == ResponseOK);
 }
 
 // Initializes the modem instance. Sets the modem stream and the on-off power pins.
-void Sodaq_nbIOT::init(Stream& stream, int8_t onoffPin, int8_t txEnablePin, int8_t saraR4XXTogglePin, uint8_t cid)
+void Sodaq_nbIOT::init(Stream& stream, int8_t onoffPin, int8_t txEnablePin, int8_t saraR4XXTogglePin, uint8_t cid,
+                       bool binaryDataMode)
 {
-    debugPrintLn("[init] started.");
+    debugPrintLn(F("[init] started."));
 
     _isSaraR4XX = (saraR4XXTogglePin != -1);
-    if (_isSaraR4XX) {
-        debugPrintLn("Enabling sara R4XX functionality");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Enabling sara R4XX functionality"));
     }
 
     initBuffer(); // safe to call multiple times
@@ -149,6 +541,18 @@ void Sodaq_nbIOT::init(Stream& stream, int8_t onoffPin, int8_t txEnablePin, int8
     
     setTxEnablePin(txEnablePin);
 	_cid = cid;
+    _isBinaryDataMode = isSaraR4XX() && binaryDataMode;
+
+    _currentBaudrate = isSaraR4XX() ? getSaraR4Baudrate() : getSaraN2Baudrate();
+}
+
+// Turns the modem off and returns true if successful.
+// The stream is switched back to the default baud rate if it was changed by connect().
+bool Sodaq_nbIOT::off()
+{
+    restoreDefaultBaudrate();
+
+    return Sodaq_AT_Device::off();
 }
 
 // Gets International Mobile Equipment Identity.
@@ -164,7 +568,7 @@ bool Sodaq_nbIOT::getIMEI(char* buffer, size_t size)
         buffer[0] = 0;
     }
 
-    println("AT+CGSN");
+    println(F("AT+CGSN"));
 
     return (readResponse<char, size_t>(_nakedStringParser, buffer, &size) == ResponseOK);
 }
@@ -187,10 +591,15 @@ ResponseTypes Sodaq_nbIOT::_nakedStringParser(ResponseTypes& response, const cha
     return ResponseError;
 }
 
+// Sets the SIM PIN used by connect() when the SIM needs it (at most SODAQ_NBIOT_MAX_PIN_LENGTH digits).
 void Sodaq_nbIOT::setPin(const char * pin)
 {
-    size_t len = strlen(pin);
-    _pin = static_cast<char*>(realloc(_pin, len + 1));
+    if (strlen(pin) > SODAQ_NBIOT_MAX_PIN_LENGTH) {
+        debugPrintLn(F("Error: The PIN is too long"));
+        _pin[0] = '\0';
+        return;
+    }
+
     strcpy(_pin, pin);
 }
 
@@ -204,8 +613,8 @@ bool Sodaq_nbIOT::doSIMcheck()
 
         SimStatuses simStatus = getSimStatus();
         if (simStatus == SimNeedsPin) {
-            if (_pin == 0 || *_pin == '\0' || !setSimPin(_pin)) {
-                debugPrintLn(DEBUG_STR_ERROR "SIM needs a PIN but none was provided, or setting it failed!");
+            if ((_pin[0] == '\0') || !setSimPin(_pin)) {
+                debugPrintLn(F(DEBUG_STR_ERROR "SIM needs a PIN but none was provided, or setting it failed!"));
                 return false;
             }
         }
@@ -223,9 +632,12 @@ ResponseTypes Sodaq_nbIOT::_cpinParser(ResponseTypes& response, const char* buff
         return ResponseError;
     }
 
-    char status[16];
-    if (sscanf(buffer, "+CPIN: %" STR(sizeof(status) - 1) "s", status) == 1) {
-        if (startsWith("READY", status)) {
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    const char* status;
+    size_t length;
+
+    if (tokenizer.skip(F("+CPIN:")) && tokenizer.readString(&status, &length) && (length > 0)) {
+        if ((length == 5) && (strncmp_P(status, PSTR("READY"), length) == 0)) {
             *parameter = SimReady;
         }
         else {
@@ -243,7 +655,7 @@ Sodaq_nbIOT::SimStatuses Sodaq_nbIOT::getSimStatus()
 {
     SimStatuses simStatus;
 
-    println("AT+CPIN?");
+    println(F("AT+CPIN?"));
     if (readResponse<SimStatuses, uint8_t>(_cpinParser, &simStatus, NULL) == ResponseOK) {
         return simStatus;
     }
@@ -253,29 +665,29 @@ Sodaq_nbIOT::SimStatuses Sodaq_nbIOT::getSimStatus()
 
 bool Sodaq_nbIOT::setSimPin(const char* simPin)
 {
-    print("AT+CPIN=\"");
+    print(F("AT+CPIN=\""));
     print(simPin);
-    println("\"");
+    println('"');
 
     return (readResponse() == ResponseOK);
 }
 
 bool Sodaq_nbIOT::setRadioActive(bool on)
 {
-    print("AT+CFUN=");
-    println(on ? "1" : "0");
+    print(F("AT+CFUN="));
+    println(on ? '1' : '0');
     
     return (readResponse() == ResponseOK);
 }
 
 bool Sodaq_nbIOT::setVerboseErrors(bool on)
 {
-    print("AT+CMEE=");
-    if (_isSaraR4XX) {
-        println(on ? "2" : "0"); // r4 supports verbose error messages
+    print(F("AT+CMEE="));
+    if (isSaraR4XX()) {
+        println(on ? '2' : '0'); // r4 supports verbose error messages
     }
     else {
-        println(on ? "1" : "0"); // 2 is not supported on the n2, according to AT command manual
+        println(on ? '1' : '0'); // 2 is not supported on the n2, according to AT command manual
     }
     
     return (readResponse() == ResponseOK);
@@ -283,22 +695,22 @@ bool Sodaq_nbIOT::setVerboseErrors(bool on)
 
 bool Sodaq_nbIOT::setIndicationsActive(bool on)
 {
-    if (!_isSaraR4XX) {
+    if (!isSaraR4XX()) {
         // TODO: this is the N2 command, there is no R4XX equivalent command
-        print("AT+NSMI=");
-        println(on ? "1" : "0");
+        print(F("AT+NSMI="));
+        println(on ? '1' : '0');
         if (readResponse() != ResponseOK) {
             return false;
         }
     }
     
-    if (_isSaraR4XX) {
-        print("AT+CNMI=");
-        println(on ? "1" : "0");
+    if (isSaraR4XX()) {
+        print(F("AT+CNMI="));
+        println(on ? '1' : '0');
     }
     else {
-        print("AT+NNMI=");
-        println(on ? "1" : "0");
+        print(F("AT+NNMI="));
+        println(on ? '1' : '0');
     }
     
     return (readResponse() == ResponseOK);
@@ -307,10 +719,10 @@ bool Sodaq_nbIOT::setIndicationsActive(bool on)
 /*!
     Read the next response from the modem
 
-    Notice that we're collecting URC's here. And in the process we could
-    be updating:
-      _socketPendingBytes[] if +NSONMI/UUSORF: is seen
-      _socketClosedBit[] if +UUSOCL: is seen
+    Notice that we're collecting URC's here, see handleUrc(). And in the
+    process we could be updating:
+      _sockets[].pendingBytes if +NSONMI/UUSORF: is seen
+      _sockets[].isClosed if +UUSOCL: is seen
 */
 ResponseTypes Sodaq_nbIOT::readResponse(char* buffer, size_t size,
                                         CallbackMethodPtr parserMethod, void* callbackParameter, void* callbackParameter2,
@@ -320,7 +732,8 @@ ResponseTypes Sodaq_nbIOT::readResponse(char* buffer, size_t size,
     uint32_t from = NOW;
     
     do {
-        // 250ms,  how many bytes at which baudrate?
+        // readLn() blocks until data arrives (or 250ms of silence), so there is
+        // no need to poll; the 250ms only bounds the time between watchdog resets
         int count = readLn(buffer, size, 250);
         sodaq_wdt_reset();
         
@@ -329,99 +742,12 @@ ResponseTypes Sodaq_nbIOT::readResponse(char* buffer, size_t size,
                 *outSize = count;
             }
             
-            if (_disableDiag && strncmp(buffer, "OK", 2) != 0) {
-                _disableDiag = false;
-            }
-            
-            debugPrint("[rdResp]: ");
-            debugPrintLn(buffer);
-
-            int param1, param2;
-            if (sscanf(buffer, "+UFOTAS: %d,%d", &param1, &param2) == 2) { // Handle FOTA URC
-                uint16_t blkRm = param1;
-                uint8_t transferStatus = param2;
-
-                debugPrint("Unsolicited: FOTA: ");
-                debugPrint(blkRm);
-                debugPrint(", ");
-                debugPrintLn(transferStatus);
-                
-                continue; 
-            }
-            else if (!_isSaraR4XX && sscanf(buffer, "+NSONMI: %d,%d", &param1, &param2) == 2) { // Handle socket URC for N2
-                int socketID = param1;
-                int dataLength = param2;
-
-                debugPrint("Unsolicited: Socket ");
-                debugPrint(socketID);
-                debugPrint(": ");
-                debugPrintLn(dataLength);
-                _receivedUDPResponseSocket = socketID;
-                _pendingUDPBytes = dataLength;
-
-                continue;
-            }
-            else if (sscanf(buffer, "+UUSORF: %d,%d", &param1, &param2) == 2) {
-                int socketID = param1;
-                int dataLength = param2;
-
-                debugPrint("Unsolicited: Socket ");
-                debugPrint(socketID);
-                debugPrint(": ");
-                debugPrintLn(dataLength);
-                _receivedUDPResponseSocket = socketID;
-                _pendingUDPBytes = dataLength;
-
-                continue;
-            }
-            
-            if (startsWith(STR_AT, buffer)) {
-                continue; // skip echoed back command
-            }
-            
-            _disableDiag = false;
-            
-            if (startsWith(STR_RESPONSE_OK, buffer)) {
-                return ResponseOK;
-            }
-            
-            if (startsWith(STR_RESPONSE_ERROR, buffer) ||
-                    startsWith(STR_RESPONSE_CME_ERROR, buffer) ||
-                    startsWith(STR_RESPONSE_CMS_ERROR, buffer)) {
-                return ResponseError;
-            }
-            
-            if (parserMethod) {
-                ResponseTypes parserResponse = parserMethod(response, buffer, count, callbackParameter, callbackParameter2);
-                
-                if ((parserResponse != ResponseEmpty) && (parserResponse != ResponsePendingExtra)) {
-                    return parserResponse;
-                }
-                else {
-                    // ?
-                    // ResponseEmpty indicates that the parser was satisfied
-                    // Continue until "OK", "ERROR", or whatever else.
-                }
-                
-                // Prevent calling the parser again.
-                // This could happen if the input line is too long. It will be split
-                // and the next readLn will return the next part.
-                // The case of "ResponsePendingExtra" is an exception to this, thus waiting for more replies to be parsed.
-                if (parserResponse != ResponsePendingExtra) {
-                    parserMethod = 0;
-                }
-            }
-            
-            // at this point, the parserMethod has ran and there is no override response from it,
-            // so if there is some other response recorded, return that
-            // (otherwise continue iterations until timeout)
-            if (response != ResponseNotFound) {
-                debugPrintLn("** response != ResponseNotFound");
-                return response;
+            ResponseTypes result;
+
+            if (processResponseLine(buffer, count, parserMethod, callbackParameter, callbackParameter2, response, &result)) {
+                return result;
             }
         }
-        
-        delay(10);      // TODO Why do we need this delay?
     }
     while (!is_timedout(from, timeout));
     
@@ -429,192 +755,939 @@ ResponseTypes Sodaq_nbIOT::readResponse(char* buffer, size_t size,
         *outSize = 0;
     }
     
-    debugPrintLn("[rdResp]: timed out");
+    debugPrintLn(F("[rdResp]: timed out"));
     return ResponseTimeout;
 }
 
-bool Sodaq_nbIOT::setApn(const char* apn)
+// Handles a single response line for the command that is running.
+// This is shared by the blocking readResponse() and the asynchronous poll().
+// Returns true (and the response in "result") when the command has completed.
+bool Sodaq_nbIOT::processResponseLine(char* buffer, size_t count, CallbackMethodPtr& parserMethod,
+                                      void* callbackParameter, void* callbackParameter2,
+                                      ResponseTypes& response, ResponseTypes* result)
 {
-    print("AT+CGDCONT=");
-    print(_cid);
-    print(",\"IP\",\"");
-    print(apn);
-    println("\"");
+    if (_disableDiag && strncmp_P(buffer, PSTR(STR_RESPONSE_OK), 2) != 0) {
+        _disableDiag = false;
+    }
     
-    return (readResponse() == ResponseOK);
-}
-
-bool Sodaq_nbIOT::getEpoch(uint32_t* epoch)
-{
-    println("AT+CCLK?");
-
-    return readResponse<uint32_t, uint8_t>(_cclkParser, epoch, NULL) == ResponseOK;
-}
+    debugPrint(F("[rdResp]: "));
+    debugPrintLn(buffer);
 
-bool Sodaq_nbIOT::setCdp(const char* cdp)
-{
-    if (_isSaraR4XX) {
-        debugPrintLn("Set CDP not supported for R4XX");
+    // an information response of the running command can look like a URC (e.g. "+CEREG: 4,1" of
+    // AT+CEREG?), the lines with the name of the command go to its parser (if it has one) first
+    if (!(parserMethod && isCommandResponse(buffer, count)) && handleUrc(buffer, count)) {
         return false;
     }
-
-    if (strlen(cdp) == 0) {
-        debugPrintLn("Skipping empty CDP");
+    
+    if (startsWith(F(STR_AT), buffer)) {
+        return false; // skip echoed back command
+    }
+    
+    _disableDiag = false;
+    
+    if (startsWith(F(STR_RESPONSE_OK), buffer)) {
+        *result = ResponseOK;
         return true;
     }
-
-    print("AT+NCDP=\"");
-    print(cdp);
-    println("\"");
     
-    return (readResponse() == ResponseOK);
-}
-
-bool Sodaq_nbIOT::setBand(uint8_t band)
-{
-    if (_isSaraR4XX) {
-        debugPrintLn("Set BAND not supported for R4XX");
-        return false;
+    if (startsWith(F(STR_RESPONSE_ERROR), buffer) ||
+            startsWith(F(STR_RESPONSE_CME_ERROR), buffer) ||
+            startsWith(F(STR_RESPONSE_CMS_ERROR), buffer)) {
+        *result = ResponseError;
+        return true;
     }
-    print("AT+NBAND=");
-    println(band);
     
-    return (readResponse() == ResponseOK);
+    if (parserMethod) {
+        ResponseTypes parserResponse = parserMethod(response, buffer, count, callbackParameter, callbackParameter2);
+        
+        if ((parserResponse != ResponseEmpty) && (parserResponse != ResponsePendingExtra)) {
+            *result = parserResponse;
+            return true;
+        }
+        else {
+            // ?
+            // ResponseEmpty indicates that the parser was satisfied
+            // Continue until "OK", "ERROR", or whatever else.
+        }
+        
+        // Prevent calling the parser again.
+        // This could happen if the input line is too long. It will be split
+        // and the next readLn will return the next part.
+        // The case of "ResponsePendingExtra" is an exception to this, thus waiting for more replies to be parsed.
+        if (parserResponse != ResponsePendingExtra) {
+            parserMethod = 0;
+        }
+    }
+    
+    // at this point, the parserMethod has ran and there is no override response from it,
+    // so if there is some other response recorded, return that
+    // (otherwise continue iterations until timeout)
+    if (response != ResponseNotFound) {
+        debugPrintLn(F("** response != ResponseNotFound"));
+        *result = response;
+        return true;
+    }
+
+    return false;
 }
 
-bool Sodaq_nbIOT::setR4XXToNarrowband()
+// Queues a command to be sent by poll(), without blocking.
+// Returns false if the queue is full.
+bool Sodaq_nbIOT::sendCommandAsync(const char* command, CommandCompletionPtr completion, void* context,
+                                   uint32_t timeout, CallbackMethodPtr parserMethod, void* parameter, void* parameter2)
 {
-    println("AT+URAT=8");
-
-    return (readResponse() == ResponseOK);
+    return queueAsyncCommand(command, false, completion, context, timeout, parserMethod, parameter, parameter2);
 }
 
-void Sodaq_nbIOT::purgeAllResponsesRead()
+// Queues a command in flash to be sent by poll(), without blocking.
+// Returns false if the queue is full.
+bool Sodaq_nbIOT::sendCommandAsync(const __FlashStringHelper* command, CommandCompletionPtr completion, void* context,
+                                   uint32_t timeout, CallbackMethodPtr parserMethod, void* parameter, void* parameter2)
 {
-    uint32_t start = millis();
-    
-    // make sure all the responses within the timeout have been read
-    while ((readResponse(0, 1000) != ResponseTimeout) && !is_timedout(start, 2000)) {}
+    return queueAsyncCommand(reinterpret_cast<const char*>(command), true, completion, context, timeout,
+                             parserMethod, parameter, parameter2);
 }
 
-// Turns on and initializes the modem, then connects to the network and activates the data connection.
-bool Sodaq_nbIOT::connect(const char* apn, const char* cdp, const char* forceOperator, uint8_t band)
+// Adds a command, in flash if "isFlashCommand", to the queue of asynchronous commands.
+// Returns false if the queue is full.
+bool Sodaq_nbIOT::queueAsyncCommand(const char* command, bool isFlashCommand, CommandCompletionPtr completion,
+                                    void* context, uint32_t timeout, CallbackMethodPtr parserMethod,
+                                    void* parameter, void* parameter2)
 {
-    if (!on()) {
-        return false;
-    }
-    
-    purgeAllResponsesRead();
-    
-    if (!setVerboseErrors(true)) {
+    if (!command || (_asyncCount >= SODAQ_NBIOT_ASYNC_QUEUE_SIZE)) {
         return false;
     }
 
-    if (!_isSaraR4XX) {
+    AsyncCommand& asyncCommand = _asyncQueue[(_asyncHead + _asyncCount) % SODAQ_NBIOT_ASYNC_QUEUE_SIZE];
+    asyncCommand.command = command;
+    asyncCommand.isFlashCommand = isFlashCommand;
+    asyncCommand.completion = completion;
+    asyncCommand.context = context;
+    asyncCommand.timeout = timeout;
+    asyncCommand.parserMethod = parserMethod;
+    asyncCommand.parameter = parameter;
+    asyncCommand.parameter2 = parameter2;
 
-        if (!setBand(band)) {
-            return false;
-        }
+    _asyncCount++;
 
-        if (!checkAndApplyNconfig()) {
-            return false;
-        }
+    return true;
+}
 
-        reboot();
-    
-        if (!on()) {
-            return false;
-        }
-        
-        purgeAllResponsesRead();
+// Advances the asynchronous commands without blocking.
+void Sodaq_nbIOT::poll()
+{
+    size_t count;
 
-        if (!setVerboseErrors(true)) {
-            return false;
+    sodaq_wdt_reset();
+
+    while (readLnAsync(_inputBuffer, _inputBufferSize, &count)) {
+        if (count == 0) {
+            continue;
         }
-    }
 
-    if (_isSaraR4XX) {
-        println("ATE0"); // echo off
-        if (readResponse() != ResponseOK) {
-            debugPrintLn("Error: Failed to turn off echo")
+        if ((_asyncCount > 0) && _isAsyncCommandSent) {
+            AsyncCommand& asyncCommand = _asyncQueue[_asyncHead];
+            ResponseTypes result;
+
+            if (processResponseLine(_inputBuffer, count, asyncCommand.parserMethod,
+                                    asyncCommand.parameter, asyncCommand.parameter2, _asyncResponse, &result)) {
+                completeAsyncCommand(result);
+            }
         }
+        else {
+            // nothing is running, so this can only be a URC
+            debugPrint(F("[poll]: "));
+            debugPrintLn(_inputBuffer);
 
-        setR4XXToNarrowband();
-        // set data transfer to hex mode
-        println("AT+UDCONF=1,1");
-        readResponse();
-    
-        if (!doSIMcheck()) {
-            return false;
+            handleUrc(_inputBuffer, count);
         }
     }
 
-#ifdef DEBUG
-    if (_isSaraR4XX) {
-        println("AT+URAT?");
-        readResponse();
+    if ((_asyncCount == 0) && (_connectState == ConnectBusy)) {
+        advanceConnect();
     }
-    else {
-        println("AT+NBAND?");
-        readResponse();
-        println("AT+NCONFIG?");
-        readResponse();
+
+    if (_asyncCount == 0) {
+        return;
+    }
+
+    if (!_isAsyncCommandSent) {
+        AsyncCommand& asyncCommand = _asyncQueue[_asyncHead];
+
+        if (asyncCommand.isFlashCommand) {
+            println(FLASH_STRING(asyncCommand.command));
+        }
+        else {
+            println(asyncCommand.command);
+        }
+
+        _isAsyncCommandSent = true;
+        _asyncCommandStart = NOW;
+        _asyncResponse = ResponseNotFound;
+    }
+    else if (is_timedout(_asyncCommandStart, _asyncQueue[_asyncHead].timeout)) {
+        debugPrintLn(F("[poll]: timed out"));
+        completeAsyncCommand(ResponseTimeout);
+    }
+}
+
+// Removes the running command from the queue and invokes its completion callback.
+// The next command (if any) is sent by poll().
+void Sodaq_nbIOT::completeAsyncCommand(ResponseTypes response)
+{
+    AsyncCommand asyncCommand = _asyncQueue[_asyncHead];
+
+    _asyncHead = (_asyncHead + 1) % SODAQ_NBIOT_ASYNC_QUEUE_SIZE;
+    _asyncCount--;
+    _isAsyncCommandSent = false;
+
+    if (asyncCommand.completion) {
+        asyncCommand.completion(response, asyncCommand.context);
+    }
+}
+
+// The entries of the command tables of sendCommands().
+static Sodaq_nbIOT::ChainedCommand toChainedCommand(const char* command)
+{
+    Sodaq_nbIOT::ChainedCommand chainedCommand = { command, false };
+
+    return chainedCommand;
+}
+
+static Sodaq_nbIOT::ChainedCommand toChainedCommand(const __FlashStringHelper* command)
+{
+    Sodaq_nbIOT::ChainedCommand chainedCommand = { reinterpret_cast<const char*>(command), true };
+
+    return chainedCommand;
+}
+
+static Sodaq_nbIOT::ChainedCommand toChainedCommand(const Sodaq_nbIOT::ChainedCommand& command)
+{
+    return command;
+}
+
+static size_t getCommandLength(const Sodaq_nbIOT::ChainedCommand& command)
+{
+    return command.isFlash ? strlen_P(command.command) : strlen(command.command);
+}
+
+// Sends the (set) commands chained on as few lines as possible, see the header for details.
+// Returns true if all the commands succeeded.
+bool Sodaq_nbIOT::sendCommands(const char* const* commands, uint8_t count, ResponseTypes* results, uint32_t timeout)
+{
+    return sendCommandTable(commands, count, results, timeout);
+}
+
+// Same as above, with the commands in flash.
+bool Sodaq_nbIOT::sendCommands(const __FlashStringHelper* const* commands, uint8_t count, ResponseTypes* results,
+                               uint32_t timeout)
+{
+    return sendCommandTable(commands, count, results, timeout);
+}
+
+// Same as above, with each command in RAM or in flash.
+bool Sodaq_nbIOT::sendCommands(const ChainedCommand* commands, uint8_t count, ResponseTypes* results, uint32_t timeout)
+{
+    return sendCommandTable(commands, count, results, timeout);
+}
+
+// Implements the sendCommands() above, for the tables of commands in RAM, in flash or both.
+template<typename T>
+bool Sodaq_nbIOT::sendCommandTable(const T* commands, uint8_t count, ResponseTypes* results, uint32_t timeout)
+{
+    bool isSuccess = true;
+    uint8_t first = 0;
+
+    while (first < count) {
+        // chain as many commands as fit on one line
+        uint8_t last = first;
+        size_t length = (sizeof(STR_AT) - 1) + getCommandLength(toChainedCommand(commands[first]));
+
+        while (_isChainingSupported && (last + 1 < count) &&
+                (length + 1 + getCommandLength(toChainedCommand(commands[last + 1])) <= SODAQ_NBIOT_MAX_CHAINED_COMMAND_LENGTH)) {
+            last++;
+            length += 1 + getCommandLength(toChainedCommand(commands[last]));
+        }
+
+        CommandWriter command(*this);
+        command.print(F(STR_AT));
+
+        for (uint8_t i = first; i <= last; i++) {
+            ChainedCommand chainedCommand = toChainedCommand(commands[i]);
+
+            if (i > first) {
+                command.print(';');
+            }
+
+            if (chainedCommand.isFlash) {
+                command.print(FLASH_STRING(chainedCommand.command));
+            }
+            else {
+                command.print(chainedCommand.command);
+            }
+        }
+
+        command.println();
+
+        ResponseTypes response = readResponse(NULL, timeout);
+
+        if ((response == ResponseOK) || (first == last)) {
+            for (uint8_t i = first; i <= last; i++) {
+                if (results) {
+                    results[i] = response;
+                }
+            }
+
+            isSuccess &= (response == ResponseOK);
+        }
+        else {
+            // find out which command failed
+            bool isEachSuccessful = true;
+
+            for (uint8_t i = first; i <= last; i++) {
+                ChainedCommand chainedCommand = toChainedCommand(commands[i]);
+
+                print(F(STR_AT));
+
+                if (chainedCommand.isFlash) {
+                    println(FLASH_STRING(chainedCommand.command));
+                }
+                else {
+                    println(chainedCommand.command);
+                }
+
+                response = readResponse(NULL, timeout);
+
+                if (results) {
+                    results[i] = response;
+                }
+
+                isEachSuccessful &= (response == ResponseOK);
+            }
+
+            if (isEachSuccessful) {
+                debugPrintLn(F("Chained commands are not supported, sending them one by one"));
+                _isChainingSupported = false;
+            }
+
+            isSuccess &= isEachSuccessful;
+        }
+
+        first = last + 1;
+    }
+
+    return isSuccess;
+}
+
+bool Sodaq_nbIOT::setApn(const char* apn)
+{
+    print(F("AT+CGDCONT="));
+    print(_cid);
+    print(F(",\"IP\",\""));
+    print(apn);
+    println('"');
+    
+    return (readResponse() == ResponseOK);
+}
+
+bool Sodaq_nbIOT::getEpoch(uint32_t* epoch)
+{
+    println(F("AT+CCLK?"));
+
+    return readResponse<uint32_t, uint8_t>(_cclkParser, epoch, NULL) == ResponseOK;
+}
+
+bool Sodaq_nbIOT::setCdp(const char* cdp)
+{
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Set CDP not supported for R4XX"));
+        return false;
+    }
+
+    if (strlen(cdp) == 0) {
+        debugPrintLn(F("Skipping empty CDP"));
+        return true;
+    }
+
+    print(F("AT+NCDP=\""));
+    print(cdp);
+    println('"');
+    
+    return (readResponse() == ResponseOK);
+}
+
+bool Sodaq_nbIOT::setBand(uint8_t band)
+{
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Set BAND not supported for R4XX"));
+        return false;
+    }
+    print(F("AT+NBAND="));
+    println(band);
+    
+    return (readResponse() == ResponseOK);
+}
+
+bool Sodaq_nbIOT::setR4XXToNarrowband()
+{
+    println(F("AT+URAT=8"));
+
+    return (readResponse() == ResponseOK);
+}
+
+void Sodaq_nbIOT::purgeAllResponsesRead()
+{
+    uint32_t start = millis();
+    
+    // make sure all the responses within the timeout have been read
+    while ((readResponse(0, 1000) != ResponseTimeout) && !is_timedout(start, 2000)) {}
+}
+
+// Appends "str" to the null terminated "buffer" of "size".
+// Returns false if it does not fit.
+static bool appendString(char* buffer, size_t size, const char* str)
+{
+    size_t length = strlen(buffer);
+    size_t strLength = strlen(str);
+
+    if (length + strLength >= size) {
+        return false;
+    }
+
+    memcpy(&buffer[length], str, strLength + 1);
+
+    return true;
+}
+
+// Same as above, with "str" in flash.
+static bool appendString(char* buffer, size_t size, const __FlashStringHelper* str)
+{
+    const char* p = reinterpret_cast<const char*>(str);
+    size_t length = strlen(buffer);
+    size_t strLength = strlen_P(p);
+
+    if (length + strLength >= size) {
+        return false;
+    }
+
+    memcpy_P(&buffer[length], p, strLength + 1);
+
+    return true;
+}
+
+// Turns on and initializes the modem, then connects to the network and activates the data connection.
+bool Sodaq_nbIOT::connect(const char* apn, const char* cdp, const char* forceOperator, uint8_t band)
+{
+    if (!beginConnect(apn, cdp, forceOperator, band)) {
+        return false;
+    }
+
+    while (_connectState == ConnectBusy) {
+        poll();
+
+        // wait (in the idle callback) for the next line or for poll() to have something else to do,
+        // but not too long, poll() resets the watchdog
+        waitForRxData(min(getPollDelay(), static_cast<uint32_t>(250)));
+    }
+
+    return (_connectState == ConnectSucceeded);
+}
+
+// Turns on and configures the modem, the network phase of the connect is advanced by poll().
+// Returns false if the modem could not be turned on or configured.
+bool Sodaq_nbIOT::beginConnect(const char* apn, const char* cdp, const char* forceOperator, uint8_t band)
+{
+    // stays failed on the early returns
+    _connectState = ConnectFailed;
+    _skippedConnectPhases = 0;
+    memset(_sockets, 0, sizeof(_sockets));
+    _networkRegistrationStatus = NetworkNotRegistered;
+    _isSignallingConnected = false;
+    _isInPsm = false;
+    _grantedActiveTime = PSM_TIMER_UNKNOWN;
+    _grantedPeriodicTau = PSM_TIMER_UNKNOWN;
+
+    if (!on()) {
+        return false;
+    }
+    
+    purgeAllResponsesRead();
+
+    // not fatal, the modem is still running at the current baud rate
+    upgradeBaudrate();
+    
+    if (!setVerboseErrors(true)) {
+        return false;
+    }
+
+    if (!isSaraR4XX()) {
+        bool isBandChanged = true;
+        bool isNconfigChanged;
+
+        if (_isWarmConnect && isBandSet(band)) {
+            isBandChanged = false;
+            _skippedConnectPhases |= ConnectPhaseBand;
+        }
+        else if (!setBand(band)) {
+            return false;
+        }
+
+        if (!checkAndApplyNconfig(&isNconfigChanged)) {
+            return false;
+        }
+
+        if (!isNconfigChanged) {
+            _skippedConnectPhases |= ConnectPhaseNconfig;
+        }
+
+        // the band and NCONFIG only take effect after a reboot
+        if (_isWarmConnect && !isBandChanged && !isNconfigChanged) {
+            debugPrintLn(F("Skipping the reboot, nothing changed"));
+            _skippedConnectPhases |= ConnectPhaseReboot;
+        }
+        else {
+            reboot();
+
+            if (!on()) {
+                return false;
+            }
+
+            purgeAllResponsesRead();
+
+            // the reboot reverted the baud rate
+            upgradeBaudrate();
+
+            // verbose errors are set again by applyConnectConfig()
+        }
+    }
+
+    if (isSaraR4XX()) {
+        println(F("ATE0")); // echo off
+        if (readResponse() != ResponseOK) {
+            debugPrintLn(F("Error: Failed to turn off echo"))
+        }
+
+        setR4XXToNarrowband();
+        // set data transfer to hex or binary mode
+        println(_isBinaryDataMode ? F("AT+UDCONF=1,0") : F("AT+UDCONF=1,1"));
+        readResponse();
+    
+        if (!doSIMcheck()) {
+            return false;
+        }
+    }
+
+#ifdef DEBUG
+    if (isSaraR4XX()) {
+        println(F("AT+URAT?"));
+        readResponse();
+    }
+    else {
+        println(F("AT+NBAND?"));
+        readResponse();
+        println(F("AT+NCONFIG?"));
+        readResponse();
     }
 #endif
 
-    if (!setRadioActive(false)) {
-        return false;
+    if (_isWarmConnect) {
+        if (isApnSet(apn)) {
+            apn = NULL;
+            _skippedConnectPhases |= ConnectPhaseApn;
+        }
+
+        if (!isSaraR4XX() && (strlen(cdp) > 0) && isCdpSet(cdp)) {
+            cdp = NULL;
+            _skippedConnectPhases |= ConnectPhaseCdp;
+        }
+    }
+
+    if (!applyConnectConfig(apn, cdp)) {
+        return false;
+    }
+    
+    if (!setRadioActive(true)) {
+        return false;
+    }
+    
+    _copsCommand[0] = '\0';
+
+    if (forceOperator && forceOperator[0] != '\0') {
+        strcpy_P(_copsCommand, PSTR("AT+COPS=1,2,\""));
+
+        if (!appendString(_copsCommand, sizeof(_copsCommand), forceOperator) ||
+                !appendString(_copsCommand, sizeof(_copsCommand), F("\""))) {
+            debugPrintLn(F("Error: The operator is too long"));
+            return false;
+        }
+    }
+
+    startConnectStep((_copsCommand[0] != '\0') ? ConnectStepOperator : ConnectStepSignalQuality);
+    _connectState = ConnectBusy;
+
+    return true;
+}
+
+// Starts "step" of the network phase of a connect, its command is sent by the next poll().
+void Sodaq_nbIOT::startConnectStep(uint8_t step)
+{
+    _connectStep = step;
+    _connectStepStart = NOW;
+    _connectCheckStart = NOW;
+    _connectCheckDelay = 0;
+}
+
+// Checks the current step again after a while, which grows up to CONNECT_CHECK_MAX_DELAY.
+// A network URC ends the wait early.
+void Sodaq_nbIOT::scheduleConnectCheck()
+{
+    _connectCheckStart = NOW;
+
+    if (_connectCheckDelay == 0) {
+        _connectCheckDelay = CONNECT_CHECK_FIRST_DELAY;
+    }
+    else {
+        _connectCheckDelay = min(_connectCheckDelay + CONNECT_CHECK_DELAY_STEP,
+                                 static_cast<uint32_t>(CONNECT_CHECK_MAX_DELAY));
+    }
+}
+
+// Sends the command of the current connect step when its check is due.
+// Called by poll() when no asynchronous command is running; the completion moves on to the next step.
+void Sodaq_nbIOT::advanceConnect()
+{
+    if (!_isNetworkEvent && ((NOW - _connectCheckStart) < _connectCheckDelay)) {
+        return;
+    }
+
+    // a network URC that arrives from now on, even during the command, ends the next wait early
+    _isNetworkEvent = false;
+
+    switch (_connectStep) {
+    case ConnectStepOperator:
+        sendCommandAsync(_copsCommand, (CommandCompletionPtr)_connectCompletion, this, COPS_TIMEOUT);
+        break;
+
+    case ConnectStepSignalQuality:
+        if (is_timedout(_connectStepStart, SIGNAL_QUALITY_TIMEOUT)) {
+            debugPrintLn(F("Error: No signal"));
+            _connectState = ConnectFailed;
+            break;
+        }
+
+        sendCommandAsync<int, int>(F("AT+CSQ"), _csqParser, &_connectCsq, &_connectBer,
+                                   (CommandCompletionPtr)_connectCompletion, this);
+        break;
+
+    case ConnectStepAttach:
+        // the (EPS) attach is part of the registration, which is reported by +CEREG
+        if (isRegistered()) {
+            startConnectStep(ConnectStepAddress);
+            break;
+        }
+
+        if (is_timedout(_connectStepStart, ATTACH_TIMEOUT)) {
+            debugPrintLn(F("Error: Not attached"));
+            _connectState = ConnectFailed;
+            break;
+        }
+
+        sendCommandAsync<uint8_t, uint8_t>(F("AT+CGATT?"), _cgattParser, &_connectAttachState, NULL,
+                                           (CommandCompletionPtr)_connectCompletion, this, CGATT_TIMEOUT);
+        break;
+
+    case ConnectStepAddress:
+        sendCommandAsync(F("AT+CGPADDR"), (CommandCompletionPtr)_connectCompletion, this);
+        break;
+    }
+}
+
+// Returns the time (ms) until poll() has something to do besides handling lines: sending the
+// queued command, timing out the running one or checking the current connect step.
+uint32_t Sodaq_nbIOT::getPollDelay() const
+{
+    uint32_t elapsed;
+    uint32_t timeout;
+
+    if (_asyncCount > 0) {
+        if (!_isAsyncCommandSent) {
+            return 0;
+        }
+
+        elapsed = NOW - _asyncCommandStart;
+        timeout = _asyncQueue[_asyncHead].timeout;
+    }
+    else if ((_connectState == ConnectBusy) && !_isNetworkEvent) {
+        elapsed = NOW - _connectCheckStart;
+        timeout = _connectCheckDelay;
+    }
+    else {
+        return 0;
+    }
+
+    return (elapsed < timeout) ? (timeout - elapsed) : 0;
+}
+
+// Moves the connect on to the next step, or checks the current one again later.
+void Sodaq_nbIOT::onConnectCommandCompleted(ResponseTypes response)
+{
+    switch (_connectStep) {
+    case ConnectStepOperator:
+        if (response == ResponseOK) {
+            startConnectStep(ConnectStepSignalQuality);
+        }
+        else {
+            _connectState = ConnectFailed;
+        }
+        break;
+
+    case ConnectStepSignalQuality:
+        // 99 is not known or not detectable
+        if ((response == ResponseOK) && (_connectCsq != 99) && (convertCSQ2RSSI(_connectCsq) >= getMinRSSI())) {
+            _lastRSSI = convertCSQ2RSSI(_connectCsq);
+            _CSQtime = (int32_t)(NOW - _connectStepStart) / 1000;
+            startConnectStep(ConnectStepAttach);
+        }
+        else {
+            scheduleConnectCheck();
+        }
+        break;
+
+    case ConnectStepAttach:
+        if ((response == ResponseOK) && (_connectAttachState == 1)) {
+            startConnectStep(ConnectStepAddress);
+        }
+        else {
+            scheduleConnectCheck();
+        }
+        break;
+
+    case ConnectStepAddress:
+        // If we got this far we succeeded
+        _connectState = ConnectSucceeded;
+        break;
+    }
+}
+
+void Sodaq_nbIOT::_connectCompletion(ResponseTypes response, Sodaq_nbIOT* self)
+{
+    self->onConnectCommandCompleted(response);
+}
+
+// Applies the configuration needed before the radio is turned on, as chained commands:
+// verbose errors, radio off, indications off (TODO turn on), APN and (N2 only) CDP.
+// A NULL "apn" or "cdp" is left as it is. The radio is only turned off if one of them is set.
+// The registration URCs (and the PSM URCs if PSM was requested) are enabled as well,
+// but failing to do so is not fatal.
+bool Sodaq_nbIOT::applyConnectConfig(const char* apn, const char* cdp)
+{
+    ChainedCommand commands[7];
+    uint8_t count = 0;
+    bool isCdpApplied = !isSaraR4XX() && cdp && (strlen(cdp) > 0);
+
+    commands[count++] = toChainedCommand(isSaraR4XX() ? F("+CMEE=2") : F("+CMEE=1"));
+
+    if (apn || isCdpApplied) {
+        commands[count++] = toChainedCommand(F("+CFUN=0"));
+    }
+
+    if (isSaraR4XX()) {
+        commands[count++] = toChainedCommand(F("+CNMI=0"));
+    }
+    else {
+        commands[count++] = toChainedCommand(F("+NSMI=0"));
+        commands[count++] = toChainedCommand(F("+NNMI=0"));
+    }
+
+    char cid[4] = { 0 };
+    uint8_t cidLength = 0;
+
+    if (_cid >= 100) {
+        cid[cidLength++] = '0' + _cid / 100;
+    }
+
+    if (_cid >= 10) {
+        cid[cidLength++] = '0' + (_cid / 10) % 10;
+    }
+
+    cid[cidLength++] = '0' + _cid % 10;
+
+    char apnCommand[SODAQ_NBIOT_MAX_CHAINED_COMMAND_LENGTH];
+    strcpy_P(apnCommand, PSTR("+CGDCONT="));
+
+    bool isApnChained = !apn || (appendString(apnCommand, sizeof(apnCommand), cid) &&
+                                 appendString(apnCommand, sizeof(apnCommand), F(",\"IP\",\"")) &&
+                                 appendString(apnCommand, sizeof(apnCommand), apn) &&
+                                 appendString(apnCommand, sizeof(apnCommand), F("\"")));
+
+    if (apn && isApnChained) {
+        commands[count++] = toChainedCommand(apnCommand);
     }
-    
-     // TODO turn on 
-     if (!setIndicationsActive(false)) {
-        return false;
+
+    char cdpCommand[sizeof("+NCDP=\"255.255.255.255\"")];
+    strcpy_P(cdpCommand, PSTR("+NCDP=\""));
+
+    bool isCdpChained = !isCdpApplied;
+
+    if (isCdpApplied) {
+        isCdpChained = appendString(cdpCommand, sizeof(cdpCommand), cdp) &&
+                       appendString(cdpCommand, sizeof(cdpCommand), F("\""));
+
+        if (isCdpChained) {
+            commands[count++] = toChainedCommand(cdpCommand);
+        }
     }
 
-    if (!setApn(apn)) {
+    if (!sendCommands(commands, count)) {
         return false;
     }
 
-    if (!_isSaraR4XX && !setCdp(cdp)) {
+    // best effort, on their own line so a firmware that rejects one of them does not
+    // make the required commands above fail or fall back to one by one
+    // +CEREG=4 also reports the granted PSM timers, see setPsm()
+    const __FlashStringHelper* urcCommands[] = {
+        _isPsmRequested ? F("+CEREG=4") : F("+CEREG=1"),
+        F("+CSCON=1"),
+        F("+CGEREP=1"),
+        isSaraR4XX() ? F("+UPSMR=1") : F("+NPSMR=1")
+    };
+
+    if (!sendCommands(urcCommands, _isPsmRequested ? ARRAY_SIZE(urcCommands) : ARRAY_SIZE(urcCommands) - 1)) {
+        debugPrintLn(F("Some of the registration URCs could not be enabled"));
+    }
+
+    // fall back to single commands for values that are too long to be chained
+    if (!isApnChained && !setApn(apn)) {
         return false;
     }
-    
-    if (!setRadioActive(true)) {
+
+    if (!isCdpChained && !setCdp(cdp)) {
         return false;
     }
-    
-    if (forceOperator && forceOperator[0] != '\0') {
-        print("AT+COPS=1,2,\"");
-        print(forceOperator);
-        println("\"");
-        
-        if (readResponse(NULL, COPS_TIMEOUT) != ResponseOK) {
-            return false;
+
+    return true;
+}
+
+// Returns true if "band" is the only band that is set.
+bool Sodaq_nbIOT::isBandSet(uint8_t band)
+{
+    bool isMatch = false;
+
+    println(F("AT+NBAND?"));
+
+    return (readResponse<uint8_t, bool>(_nbandParser, &band, &isMatch) == ResponseOK) && isMatch;
+}
+
+ResponseTypes Sodaq_nbIOT::_nbandParser(ResponseTypes& response, const char* buffer, size_t size,
+    uint8_t* band, bool* isMatch)
+{
+    if (!band || !isMatch) {
+        return ResponseError;
+    }
+
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t value;
+    uint8_t count = 0;
+
+    // +NBAND:<n>[,<n>...]
+    if (!tokenizer.skip(F("+NBAND:"))) {
+        return ResponseError;
+    }
+
+    do {
+        if (!tokenizer.readInt(&value)) {
+            return ResponseError;
         }
+
+        count++;
     }
-    
-    if (!waitForSignalQuality()) {
-        return false;
+    while (tokenizer.skip(','));
+
+    *isMatch = (count == 1) && (value == *band);
+
+    return ResponseEmpty;
+}
+
+// Returns true if the PDP context of the cid (see init()) has "apn".
+bool Sodaq_nbIOT::isApnSet(const char* apn)
+{
+    ApnMatch match = { _cid, apn, false };
+
+    println(F("AT+CGDCONT?"));
+
+    return (readResponse<ApnMatch, uint8_t>(_cgdcontParser, &match, NULL) == ResponseOK) && match.isMatch;
+}
+
+ResponseTypes Sodaq_nbIOT::_cgdcontParser(ResponseTypes& response, const char* buffer, size_t size,
+    ApnMatch* match, uint8_t* dummy)
+{
+    if (!match) {
+        return ResponseError;
     }
-    
-    if (!attachGprs()) {
-        return false;
+
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t cid;
+    const char* field;
+    size_t fieldLength;
+
+    // +CGDCONT:<cid>,"<PDP_type>","<APN>",...
+    if (tokenizer.skip(F("+CGDCONT:")) && tokenizer.readInt(&cid) && tokenizer.skip(',') &&
+            tokenizer.readString(&field, &fieldLength) && tokenizer.skip(',') &&
+            tokenizer.readString(&field, &fieldLength)) {
+        if ((cid == match->cid) && (strlen(match->apn) == fieldLength) && (strncmp(match->apn, field, fieldLength) == 0)) {
+            match->isMatch = true;
+        }
+
+        // one line per context
+        return ResponsePendingExtra;
     }
-    
-    println("AT+CGPADDR");
-    readResponse();
-    
-    // If we got this far we succeeded
-    return true;
+
+    return ResponseError;
+}
+
+// Returns true if the CDP address is "cdp".
+bool Sodaq_nbIOT::isCdpSet(const char* cdp)
+{
+    bool isMatch = false;
+
+    println(F("AT+NCDP?"));
+
+    return (readResponse<const char, bool>(_ncdpParser, cdp, &isMatch) == ResponseOK) && isMatch;
+}
+
+ResponseTypes Sodaq_nbIOT::_ncdpParser(ResponseTypes& response, const char* buffer, size_t size,
+    const char* cdp, bool* isMatch)
+{
+    if (!cdp || !isMatch) {
+        return ResponseError;
+    }
+
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    const char* address;
+    size_t addressLength;
+
+    // +NCDP:<ip_addr>,<port>
+    if (tokenizer.skip(F("+NCDP:")) && tokenizer.readString(&address, &addressLength)) {
+        *isMatch = (strlen(cdp) == addressLength) && (strncmp(cdp, address, addressLength) == 0);
+
+        return ResponseEmpty;
+    }
+
+    return ResponseError;
 }
 
 void Sodaq_nbIOT::reboot()
 {
-    if (_isSaraR4XX) {
-        println("AT+CFUN=15"); // reset modem + sim
+    // the sockets and their pending data are gone after the reboot
+    memset(_sockets, 0, sizeof(_sockets));
+
+    if (isSaraR4XX()) {
+        restoreDefaultBaudrate();
+        println(F("AT+CFUN=15")); // reset modem + sim
     }
     else {
-        println("AT+NRB");
+        println(F("AT+NRB"));
+        restoreDefaultBaudrate(); // the N2 comes up at the default baud rate
     }
     
     // wait up to 2000ms for the modem to come up
@@ -623,26 +1696,156 @@ void Sodaq_nbIOT::reboot()
     while ((readResponse() != ResponseOK) && !is_timedout(start, 2000)) { }
 }
 
-bool Sodaq_nbIOT::checkAndApplyNconfig()
+// Waits for the "prompt" character the modem sends when it is ready for the data of a command.
+// Returns false if it does not arrive within "timeout" ms.
+bool Sodaq_nbIOT::waitForPrompt(char prompt, uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while (!is_timedout(start, timeout)) {
+        int c = timedRead(timeout);
+
+        if (c == prompt) {
+            return true;
+        }
+
+        if (c < 0) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+// Switches the modem and the stream to the upgrade baud rate, see setUpgradeBaudrate().
+// Falls back to the current baud rate if the modem does not reply at the new one.
+// Returns true if the modem runs at the upgrade baud rate (or no change was needed).
+bool Sodaq_nbIOT::upgradeBaudrate()
+{
+    uint32_t baudrate = _upgradeBaudrate;
+
+    if (!_baudRateChangeCallbackPtr || (baudrate == 0) || (baudrate == _currentBaudrate)) {
+        return true;
+    }
+
+    uint32_t previousBaudrate = _currentBaudrate;
+
+    if (isSaraR4XX()) {
+        print(F("AT+IPR="));
+        println(baudrate);
+    }
+    else {
+        // not stored, the modem falls back to the previous baud rate if no command arrives in time
+        print(F("AT+NATSPEED="));
+        print(baudrate);
+        print(',');
+        print(SARA_N2_NATSPEED_TIMEOUT);
+        println(F(",0,2"));
+    }
+
+    if (readResponse() != ResponseOK) {
+        debugPrintLn(F("Error: The modem did not accept the baud rate"));
+        return false;
+    }
+
+    changeStreamBaudrate(baudrate);
+
+    for (uint8_t i = 0; i < 3; i++) {
+        if (isAlive()) {
+            debugPrint(F("Baud rate changed to "));
+            debugPrintLn(baudrate);
+
+            return true;
+        }
+    }
+
+    debugPrintLn(F("Error: No reply at the new baud rate, falling back"));
+
+    changeStreamBaudrate(previousBaudrate);
+
+    if (isSaraR4XX()) {
+        // the R4 does not fall back by itself
+        return false;
+    }
+
+    // wait for the N2 to fall back after the timeout
+    uint32_t start = millis();
+
+    while (!isAlive() && !is_timedout(start, (SARA_N2_NATSPEED_TIMEOUT + 2) * 1000UL)) { }
+
+    return false;
+}
+
+// Switches the stream back to the default baud rate if it was changed by upgradeBaudrate().
+// The N2 falls back by itself when it is rebooted or turned off (the baud rate is not stored),
+// the R4 is switched back first.
+void Sodaq_nbIOT::restoreDefaultBaudrate()
+{
+    uint32_t defaultBaudrate = isSaraR4XX() ? getSaraR4Baudrate() : getSaraN2Baudrate();
+
+    if ((_currentBaudrate == 0) || (_currentBaudrate == defaultBaudrate)) {
+        return;
+    }
+
+    if (isSaraR4XX() && isOn()) {
+        print(F("AT+IPR="));
+        println(defaultBaudrate);
+        readResponse();
+    }
+
+    changeStreamBaudrate(defaultBaudrate);
+}
+
+// Lets the application re-initialize the stream at "baudrate" (see enableBaudrateChange()).
+void Sodaq_nbIOT::changeStreamBaudrate(uint32_t baudrate)
+{
+    // let the last command leave the UART at the old baud rate
+    _modemStream->flush();
+
+    if (_baudRateChangeCallbackPtr) {
+        _baudRateChangeCallbackPtr(baudrate);
+    }
+
+    _currentBaudrate = baudrate;
+
+    // whatever was received during the change is garbage
+    delay(10);
+    while (_modemStream->available()) {
+        _modemStream->read();
+    }
+    clearRxBuffer();
+}
+
+// Sets the NCONFIG parameters that differ from nConfig.
+// "isChanged" (optional) is set to true if any parameter was set.
+bool Sodaq_nbIOT::checkAndApplyNconfig(bool* isChanged)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("NCONFIG not supported by R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("NCONFIG not supported by R4XX"));
         return false;
     }
-    bool applyParam[nConfigCount];
+    bool applyParam[nConfigCount] = { false };
+
+    if (isChanged) {
+        *isChanged = false;
+    }
     
-    println("AT+NCONFIG?");
+    println(F("AT+NCONFIG?"));
     
     if (readResponse<bool, uint8_t>(_nconfigParser, applyParam, NULL) == ResponseOK) {
         for (uint8_t i = 0; i < nConfigCount; i++) {
-            debugPrint(nConfig[i].Name);
+            debugPrint(FLASH_STRING(nConfig[i].Name));
             
             if (!applyParam[i]) {
-                debugPrintLn("... CHANGE");
-                setNconfigParam(nConfig[i].Name, nConfig[i].Value ? "TRUE" : "FALSE");
+                debugPrintLn(F("... CHANGE"));
+                setNconfigParam(FLASH_STRING(nConfig[i].Name), nConfig[i].Value ? F("TRUE") : F("FALSE"));
+
+                if (isChanged) {
+                    *isChanged = true;
+                }
             }
             else {
-                debugPrintLn("... OK");
+                debugPrintLn(F("... OK"));
             }
         }
         
@@ -652,24 +1855,24 @@ bool Sodaq_nbIOT::checkAndApplyNconfig()
     return false;
 }
 
-bool Sodaq_nbIOT::setNconfigParam(const char* param, const char* value)
+bool Sodaq_nbIOT::setNconfigParam(const __FlashStringHelper* param, const __FlashStringHelper* value)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("set NCONFIG param not supported by R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("set NCONFIG param not supported by R4XX"));
         return false;
     }
-    print("AT+NCONFIG=\"");
+    print(F("AT+NCONFIG=\""));
     print(param);
-    print("\",\"");
+    print(F("\",\""));
     print(value);
-    println("\"");
+    println('"');
     
     return readResponse() == ResponseOK;
 }
 
 bool Sodaq_nbIOT::overrideNconfigParam(const char* param, bool value) {
     for (uint8_t i = 0; i < nConfigCount; i++) {
-        if (strcmp(nConfig[i].Name, param) == 0) {
+        if (strcmp_P(param, nConfig[i].Name) == 0) {
             nConfig[i].Value = value;
             return true;
         }
@@ -683,13 +1886,19 @@ ResponseTypes Sodaq_nbIOT::_nconfigParser(ResponseTypes& response, const char* b
         return ResponseError;
     }
     
-    char name[32];
-    char value[32];
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    const char* name;
+    size_t nameLength;
+    const char* value;
+    size_t valueLength;
     
-    if (sscanf(buffer, "+NCONFIG: \"%[^\"]\",\"%[^\"]\"", name, value) == 2) {
+    if (tokenizer.skip(F("+NCONFIG:")) && tokenizer.readString(&name, &nameLength) &&
+            tokenizer.skip(',') && tokenizer.readString(&value, &valueLength)) {
         for (uint8_t i = 0; i < nConfigCount; i++) {
-            if (strcmp(nConfig[i].Name, name) == 0) {
-                if (strcmp(nConfig[i].Value ? "TRUE" : "FALSE", value) == 0) {
+            if ((strlen_P(nConfig[i].Name) == nameLength) && (strncmp_P(name, nConfig[i].Name, nameLength) == 0)) {
+                const char* expected = nConfig[i].Value ? PSTR("TRUE") : PSTR("FALSE");
+
+                if ((strlen_P(expected) == valueLength) && (strncmp_P(value, expected, valueLength) == 0)) {
                     nconfigEqualsArray[i] = true;
                     
                     break;
@@ -703,50 +1912,27 @@ ResponseTypes Sodaq_nbIOT::_nconfigParser(ResponseTypes& response, const char* b
     return ResponseError;
 }
 
-bool Sodaq_nbIOT::attachGprs(uint32_t timeout)
-{
-    uint32_t start = millis();
-    uint32_t delay_count = 500;
-    
-    while (!is_timedout(start, timeout)) {
-        if (isConnected()) {
-            return true;
-        }
-        
-        // println("AT+CGATT=1");
-        // readResponse(); // get Error 51 Command implemented but currently disabled on N2
-        
-        //if (readResponse() == ResponseOK) {
-        //    return true;
-        //}
-        
-        sodaq_wdt_safe_delay(delay_count);
-        
-        // Next time wait a little longer, but not longer than 5 seconds
-        if (delay_count < 5000) {
-            delay_count += 1000;
-        }
-    }
-    
-    return false;
-}
-
 int Sodaq_nbIOT::createSocket(uint16_t localPort)
 {
-    if (_isSaraR4XX) {
-        print("AT+USOCR=17,");
+    if (isSaraR4XX()) {
+        print(F("AT+USOCR=17,"));
         println(localPort);
     }
     else {
         // only Datagram/UDP is supported
-        print("AT+NSOCR=\"DGRAM\",17,");
+        print(F("AT+NSOCR=\"DGRAM\",17,"));
         print(localPort);
-        println(",1");
+        println(F(",1"));
     }
     
     uint8_t socket;
     
-    if (readResponse<uint8_t, uint8_t>(_createSocketParser, &socket, NULL) == ResponseOK) {
+    if ((readResponse<uint8_t, uint8_t>(_createSocketParser, &socket, NULL) == ResponseOK) &&
+            (socket < SODAQ_NBIOT_SOCKET_COUNT)) {
+        memset(&_sockets[socket], 0, sizeof(_sockets[socket]));
+        _sockets[socket].localPort = localPort;
+        _sockets[socket].isOpen = true;
+
         return socket;
     }
     
@@ -756,63 +1942,99 @@ int Sodaq_nbIOT::createSocket(uint16_t localPort)
 bool Sodaq_nbIOT::closeSocket(uint8_t socketID)
 {
     // only Datagram/UDP is supported
-    if (_isSaraR4XX) {
-        print("AT+USOCL=");
+    if (isSaraR4XX()) {
+        print(F("AT+USOCL="));
     }
     else {
-        print("AT+NSOCL=");
+        print(F("AT+NSOCL="));
     }
     println(socketID);
     
-    return readResponse() == ResponseOK;
+    if (readResponse() != ResponseOK) {
+        return false;
+    }
+
+    if (socketID < SODAQ_NBIOT_SOCKET_COUNT) {
+        memset(&_sockets[socketID], 0, sizeof(_sockets[socketID]));
+    }
+
+    return true;
 }
 
 bool Sodaq_nbIOT::ping(const char* ip)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("Ping not supported by R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Ping not supported by R4XX"));
         return false;
     }
-    print("AT+NPING=");
-    print("\"");
+    print(F("AT+NPING="));
+    print('"');
     print(ip);
-    println("\"");
+    println('"');
     
     return readResponse() == ResponseOK;
 }
 
-size_t Sodaq_nbIOT::socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const uint8_t* buffer, size_t size)
+size_t Sodaq_nbIOT::socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const uint8_t* buffer, size_t size,
+                               ReleaseAssistance releaseAssistance)
 {
     if (size > SODAQ_NBIOT_MAX_UDP_BUFFER) {
-        debugPrintLn("SocketSend exceeded maximum buffer size!");
+        debugPrintLn(F("SocketSend exceeded maximum buffer size!"));
         return 0;
     }
     
     // only Datagram/UDP is supported
-    if (_isSaraR4XX) {
-        print("AT+USOST=");
+    // the complete command is rendered in chunks, instead of 2 print() calls per byte
+    CommandWriter command(*this);
+
+    if (isSaraR4XX() && (releaseAssistance != ReleaseAssistanceNone)) {
+        debugPrintLn(F("Release assistance not supported by R4XX"));
+        releaseAssistance = ReleaseAssistanceNone;
+    }
+
+    if (isSaraR4XX()) {
+        command.print(F("AT+USOST="));
     }
     else {
-        print("AT+NSOST=");
+        command.print((releaseAssistance != ReleaseAssistanceNone) ? F("AT+NSOSTF=") : F("AT+NSOST="));
     }
-    print(socket);
-    print(',');
-    print('\"');
-    print(remoteIP);
-    print('\"');
-    print(',');
-    print(remotePort);
-    print(',');
-    print(size);
-    print(',');
-    print('\"');
 
-    for (size_t i = 0; i < size; ++i) {
-        print(static_cast<char>(NIBBLE_TO_HEX_CHAR(HIGH_NIBBLE(buffer[i]))));
-        print(static_cast<char>(NIBBLE_TO_HEX_CHAR(LOW_NIBBLE(buffer[i]))));
+    command.print(static_cast<uint32_t>(socket));
+    command.print(F(",\""));
+    command.print(remoteIP);
+    command.print(F("\","));
+    command.print(static_cast<uint32_t>(remotePort));
+    command.print(',');
+
+    // the flag of AT+NSOSTF, 0x200: release after this uplink, 0x400: release after the first downlink
+    if (releaseAssistance != ReleaseAssistanceNone) {
+        command.print((releaseAssistance == ReleaseAfterUplink) ? F("0x200,") : F("0x400,"));
     }
 
-    println('\"');
+    command.print(static_cast<uint32_t>(size));
+
+    if (_isBinaryDataMode) {
+        // the modem asks for the data with the '@' prompt
+        command.println();
+
+        if (!waitForPrompt('@', SARA_R4_DATA_PROMPT_TIMEOUT)) {
+            debugPrintLn(F("Error: No data prompt"));
+
+            // the prompt may only be late, resync once the modem is done with the command
+            readResponse(NULL, SARA_R4_DATA_TIMEOUT);
+            isAlive();
+            return 0;
+        }
+
+        delay(SARA_R4_DATA_PROMPT_DELAY);
+        write(buffer, size);
+    }
+    else {
+        command.print(F(",\""));
+        command.printHex(buffer, size);
+        command.print('\"');
+        command.println();
+    }
     
     uint8_t retSocketID;
     size_t sentLength;
@@ -823,118 +2045,353 @@ size_t Sodaq_nbIOT::socketSend(uint8_t socket, const char* remoteIP, const uint1
     else {
         return 0;
     }
-}
+}
+
+size_t Sodaq_nbIOT::socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const char* str,
+                               ReleaseAssistance releaseAssistance)
+{
+    return socketSend(socket, remoteIP, remotePort, (uint8_t *)str, strlen(str), releaseAssistance);
+}
+
+// Waits for a datagram on any socket. With a receive queue, the pending datagrams are
+// prefetched into it and this returns true when the queue is not empty.
+bool Sodaq_nbIOT::waitForUDPResponse(uint32_t timeoutMS)
+{
+    if (hasUDPResponse()) { 
+        return true; 
+    }
+    
+    uint32_t startTime = millis();
+    
+    while (!hasUDPResponse() && (millis() - startTime) < timeoutMS) {
+        if (isSaraR4XX()) {
+            for (uint8_t i = 0; i < SODAQ_NBIOT_SOCKET_COUNT; i++) {
+                if (!_sockets[i].isOpen) {
+                    continue;
+                }
+
+                print(F("AT+USORF="));
+                print(i);
+                print(',');
+                println(0); 
+
+                uint8_t socketID;
+                size_t length;
+
+                if ((readResponse<uint8_t, size_t>(_udpReadURCParser, &socketID, &length) == ResponseOK) &&
+                        (socketID < SODAQ_NBIOT_SOCKET_COUNT)) {
+                    _sockets[socketID].pendingBytes = length;
+                    _sockets[socketID].datagramCount = (length > 0) ? 1 : 0;
+                }
+            }
+        }
+        else {
+            isAlive();
+        }
+        sodaq_wdt_safe_delay(10);
+    }
+    
+    return hasUDPResponse();
+}
+
+// Reads the pending datagrams and passes them to the datagram handler.
+// Returns the number of datagrams (or parts) passed.
+uint8_t Sodaq_nbIOT::dispatchDatagrams()
+{
+    uint8_t count = 0;
+    int socketID;
+
+    // the reads would mix with the responses of the running command
+    if (!_datagramHandler || (_inputBufferSize <= DATAGRAM_LINE_SIZE) || isBusy()) {
+        return 0;
+    }
+
+    // the line goes at the start of the input buffer and the data is decoded after it
+    uint8_t* data = reinterpret_cast<uint8_t*>(&_inputBuffer[DATAGRAM_LINE_SIZE]);
+
+    while ((socketID = getPendingSocket()) != SOCKET_FAIL) {
+        if (dropOversizedDatagram(socketID, data, _inputBufferSize - DATAGRAM_LINE_SIZE, DATAGRAM_LINE_SIZE)) {
+            _droppedDatagramCount++;
+            continue;
+        }
+
+        SaraN2UDPPacketMetadata packet;
+        size_t length = socketReceive(socketID, &packet, data, _inputBufferSize - DATAGRAM_LINE_SIZE, true,
+                                      DATAGRAM_LINE_SIZE);
+
+        if (length == 0) {
+            break;
+        }
+
+        _datagramHandler(socketID, packet, data, length, _datagramHandlerParameter);
+        count++;
+    }
+
+    return count;
+}
+
+// Returns true if there is a datagram to read: in the receive queue (after prefetching), or in the modem.
+bool Sodaq_nbIOT::hasUDPResponse()
+{
+    if (!_receiveQueue) {
+        return hasPendingUDPBytes();
+    }
+
+    if (hasPendingUDPBytes()) {
+        prefetchDatagrams();
+    }
+
+    return !_receiveQueue->isEmpty();
+}
+
+// Reads the pending datagrams into the receive queue, until the queue is full.
+// Returns the number of datagrams added.
+uint8_t Sodaq_nbIOT::prefetchDatagrams()
+{
+    uint8_t count = 0;
+    int socketID;
+
+    if (!_receiveQueue) {
+        return 0;
+    }
+
+    while ((socketID = getPendingSocket()) != SOCKET_FAIL) {
+        uint8_t* data = _receiveQueue->reserve();
+
+        if (!data) {
+            debugPrintLn(F("Receive queue full"));
+            _receiveQueue->onOverflow();
+            break;
+        }
+
+        if (dropOversizedDatagram(socketID, data, _receiveQueue->getMaxDatagramSize())) {
+            _receiveQueue->onDropped();
+            continue;
+        }
+
+        SaraN2UDPPacketMetadata packet;
+
+        if (socketReceive(socketID, &packet, data, _receiveQueue->getMaxDatagramSize(), true) == 0) {
+            break;
+        }
+
+        if (packet.remainingLength > 0) {
+            // too large for a slot, read (and drop) the rest of it
+            debugPrintLn(F("Dropping a datagram that does not fit the receive queue"));
+
+            while ((packet.remainingLength > 0) &&
+                    (socketReceive(socketID, &packet, data, _receiveQueue->getMaxDatagramSize(), true) > 0)) { }
+
+            _receiveQueue->onDropped();
+            continue;
+        }
+
+        _receiveQueue->commit(packet);
+        count++;
+    }
 
-size_t Sodaq_nbIOT::socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const char* str)
-{
-    return socketSend(socket, remoteIP, remotePort, (uint8_t *)str, strlen(str));
+    return count;
 }
 
-bool Sodaq_nbIOT::waitForUDPResponse(uint32_t timeoutMS)
+// On the R4 the URC announces a single datagram and it cannot be read in parts (the data would be
+// cut short without a "remainingLength"), so a datagram that does not fit the "size" bytes of "buffer"
+// is read into it in parts and dropped. The N2 reports the rest of a partial read instead.
+// Returns true if the datagram was dropped.
+bool Sodaq_nbIOT::dropOversizedDatagram(uint8_t socketID, uint8_t* buffer, size_t size, size_t lineSize)
 {
-    if (hasPendingUDPBytes()) { 
-        return true; 
+    if (!isSaraR4XX() || (_sockets[socketID].pendingBytes <= size)) {
+        return false;
     }
-    
-    uint32_t startTime = millis();
-    
-    while (!hasPendingUDPBytes() && (millis() - startTime) < timeoutMS) {
-        if (_isSaraR4XX) {
-            print("AT+USORF=");
-            print(_receivedUDPResponseSocket);
-            print(",");
-            println(0); 
 
-            uint8_t socketID;
-            size_t length;
+    debugPrintLn(F("Dropping a datagram that does not fit"));
 
-            if (readResponse<uint8_t, size_t>(_udpReadURCParser, &socketID, &length) == ResponseOK) {
-                _pendingUDPBytes = length;
-            }
-        }
-        else {
-            isAlive();
+    SaraN2UDPPacketMetadata packet;
+
+    // an empty read clears what the modem did not keep
+    while ((_sockets[socketID].pendingBytes > 0) && (socketReceive(socketID, &packet, buffer, size, true, lineSize) > 0)) { }
+
+    return true;
+}
+
+// Returns the first socket with pending data, or SOCKET_FAIL if there is none.
+int Sodaq_nbIOT::getPendingSocket()
+{
+    for (uint8_t i = 0; i < SODAQ_NBIOT_SOCKET_COUNT; i++) {
+        if (_sockets[i].pendingBytes > 0) {
+            return i;
         }
-        sodaq_wdt_safe_delay(10);
     }
-    
-    return hasPendingUDPBytes();
+
+    return SOCKET_FAIL;
 }
 
 size_t Sodaq_nbIOT::getPendingUDPBytes()
 {
-    return _pendingUDPBytes;
+    int socketID = getPendingSocket();
+
+    return (socketID != SOCKET_FAIL) ? _sockets[socketID].pendingBytes : 0;
 }
 
 bool Sodaq_nbIOT::hasPendingUDPBytes()
 {
-    return _pendingUDPBytes > 0;
+    return getPendingSocket() != SOCKET_FAIL;
+}
+
+size_t Sodaq_nbIOT::getPendingUDPBytes(uint8_t socketID)
+{
+    return (socketID < SODAQ_NBIOT_SOCKET_COUNT) ? _sockets[socketID].pendingBytes : 0;
+}
+
+uint8_t Sodaq_nbIOT::getPendingDatagramCount(uint8_t socketID)
+{
+    return (socketID < SODAQ_NBIOT_SOCKET_COUNT) ? _sockets[socketID].datagramCount : 0;
 }
 
-size_t Sodaq_nbIOT::socketReceive(SaraN2UDPPacketMetadata* packet, char* buffer, size_t size)
+bool Sodaq_nbIOT::isSocketClosed(uint8_t socketID)
 {
-    size_t maxBufferSize = size;
+    return (socketID < SODAQ_NBIOT_SOCKET_COUNT) && _sockets[socketID].isClosed;
+}
+
+uint16_t Sodaq_nbIOT::getSocketLocalPort(uint8_t socketID)
+{
+    return (socketID < SODAQ_NBIOT_SOCKET_COUNT) ? _sockets[socketID].localPort : 0;
+}
 
-    if (!hasPendingUDPBytes()) {
+// Reads up to "size" bytes of pending data of the socket. The data field of the response is
+// written straight into "buffer" while it is being received, either hex decoded (bytes)
+// or as is (2 hex characters per byte, "buffer" must be able to hold 2 * "size" characters).
+// The response line is read into the first "lineSize" bytes of the input buffer (0 for all of it).
+size_t Sodaq_nbIOT::socketReceive(uint8_t socketID, SaraN2UDPPacketMetadata* packet, uint8_t* buffer, size_t size, bool decodeHex,
+                                  size_t lineSize)
+{
+    if (!hasPendingUDPBytes(socketID)) {
         // no URC has happened, no socket to read
-        debugPrintLn("Reading from without available bytes!");
+        debugPrintLn(F("Reading from without available bytes!"));
         return 0;
     }
     
-    if (_isSaraR4XX) {
-        print("AT+USORF=");
+    SocketState& socket = _sockets[socketID];
+    size_t readSize = min(size, static_cast<size_t>(socket.pendingBytes));
+
+    if (readSize == 0) {
+        return 0;
+    }
+
+    // stays 0 if the response has no data line
+    packet->length = 0;
+
+    CommandWriter command(*this);
+
+    command.print(isSaraR4XX() ? F("AT+USORF=") : F("AT+NSORF="));
+    command.print(static_cast<uint32_t>(socketID));
+    command.print(',');
+    command.print(static_cast<uint32_t>(readSize));
+    command.println();
+
+    // the data is the second quoted field: <socket>,"<ip>",<port>,<length>,"<data>"...
+    if (_isBinaryDataMode) {
+        // raw bytes, as hex they are encoded afterwards from the second half of the buffer
+        armRxRawFieldSink(decodeHex ? buffer : &buffer[readSize], readSize, 1);
     }
     else {
-        print("AT+NSORF=");
+        armRxFieldSink(buffer, decodeHex ? readSize : 2 * readSize, 1, decodeHex);
     }
-    print(_receivedUDPResponseSocket);
-    print(',');
 
-    size_t readSize = min(maxBufferSize, _pendingUDPBytes);
-    println(readSize);
-    
-    if (readResponse<SaraN2UDPPacketMetadata, char>(_udpReadSocketParser, packet, buffer) == ResponseOK) {
-        // update pending bytes
-        _pendingUDPBytes -= packet->length;
+    ResponseTypes response = readResponse(_inputBuffer, (lineSize > 0) ? lineSize : _inputBufferSize,
+                                          (CallbackMethodPtr)_udpReadSocketParser, packet, NULL);
+    disarmRxFieldSink();
+
+    if ((response == ResponseOK) && isRxFieldSinkFailed()) {
+        debugPrintLn(F("Error: The data is malformed or does not match its length"));
+        response = ResponseError;
+    }
+
+    if (response == ResponseOK) {
+        if (_isBinaryDataMode && !decodeHex) {
+            // front to back, each byte is read before its position is overwritten
+            for (size_t i = 0; i < min(static_cast<size_t>(packet->length), readSize); i++) {
+                sodaq_hex_encode(&buffer[readSize + i], 1, reinterpret_cast<char*>(&buffer[2 * i]));
+            }
+        }
+
+        // update pending bytes, without a data line nothing is pending anymore
+        if (packet->length == 0) {
+            socket.pendingBytes = 0;
+        }
+        else {
+            socket.pendingBytes -= min(static_cast<uint16_t>(packet->length), socket.pendingBytes);
+        }
+
+        if (socket.pendingBytes == 0) {
+            socket.datagramCount = 0;
+        }
+        else if ((packet->remainingLength == 0) && (socket.datagramCount > 0)) {
+            socket.datagramCount--;
+        }
         
         return packet->length;
     }
     
-    debugPrintLn("Reading from socket failed!");
+    debugPrintLn(F("Reading from socket failed!"));
     return 0;
 }
 
+// Receives pending data of the first socket with pending data, as hex characters.
 size_t Sodaq_nbIOT::socketReceiveHex(char* buffer, size_t length, SaraN2UDPPacketMetadata* p)
 {
-    SaraN2UDPPacketMetadata packet;
+    int socketID = getPendingSocket();
 
-    size_t receiveSize = length;
-    if (!_isSaraR4XX) {
-        receiveSize = receiveSize / 2;
+    if (socketID == SOCKET_FAIL) {
+        debugPrintLn(F("Reading from without available bytes!"));
+        return 0;
     }
 
-    receiveSize = min(receiveSize, _pendingUDPBytes);
-    return socketReceive(p ? p : &packet, buffer, receiveSize);
+    return socketReceiveHex(socketID, buffer, length, p);
 }
 
+// Receives pending data of the first socket with pending data, decoded into the buffer.
 size_t Sodaq_nbIOT::socketReceiveBytes(uint8_t* buffer, size_t length, SaraN2UDPPacketMetadata* p)
 {
-    size_t size = min(length, min(SODAQ_NBIOT_MAX_UDP_BUFFER, _pendingUDPBytes));
+    int socketID = getPendingSocket();
 
-    SaraN2UDPPacketMetadata packet;
-    char tempBuffer[SODAQ_NBIOT_MAX_UDP_BUFFER];
+    if (socketID == SOCKET_FAIL) {
+        debugPrintLn(F("Reading from without available bytes!"));
+        return 0;
+    }
 
-    size_t receivedSize = socketReceive(p ? p : &packet, tempBuffer, size);
+    return socketReceiveBytes(socketID, buffer, length, p);
+}
 
-    if (buffer && length > 0) {
-        for (size_t i = 0; i < receivedSize * 2; i += 2) {
-            buffer[i / 2] = HEX_PAIR_TO_BYTE(tempBuffer[i], tempBuffer[i + 1]);
-        }
+// Receives pending socket data as hex characters. The buffer is null terminated,
+// so "length" must include room for the terminator.
+size_t Sodaq_nbIOT::socketReceiveHex(uint8_t socketID, char* buffer, size_t length, SaraN2UDPPacketMetadata* p)
+{
+    SaraN2UDPPacketMetadata packet;
+
+    if (!buffer || (length == 0)) {
+        return 0;
     }
-    
+
+    buffer[0] = '\0';
+
+    size_t receivedSize = socketReceive(socketID, p ? p : &packet, reinterpret_cast<uint8_t*>(buffer), (length - 1) / 2, false);
+    buffer[2 * min(receivedSize, (length - 1) / 2)] = '\0';
+
     return receivedSize;
 }
 
+// Receives pending socket data, decoded into the buffer as it arrives (no intermediate copy).
+size_t Sodaq_nbIOT::socketReceiveBytes(uint8_t socketID, uint8_t* buffer, size_t length, SaraN2UDPPacketMetadata* p)
+{
+    SaraN2UDPPacketMetadata packet;
+
+    if (!buffer || (length == 0)) {
+        return 0;
+    }
+
+    return socketReceive(socketID, p ? p : &packet, buffer, length, true);
+}
+
 ResponseTypes Sodaq_nbIOT::_createSocketParser(ResponseTypes& response, const char* buffer, size_t size,
         uint8_t* socket, uint8_t* dummy)
 {
@@ -942,27 +2399,11 @@ ResponseTypes Sodaq_nbIOT::_createSocketParser(ResponseTypes& response, const ch
         return ResponseError;
     }
     
-    int socketID;
-    
-    if (sscanf(buffer, "%d", &socketID) == 1) {
-        if (socketID <= UINT8_MAX) {
-            *socket = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-        
-        return ResponseEmpty;
-    }
-
-    if (sscanf(buffer, "+USOCR: %d", &socketID) == 1) {
-        if (socketID <= UINT8_MAX) {
-            *socket = socketID;
-        }
-        else {
-            return ResponseError;
-        }
+    // N2: "<socket>", R4: "+USOCR: <socket>"
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    tokenizer.skip(F("+USOCR:"));
 
+    if (tokenizer.readInt(socket) && tokenizer.atEnd()) {
         return ResponseEmpty;
     }
     
@@ -972,46 +2413,15 @@ ResponseTypes Sodaq_nbIOT::_createSocketParser(ResponseTypes& response, const ch
 ResponseTypes Sodaq_nbIOT::_sendSocketParser(ResponseTypes& response, const char* buffer, size_t size,
         uint8_t* socket, size_t* length)
 {
-    if (!socket) {
+    if (!socket || !length) {
         return ResponseError;
     }
     
-    int socketID;
-    int sendSize;
-    
-    if (sscanf(buffer, "%d,%d", &socketID, &sendSize) == 2) {
-        if (socketID <= UINT8_MAX) {
-            *socket = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-
-        if (socketID <= SIZE_MAX) {
-            *length = sendSize;
-        }
-        else {
-            return ResponseError;
-        }
-        
-        return ResponseEmpty;
-    }
-
-    if (sscanf(buffer, "+USOST: %d,%d", &socketID, &sendSize) == 2) {
-        if (socketID <= UINT8_MAX) {
-            *socket = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-
-        if (socketID <= SIZE_MAX) {
-            *length = sendSize;
-        }
-        else {
-            return ResponseError;
-        }
+    // N2: "<socket>,<length>", R4: "+USOST: <socket>,<length>"
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    tokenizer.skip(F("+USOST:"));
 
+    if (tokenizer.readInt(socket) && tokenizer.skip(',') && tokenizer.readInt(length)) {
         return ResponseEmpty;
     }
     
@@ -1029,28 +2439,33 @@ ResponseTypes Sodaq_nbIOT::_udpReadSocketParser(ResponseTypes& response, const c
         return ResponsePendingExtra;
     }
 
-    int socketID;
+    // N2: <socket>,"<ip>",<port>,<length>,"<data>",<remaining_length>
+    // R4: +USORF: <socket>,"<ip>",<port>,<length>,"<data>"
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    bool isSaraR4XX = tokenizer.skip(F("+USORF:"));
+    const char* hex;
+    size_t hexLength;
 
-    if (sscanf(buffer, "%d,\"%[^\"]\",%d,%d,\"%[^\"]\",%d", &socketID, packet->ip, &packet->port, &packet->length, data, &packet->remainingLength) == 6) {
-        if (socketID <= UINT8_MAX) {
-            packet->socketID = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-        return ResponseEmpty;
-    } 
-    else if (sscanf(buffer, "+USORF: %d,\"%[^\"]\",%d,%d,\"%[^\"]\"", &socketID, packet->ip, &packet->port, &packet->length, data) == 5) {
-        if (socketID <= UINT8_MAX) {
-            packet->socketID = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-        return ResponseEmpty;
+    if (!(tokenizer.readInt(&packet->socketID) && tokenizer.skip(',') &&
+            tokenizer.readIP(packet->ip, sizeof(packet->ip)) && tokenizer.skip(',') &&
+            tokenizer.readInt(&packet->port) && tokenizer.skip(',') &&
+            tokenizer.readInt(&packet->length) && tokenizer.skip(',') &&
+            tokenizer.readString(&hex, &hexLength))) {
+        return ResponseError;
     }
 
-    return ResponseError;
+    packet->remainingLength = 0;
+
+    if (!isSaraR4XX && !(tokenizer.skip(',') && tokenizer.readInt(&packet->remainingLength))) {
+        return ResponseError;
+    }
+
+    if (data) {
+        memcpy(data, hex, hexLength);
+        data[hexLength] = '\0';
+    }
+
+    return ResponseEmpty;
 }
 
 
@@ -1061,12 +2476,18 @@ ResponseTypes Sodaq_nbIOT::_messageReceiveParser(ResponseTypes& response, const
         return ResponseError;
     }
 
+    // <length>,"<data>"
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
     size_t receivedLength;
+    const char* hex;
+    size_t hexLength;
 
-    if (sscanf(buffer, "%d,\"%s\"", &receivedLength, data) == 2) {
+    if (tokenizer.readInt(&receivedLength) && tokenizer.skip(',') && tokenizer.readString(&hex, &hexLength)) {
         // length contains the length of the passed buffer
         // this guards against overflowing the passed buffer
-        if (receivedLength * 2 <= *length) {
+        if ((receivedLength * 2 <= *length) && (hexLength < *length)) {
+            memcpy(data, hex, hexLength);
+            data[hexLength] = '\0';
             *length = receivedLength * 2;
         }
         else {
@@ -1087,24 +2508,10 @@ ResponseTypes Sodaq_nbIOT::_udpReadURCParser(ResponseTypes& response, const char
         return ResponsePendingExtra;
     }
 
-    int socketID;
-    int receiveSize;
-
-    if (sscanf(buffer, "+USORF: %d,%d", &socketID, &receiveSize) == 2) {
-        if (socketID <= UINT8_MAX) {
-            *socket = socketID;
-        }
-        else {
-            return ResponseError;
-        }
-
-        if (socketID <= SIZE_MAX) {
-            *length = receiveSize;
-        }
-        else {
-            return ResponseError;
-        }
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
 
+    if (tokenizer.skip(F("+USORF:")) && tokenizer.readInt(socket) &&
+            tokenizer.skip(',') && tokenizer.readInt(length)) {
         return ResponseEmpty;
     }
 
@@ -1114,7 +2521,7 @@ ResponseTypes Sodaq_nbIOT::_udpReadURCParser(ResponseTypes& response, const char
 // Disconnects the modem from the network.
 bool Sodaq_nbIOT::disconnect()
 {
-    println("AT+CGATT=0");
+    println(F("AT+CGATT=0"));
     
     return (readResponse(NULL, 40000) == ResponseOK);
 }
@@ -1124,7 +2531,7 @@ bool Sodaq_nbIOT::isConnected()
 {
     uint8_t value = 0;
     
-    println("AT+CGATT?");
+    println(F("AT+CGATT?"));
     
     if (readResponse<uint8_t, uint8_t>(_cgattParser, &value, NULL, 0, 10 * 1000) == ResponseOK) {
         return (value == 1);
@@ -1139,7 +2546,7 @@ bool Sodaq_nbIOT::getRSSIAndBER(int8_t* rssi, uint8_t* ber)
 {
     static char berValues[] = { 49, 43, 37, 25, 19, 13, 7, 0 }; // 3GPP TS 45.008 [20] subclause 8.2.4
     
-    println("AT+CSQ");
+    println(F("AT+CSQ"));
     
     int csqRaw = 0;
     int berRaw = 0;
@@ -1172,9 +2579,165 @@ uint8_t Sodaq_nbIOT::convertRSSI2CSQ(int8_t rssi) const
     return (rssi + 113) / 2;
 }
 
-bool Sodaq_nbIOT::startsWith(const char* pre, const char* str)
+// Encodes "seconds" as a 3GPP TS 24.008 GPRS timer value, with the smallest of the (ascending) "units"
+// that can represent it. The value is rounded up.
+static uint8_t encodePsmTimer(uint32_t seconds, const PsmTimerUnit* units, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (seconds <= PSM_TIMER_MAX_VALUE * units[i].Seconds) {
+            return (units[i].Code << 5) | ((seconds + units[i].Seconds - 1) / units[i].Seconds);
+        }
+    }
+
+    return (units[count - 1].Code << 5) | PSM_TIMER_MAX_VALUE;
+}
+
+// Decodes the 3GPP TS 24.008 GPRS timer "value" into "seconds".
+// Returns false if the timer is deactivated (or unknown).
+static bool decodePsmTimer(uint8_t value, const PsmTimerUnit* units, uint8_t count, uint32_t* seconds)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (units[i].Code == (value >> 5)) {
+            *seconds = (value & PSM_TIMER_MAX_VALUE) * units[i].Seconds;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Requests Power Saving Mode with the periodic TAU (T3412) and the active time (T3324) in seconds.
+bool Sodaq_nbIOT::setPsm(bool on, uint32_t periodicTau, uint32_t activeTime)
+{
+    char cpsms[sizeof("+CPSMS=1,,,\"01234567\",\"01234567\"")];
+    strcpy_P(cpsms, PSTR("+CPSMS=0"));
+
+    if (on) {
+        char periodicTauBits[8 + 1];
+        char activeTimeBits[8 + 1];
+
+        formatBits(encodePsmTimer(periodicTau, periodicTauUnits, ARRAY_SIZE(periodicTauUnits)), 8, periodicTauBits);
+        formatBits(encodePsmTimer(activeTime, activeTimeUnits, ARRAY_SIZE(activeTimeUnits)), 8, activeTimeBits);
+
+        cpsms[0] = '\0';
+        appendString(cpsms, sizeof(cpsms), F("+CPSMS=1,,,\""));
+        appendString(cpsms, sizeof(cpsms), periodicTauBits);
+        appendString(cpsms, sizeof(cpsms), F("\",\""));
+        appendString(cpsms, sizeof(cpsms), activeTimeBits);
+        appendString(cpsms, sizeof(cpsms), F("\""));
+    }
+
+    // the granted timers are reported by +CEREG=4 and the PSM state by +NPSMR/+UUPSMR,
+    // these are optional as not every firmware supports them
+    ChainedCommand commands[] = {
+        toChainedCommand(cpsms),
+        toChainedCommand(F("+CEREG=4")),
+        toChainedCommand(isSaraR4XX() ? F("+UPSMR=1") : F("+NPSMR=1"))
+    };
+    ResponseTypes results[ARRAY_SIZE(commands)];
+
+    sendCommands(commands, on ? ARRAY_SIZE(commands) : 1, results);
+
+    if (results[0] != ResponseOK) {
+        return false;
+    }
+
+    _isPsmRequested = on;
+
+    return true;
+}
+
+// Gets the periodic TAU and the active time in seconds, as granted by the network.
+// Returns false if the network has not (yet) granted PSM.
+bool Sodaq_nbIOT::getGrantedPsmTimers(uint32_t* periodicTau, uint32_t* activeTime) const
+{
+    return decodePsmTimer(_grantedPeriodicTau, periodicTauUnits, ARRAY_SIZE(periodicTauUnits), periodicTau) &&
+           decodePsmTimer(_grantedActiveTime, activeTimeUnits, ARRAY_SIZE(activeTimeUnits), activeTime);
+}
+
+// Handles the URCs until the modem reports that it entered PSM, or until "timeout".
+// Returns true if the modem is in PSM.
+bool Sodaq_nbIOT::waitForPsm(uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while (!_isInPsm && !is_timedout(start, timeout)) {
+        waitForNetworkEvent(timeout - (millis() - start));
+    }
+
+    return _isInPsm;
+}
+
+// Requests eDRX with the given cycle (3GPP TS 24.008 table 10.5.5.32).
+bool Sodaq_nbIOT::setEdrx(bool on, uint8_t cycle)
+{
+    print(F("AT+CEDRXS="));
+
+    if (on) {
+        char cycleBits[4 + 1];
+
+        formatBits(cycle, 4, cycleBits);
+
+        // 5 is E-UTRAN (NB-S1 mode)
+        print(F("1,5,\""));
+        print(cycleBits);
+        println('"');
+    }
+    else {
+        println(F("0"));
+    }
+
+    return (readResponse() == ResponseOK);
+}
+
+// Gets the eDRX cycle and paging time window granted by the network.
+// Returns false if eDRX is not used.
+bool Sodaq_nbIOT::getGrantedEdrx(uint8_t* cycle, uint8_t* pagingTimeWindow)
+{
+    *cycle = PSM_TIMER_UNKNOWN;
+    *pagingTimeWindow = 0;
+
+    println(F("AT+CEDRXRDP"));
+
+    return (readResponse<uint8_t, uint8_t>(_cedrxrdpParser, cycle, pagingTimeWindow) == ResponseOK) &&
+           (*cycle != PSM_TIMER_UNKNOWN);
+}
+
+ResponseTypes Sodaq_nbIOT::_cedrxrdpParser(ResponseTypes& response, const char* buffer, size_t size,
+    uint8_t* cycle, uint8_t* pagingTimeWindow)
+{
+    if (!cycle || !pagingTimeWindow) {
+        return ResponseError;
+    }
+
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint8_t accessTechnology;
+    const char* field;
+    size_t fieldLength;
+
+    // +CEDRXRDP: <AcT>[,<Requested_eDRX_value>[,<NW-provided_eDRX_value>[,<Paging_time_window>]]]
+    if (!tokenizer.skip(F("+CEDRXRDP:")) || !tokenizer.readInt(&accessTechnology)) {
+        return ResponseError;
+    }
+
+    // an access technology of 0 means eDRX is not used
+    if ((accessTechnology != 0) && tokenizer.skip(',') && tokenizer.readString(&field, &fieldLength) &&
+            tokenizer.skip(',') && tokenizer.readString(&field, &fieldLength) &&
+            parseBits(field, fieldLength, cycle)) {
+        if (tokenizer.skip(',') && tokenizer.readString(&field, &fieldLength)) {
+            parseBits(field, fieldLength, pagingTimeWindow);
+        }
+    }
+
+    return ResponseEmpty;
+}
+
+// Returns true if "str" starts with the flash string "pre" (F("...")).
+bool Sodaq_nbIOT::startsWith(const __FlashStringHelper* pre, const char* str)
 {
-    return (strncmp(pre, str, strlen(pre)) == 0);
+    const char* p = reinterpret_cast<const char*>(pre);
+
+    return (strncmp_P(str, p, strlen_P(p)) == 0);
 }
 
 size_t Sodaq_nbIOT::ipToString(IP_t ip, char* buffer, size_t size)
@@ -1241,33 +2804,28 @@ bool Sodaq_nbIOT::isValidIPv4(const char* str)
     return true;
 }
 
-bool Sodaq_nbIOT::waitForSignalQuality(uint32_t timeout)
+// Handles the incoming lines (URCs) until a network URC has been received, or until "timeout".
+// Returns true if a network URC was received.
+bool Sodaq_nbIOT::waitForNetworkEvent(uint32_t timeout)
 {
-    uint32_t start = millis();
-    const int8_t minRSSI = getMinRSSI();
-    int8_t rssi;
-    uint8_t ber;
-    
-    uint32_t delay_count = 500;
-    
-    while (!is_timedout(start, timeout)) {
-        if (getRSSIAndBER(&rssi, &ber)) {
-            if (rssi != 0 && rssi >= minRSSI) {
-                _lastRSSI = rssi;
-                _CSQtime = (int32_t)(millis() - start) / 1000;
-                return true;
-            }
-        }
-        
-        sodaq_wdt_safe_delay(delay_count);
-        
-        // Next time wait a little longer, but not longer than 5 seconds
-        if (delay_count < 5000) {
-            delay_count += 1000;
+    uint32_t start = NOW;
+
+    _isNetworkEvent = false;
+
+    do {
+        int count = readLn(_inputBuffer, _inputBufferSize, min(timeout, static_cast<uint32_t>(250)));
+        sodaq_wdt_reset();
+
+        if (count > 0) {
+            debugPrint(F("[wait]: "));
+            debugPrintLn(_inputBuffer);
+
+            handleUrc(_inputBuffer, count);
         }
     }
-    
-    return false;
+    while (!_isNetworkEvent && !is_timedout(start, timeout));
+
+    return _isNetworkEvent;
 }
 
 ResponseTypes Sodaq_nbIOT::_cgattParser(ResponseTypes& response, const char* buffer, size_t size, uint8_t* result, uint8_t* dummy)
@@ -1276,10 +2834,9 @@ ResponseTypes Sodaq_nbIOT::_cgattParser(ResponseTypes& response, const char* buf
         return ResponseError;
     }
     
-    int val;
-    
-    if (sscanf(buffer, "+CGATT: %d", &val) == 1) {
-        *result = val;
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+
+    if (tokenizer.skip(F("+CGATT:")) && tokenizer.readInt(result)) {
         return ResponseEmpty;
     }
     
@@ -1293,7 +2850,9 @@ ResponseTypes Sodaq_nbIOT::_csqParser(ResponseTypes& response, const char* buffe
         return ResponseError;
     }
     
-    if (sscanf(buffer, "+CSQ: %d,%d", rssi, ber) == 2) {
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+
+    if (tokenizer.skip(F("+CSQ:")) && tokenizer.readInt(rssi) && tokenizer.skip(',') && tokenizer.readInt(ber)) {
         return ResponseEmpty;
     }
     
@@ -1324,15 +2883,28 @@ ResponseTypes Sodaq_nbIOT::_cclkParser(ResponseTypes& response, const char* buff
         return ResponseError;
     }
     
-    // format: "yy/MM/dd,hh:mm:ss+TZ
+    // format: "yy/MM/dd,hh:mm:ss+TZ", the time zone is optional
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
     int y, m, d, h, min, sec, tz;
-    if (sscanf(buffer, "+CCLK: \"%d/%d/%d,%d:%d:%d+%d\"", &y, &m, &d, &h, &min, &sec, &tz) == 7) {
-        *epoch = convertDatetimeToEpoch(y, m, d, h, min, sec);
-        return ResponseEmpty;
+
+    if (!tokenizer.skip(F("+CCLK:"))) {
+        return ResponseError;
     }
-    else if (sscanf(buffer, "+CCLK: \"%d/%d/%d,%d:%d:%d\"", &y, &m, &d, &h, &min, &sec) == 6) {
-        *epoch = convertDatetimeToEpoch(y, m, d, h, min, sec);
-        return ResponseEmpty;
+
+    tokenizer.skip(' ');
+
+    if (tokenizer.skip('"') && tokenizer.readInt(&y) && tokenizer.skip('/') && tokenizer.readInt(&m) && tokenizer.skip('/') &&
+            tokenizer.readInt(&d) && tokenizer.skip(',') &&
+            tokenizer.readInt(&h) && tokenizer.skip(':') && tokenizer.readInt(&min) && tokenizer.skip(':') &&
+            tokenizer.readInt(&sec)) {
+        if ((tokenizer.peek('+') || tokenizer.peek('-')) && !tokenizer.readInt(&tz)) {
+            return ResponseError;
+        }
+
+        if (tokenizer.skip('"')) {
+            *epoch = convertDatetimeToEpoch(y, m, d, h, min, sec);
+            return ResponseEmpty;
+        }
     }
 
     return ResponseError;
@@ -1340,24 +2912,22 @@ ResponseTypes Sodaq_nbIOT::_cclkParser(ResponseTypes& response, const char* buff
 
 bool Sodaq_nbIOT::sendMessage(const uint8_t* buffer, size_t size)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("Messages not supported for sara R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Messages not supported for sara R4XX"));
         return false;
     }
-    if (size > 512) {
+    if (size > SODAQ_NBIOT_MAX_MESSAGE_SIZE) {
         return false;
     }
     
-    print("AT+NMGS=");
-    print(size);
-    print(",\"");
-    
-    for (uint16_t i = 0; i < size; ++i) {
-        print(static_cast<char>(NIBBLE_TO_HEX_CHAR(HIGH_NIBBLE(buffer[i]))));
-        print(static_cast<char>(NIBBLE_TO_HEX_CHAR(LOW_NIBBLE(buffer[i]))));
-    }
-    
-    println("\"");
+    CommandWriter command(*this);
+
+    command.print(F("AT+NMGS="));
+    command.print(static_cast<uint32_t>(size));
+    command.print(F(",\""));
+    command.printHex(buffer, size);
+    command.print('\"');
+    command.println();
     
     return (readResponse() == ResponseOK);
 }
@@ -1365,8 +2935,8 @@ bool Sodaq_nbIOT::sendMessage(const uint8_t* buffer, size_t size)
 // NOTE! Need to send data ( sendMessage() ) before receiving
 size_t Sodaq_nbIOT::receiveMessage(char* buffer, size_t size)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("Messages not supported for sara R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Messages not supported for sara R4XX"));
         return false;
     }
 
@@ -1374,11 +2944,11 @@ size_t Sodaq_nbIOT::receiveMessage(char* buffer, size_t size)
     size_t receiveSize = size;
 
     // when there is no buffered message, the parser is not executed
-    strcpy(buffer, "no_parser");
+    strcpy_P(buffer, PSTR("no_parser"));
 
-    println("AT+NMGR");
+    println(F("AT+NMGR"));
     if (readResponse<size_t, char>(_messageReceiveParser, &receiveSize, buffer) == ResponseOK) {
-        if (strcmp(buffer, "no_parser") == 0) {
+        if (strcmp_P(buffer, PSTR("no_parser")) == 0) {
             return 0;
         }
         else {
@@ -1391,11 +2961,11 @@ size_t Sodaq_nbIOT::receiveMessage(char* buffer, size_t size)
 
 int Sodaq_nbIOT::getSentMessagesCount(SentMessageStatus filter)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("Messages not supported for sara R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Messages not supported for sara R4XX"));
         return 0;
     }
-    println("AT+NQMGS");
+    println(F("AT+NQMGS"));
     
     uint16_t pendingCount = 0;
     uint16_t errorCount = 0;
@@ -1418,13 +2988,12 @@ ResponseTypes Sodaq_nbIOT::_nqmgsParser(ResponseTypes& response, const char* buf
         return ResponseError;
     }
 
-    int pendingValue;
-    int errorValue;
-
-    if (sscanf(buffer, "PENDING=%d,SENT=%*d,ERROR=%d", &pendingValue, &errorValue) == 2) {
-        *pendingCount = pendingValue;
-        *errorCount = errorValue;
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
+    uint16_t sentCount;
 
+    if (tokenizer.skip(F("PENDING=")) && tokenizer.readInt(pendingCount) && tokenizer.skip(',') &&
+            tokenizer.skip(F("SENT=")) && tokenizer.readInt(&sentCount) && tokenizer.skip(',') &&
+            tokenizer.skip(F("ERROR=")) && tokenizer.readInt(errorCount)) {
         return ResponseEmpty;
     }
 
@@ -1433,11 +3002,11 @@ ResponseTypes Sodaq_nbIOT::_nqmgsParser(ResponseTypes& response, const char* buf
 
 bool Sodaq_nbIOT::getReceivedMessagesCount(ReceivedMessageStatus* status)
 {
-    if (_isSaraR4XX) {
-        debugPrintLn("Messages not supported for sara R4XX");
+    if (isSaraR4XX()) {
+        debugPrintLn(F("Messages not supported for sara R4XX"));
         return 0;
     }
-    println("AT+NQMGS");
+    println(F("AT+NQMGR"));
 
     uint8_t dummy = 0;
 
@@ -1454,16 +3023,11 @@ ResponseTypes Sodaq_nbIOT::_nqmgrParser(ResponseTypes& response, const char* buf
         return ResponseError;
     }
     
-    int buffered;
-    int received;
-    int dropped;
+    Sodaq_AT_Tokenizer tokenizer(buffer, size);
 
-    
-    if (sscanf(buffer, "BUFFERED=%d,RECEIVED=%d,DROPPED=%d", &buffered, &received, &dropped) == 2) {
-        status->pending = buffered;
-        status->receivedSinceBoot = received;
-        status->droppedSinceBoot = dropped;
-        
+    if (tokenizer.skip(F("BUFFERED=")) && tokenizer.readInt(&status->pending) && tokenizer.skip(',') &&
+            tokenizer.skip(F("RECEIVED=")) && tokenizer.readInt(&status->receivedSinceBoot) && tokenizer.skip(',') &&
+            tokenizer.skip(F("DROPPED=")) && tokenizer.readInt(&status->droppedSinceBoot)) {
         return ResponseEmpty;
     }
     
@@ -23,12 +23,66 @@
 
 #define SODAQ_NBIOT_DEFAULT_UDP_TIMOUT_MS 15000
 #define SODAQ_NBIOT_MAX_UDP_BUFFER 256
+#define SODAQ_NBIOT_MAX_MESSAGE_SIZE 512
 
 #define SODAQ_NBIOT_DEFAULT_CID 0
 
+// The number of sockets of the modem.
+#define SODAQ_NBIOT_SOCKET_COUNT 7
+
+// The number of URC handlers registered by the driver itself.
+#define SODAQ_NBIOT_BUILTIN_URC_HANDLERS 9
+
+// The maximum number of URC handlers the application can add with addUrcHandler().
+#ifndef SODAQ_NBIOT_MAX_APP_URC_HANDLERS
+#define SODAQ_NBIOT_MAX_APP_URC_HANDLERS 4
+#endif
+
+#define SODAQ_NBIOT_MAX_URC_HANDLERS (SODAQ_NBIOT_BUILTIN_URC_HANDLERS + SODAQ_NBIOT_MAX_APP_URC_HANDLERS)
+
+// The maximum number of queued asynchronous commands.
+#ifndef SODAQ_NBIOT_ASYNC_QUEUE_SIZE
+#define SODAQ_NBIOT_ASYNC_QUEUE_SIZE 4
+#endif
+
+// The maximum length of a line with chained commands ("AT+A;+B;+C"), see sendCommands().
+#ifndef SODAQ_NBIOT_MAX_CHAINED_COMMAND_LENGTH
+#define SODAQ_NBIOT_MAX_CHAINED_COMMAND_LENGTH 128
+#endif
+
+// The maximum length of the SIM PIN, see setPin().
+#define SODAQ_NBIOT_MAX_PIN_LENGTH 8
+
+// The minimum size of the input buffer of Sodaq_nbIOT_Static, enough for the longest response line
+// that is not sunk into a caller's buffer.
+#define SODAQ_NBIOT_MIN_INPUT_BUFFER_SIZE 128
+
+// Define one of these (e.g. -DSODAQ_NBIOT_SARA_N2_ONLY) to build for a single modem family:
+// isSaraR4XX() becomes a constant, so the compiler leaves out the code of the other family.
+// It must be a global build flag (e.g. build_flags in platformio.ini), the sketch and the library
+// have to be compiled with the same setting. A #define in the sketch does not reach the library.
+#if defined(SODAQ_NBIOT_SARA_N2_ONLY) && defined(SODAQ_NBIOT_SARA_R4_ONLY)
+#error "Define only one of SODAQ_NBIOT_SARA_N2_ONLY and SODAQ_NBIOT_SARA_R4_ONLY"
+#endif
+
+// The constructor references the symbol of the family setting it was compiled with and the library
+// only defines the symbol of its own setting, so mixing settings fails to link (instead of the inline
+// methods silently disagreeing with the library).
+#if defined(SODAQ_NBIOT_SARA_N2_ONLY)
+#define SODAQ_NBIOT_BUILD_FAMILY sodaq_nbiot_built_for_sara_n2_only
+#elif defined(SODAQ_NBIOT_SARA_R4_ONLY)
+#define SODAQ_NBIOT_BUILD_FAMILY sodaq_nbiot_built_for_sara_r4_only
+#else
+#define SODAQ_NBIOT_BUILD_FAMILY sodaq_nbiot_built_for_both_families
+#endif
+
 #include "Arduino.h"
 #include "Sodaq_AT_Device.h"
 
+class Sodaq_ReceiveQueue;
+
+extern const uint8_t SODAQ_NBIOT_BUILD_FAMILY;
+
 struct SaraN2UDPPacketMetadata {
     uint8_t socketID;
     char ip[16]; // max IP size 4*3 digits + 3 dots + zero term = 16
@@ -37,10 +91,23 @@ struct SaraN2UDPPacketMetadata {
     int remainingLength;
 };
 
+// callback for handling an unsolicited result code (URC) line, e.g. "+NSONMI: 0,4".
+// The buffer contains the complete line, including the prefix.
+typedef void (*UrcHandlerPtr)(const char* buffer, size_t size, void* parameter);
+
+// callback for handling a received datagram, see Sodaq_nbIOT::setDatagramHandler().
+// "data" points into the input buffer of the driver, it is only valid during the call.
+typedef void (*DatagramHandlerPtr)(uint8_t socketID, const SaraN2UDPPacketMetadata& metadata,
+                                   const uint8_t* data, size_t length, void* parameter);
+
+// callback invoked when an asynchronous command has completed, see Sodaq_nbIOT::sendCommandAsync().
+// "response" is ResponseOK, ResponseError, ResponseTimeout or the result of the parser.
+typedef void (*CommandCompletionPtr)(ResponseTypes response, void* context);
+
 class Sodaq_nbIOT: public Sodaq_AT_Device
 {
     public:
-        Sodaq_nbIOT();
+        Sodaq_nbIOT() : Sodaq_nbIOT(&SODAQ_NBIOT_BUILD_FAMILY) { }
         
         enum SimStatuses {
             SimStatusUnknown = 0,
@@ -59,9 +126,119 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
             uint16_t receivedSinceBoot;
             uint16_t droppedSinceBoot;
         };
+
+        // The Release Assistance Indication of a socket send, telling the network when the
+        // connection can be released, see socketSend().
+        enum ReleaseAssistance {
+            ReleaseAssistanceNone = 0,
+            ReleaseAfterUplink, // this is the last packet, no reply is expected
+            ReleaseAfterReply,  // release after the (single) reply has been received
+        };
+
+        // The network registration status, as reported by the +CEREG URC (3GPP TS 27.007).
+        enum NetworkRegistrationStatuses {
+            NetworkNotRegistered = 0,
+            NetworkRegisteredHome = 1,
+            NetworkSearching = 2,
+            NetworkRegistrationDenied = 3,
+            NetworkStatusUnknown = 4,
+            NetworkRegisteredRoaming = 5,
+        };
+
+        // The phases of connect() that can be skipped, see getSkippedConnectPhases().
+        enum ConnectPhases {
+            ConnectPhaseBand = 0x01,    // AT+NBAND (N2)
+            ConnectPhaseNconfig = 0x02, // AT+NCONFIG (N2)
+            ConnectPhaseReboot = 0x04,  // AT+NRB and turning the modem on again (N2)
+            ConnectPhaseApn = 0x08,     // AT+CGDCONT
+            ConnectPhaseCdp = 0x10,     // AT+NCDP (N2)
+        };
         
         typedef ResponseTypes(*CallbackMethodPtr)(ResponseTypes& response, const char* buffer, size_t size,
                 void* parameter, void* parameter2);
+
+        // Registers a handler for the URC lines starting with "prefix" (e.g. "+CEREG:").
+        // The prefix must start with '+' and must remain valid (typically a string literal).
+        // While a command with a parser is running, the lines with its name (e.g. "+CSQ:" during AT+CSQ)
+        // go to its parser instead, as they are its response.
+        // Returns false if the prefix is invalid or there is no room for another handler.
+        bool addUrcHandler(const char* prefix, UrcHandlerPtr handler, void* parameter = NULL);
+
+        // Same as above, with the prefix in flash, e.g. F("+CEREG:").
+        bool addUrcHandler(const __FlashStringHelper* prefix, UrcHandlerPtr handler, void* parameter = NULL);
+
+        // Queues a command (e.g. "AT+CGATT?") to be sent by poll(), without blocking.
+        // "command" (without line terminator) must remain valid until the command has completed.
+        // The (optional) parser is called for the response lines, like with the blocking methods,
+        // and the (optional) completion callback is called with the final response.
+        // Do not call the blocking methods while isBusy() returns true.
+        // Returns false if the queue is full.
+        bool sendCommandAsync(const char* command, CommandCompletionPtr completion = NULL, void* context = NULL,
+                              uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS,
+                              CallbackMethodPtr parserMethod = NULL, void* parameter = NULL, void* parameter2 = NULL);
+
+        template<typename T1, typename T2>
+        bool sendCommandAsync(const char* command,
+                              ResponseTypes(*parserMethod)(ResponseTypes& response, const char* parseBuffer, size_t size, T1* parameter, T2* parameter2),
+                              T1* parameter, T2* parameter2,
+                              CommandCompletionPtr completion = NULL, void* context = NULL,
+                              uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS)
+        {
+            return sendCommandAsync(command, completion, context, timeout,
+                                    (CallbackMethodPtr)parserMethod, (void*)parameter, (void*)parameter2);
+        };
+
+        // Same as above, with the command in flash, e.g. F("AT+CGATT?").
+        bool sendCommandAsync(const __FlashStringHelper* command, CommandCompletionPtr completion = NULL, void* context = NULL,
+                              uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS,
+                              CallbackMethodPtr parserMethod = NULL, void* parameter = NULL, void* parameter2 = NULL);
+
+        template<typename T1, typename T2>
+        bool sendCommandAsync(const __FlashStringHelper* command,
+                              ResponseTypes(*parserMethod)(ResponseTypes& response, const char* parseBuffer, size_t size, T1* parameter, T2* parameter2),
+                              T1* parameter, T2* parameter2,
+                              CommandCompletionPtr completion = NULL, void* context = NULL,
+                              uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS)
+        {
+            return sendCommandAsync(command, completion, context, timeout,
+                                    (CallbackMethodPtr)parserMethod, (void*)parameter, (void*)parameter2);
+        };
+
+        // Sends the (set) commands, given without the "AT" prefix (e.g. "+CFUN=0"), chained on as
+        // few lines as possible ("AT+CFUN=0;+NSMI=0"), and stores the response of each command in
+        // the (optional) "results". When a chained line fails, its commands are repeated one by one
+        // to find out which one failed. If they all succeed on their own, the firmware is assumed
+        // not to support chaining and commands are sent one by one from then on.
+        // Only use commands that can safely be repeated.
+        // Returns true if all the commands succeeded.
+        bool sendCommands(const char* const* commands, uint8_t count, ResponseTypes* results = NULL,
+                          uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS);
+
+        // Same as above, with the commands in flash, e.g. { F("+CFUN=0"), F("+NSMI=0") }.
+        bool sendCommands(const __FlashStringHelper* const* commands, uint8_t count, ResponseTypes* results = NULL,
+                          uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS);
+
+        // A command of sendCommands() below, in RAM or in flash (e.g. { PSTR("+CFUN=0"), true }),
+        // so that constant commands can be chained with commands built at runtime.
+        struct ChainedCommand {
+            const char* command;
+            bool isFlash;
+        };
+
+        // Same as above, with each command in RAM or in flash.
+        bool sendCommands(const ChainedCommand* commands, uint8_t count, ResponseTypes* results = NULL,
+                          uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS);
+
+        // Advances the asynchronous commands without blocking: processes the lines received so far
+        // (URCs included), completes the running command and sends the next queued one.
+        // It also advances the network phase of beginConnect().
+        // Received datagrams are not read (their URCs only update the pending bytes), the application
+        // reads them with dispatchDatagrams() or prefetchDatagrams().
+        // Should be called regularly, e.g. from loop().
+        void poll();
+
+        // Returns true if there are asynchronous commands queued or running.
+        bool isBusy() const { return _asyncCount > 0; }
                 
         bool setRadioActive(bool on);
         bool setIndicationsActive(bool on);
@@ -77,18 +254,81 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         // Returns the default baud rate of the modem.
         // To be used when initializing the modem stream for the first time.
 
+#ifdef SODAQ_NBIOT_SARA_R4_ONLY
+        uint32_t getDefaultBaudrate() { return getSaraR4Baudrate(); };
+#else
         uint32_t getDefaultBaudrate() { return getSaraN2Baudrate(); };
+#endif
         uint32_t getSaraN2Baudrate() { return 9600; };
         uint32_t getSaraR4Baudrate() { return 115200; };
 
+        // Sets the baud rate connect() switches the modem to (AT+NATSPEED on N2, AT+IPR on R4), after which the
+        // callback of enableBaudrateChange() re-initializes the stream. The baud rate is only changed when both
+        // are set, e.g. 115200 on N2. 0 (the default) disables the change.
+        void setUpgradeBaudrate(uint32_t baudrate) { _upgradeBaudrate = baudrate; }
+
+        // Returns the baud rate the modem stream is currently running at.
+        uint32_t getCurrentBaudrate() const { return _currentBaudrate; }
+
+        // Turns the modem off and returns true if successful.
+        // The stream is switched back to the default baud rate if it was changed by connect().
+        bool off();
+
         
         // Initializes the modem instance. Sets the modem stream and the on-off power pins.
-        void init(Stream& stream, int8_t onoffPin, int8_t txEnablePin = -1, int8_t saraR4XXTogglePin = -1, uint8_t cid = SODAQ_NBIOT_DEFAULT_CID);
+        // With "binaryDataMode" the R4 exchanges socket data as raw bytes instead of hex (AT+UDCONF=1,0),
+        // which halves the UART traffic of the data. The N2 only supports hex.
+        void init(Stream& stream, int8_t onoffPin, int8_t txEnablePin = -1, int8_t saraR4XXTogglePin = -1, uint8_t cid = SODAQ_NBIOT_DEFAULT_CID,
+                  bool binaryDataMode = false);
+
+        // Returns true if the modem is a SARA R4XX (a toggle pin was passed to init()),
+        // or the constant of SODAQ_NBIOT_SARA_N2_ONLY / SODAQ_NBIOT_SARA_R4_ONLY.
+        bool isSaraR4XX() const
+        {
+#if defined(SODAQ_NBIOT_SARA_N2_ONLY)
+            return false;
+#elif defined(SODAQ_NBIOT_SARA_R4_ONLY)
+            return true;
+#else
+            return _isSaraR4XX;
+#endif
+        }
+
+        // Returns true if socket data is exchanged as raw bytes, see init().
+        bool isBinaryDataMode() const { return _isBinaryDataMode; }
         
         bool overrideNconfigParam(const char* param, bool value);
 
+        // The states of the connection started by beginConnect(), see getConnectState().
+        enum ConnectStates {
+            ConnectIdle,      // no connect has been started
+            ConnectBusy,      // poll() is waiting for the network
+            ConnectSucceeded,
+            ConnectFailed
+        };
+
         // Turns on and initializes the modem, then connects to the network and activates the data connection.
+        // Blocks until connected, it calls beginConnect() and then poll() until the connect has finished.
         bool connect(const char* apn, const char* cdp, const char* forceOperator = 0, uint8_t band = 8);
+
+        // Starts a connect() that does not block on the network: the modem is turned on and configured
+        // (blocking, a few seconds of AT round trips), then poll() selects the operator and waits for
+        // the signal quality and the attach, with the commands in the asynchronous queue.
+        // Call poll() until getConnectState() is no longer ConnectBusy, and do not call the other blocking
+        // methods in the meantime. "forceOperator" is copied.
+        // Returns false if the modem could not be turned on or configured.
+        bool beginConnect(const char* apn, const char* cdp, const char* forceOperator = 0, uint8_t band = 8);
+
+        // Returns the state of the last (begin)connect().
+        ConnectStates getConnectState() const { return _connectState; }
+
+        // Enables the warm connect: connect() first reads the band, NCONFIG, APN and CDP from the modem
+        // and only applies the settings that differ. The modem is only rebooted when the band or NCONFIG changed.
+        void setWarmConnect(bool on) { _isWarmConnect = on; }
+
+        // Returns the ConnectPhases (or'ed) that the last connect() skipped because the modem already had
+        // the right settings.
+        uint8_t getSkippedConnectPhases() const { return _skippedConnectPhases; }
         
         // Disconnects the modem from the network.
         bool disconnect();
@@ -96,6 +336,42 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         // Returns true if the modem is connected to the network and has an activated data connection.
         bool isConnected();
         
+        // Returns the network registration status, as last reported by the +CEREG URC.
+        // connect() enables the URC; the status is tracked while responses are read.
+        NetworkRegistrationStatuses getNetworkRegistrationStatus() const { return _networkRegistrationStatus; }
+
+        // Returns true if the modem is registered (home or roaming), as last reported by the +CEREG URC.
+        bool isRegistered() const { return (_networkRegistrationStatus == NetworkRegisteredHome) ||
+                                           (_networkRegistrationStatus == NetworkRegisteredRoaming); }
+
+        // Returns true if the modem has a signalling (RRC) connection, as last reported by the +CSCON URC.
+        bool isSignallingConnected() const { return _isSignallingConnected; }
+
+        // Requests Power Saving Mode with the periodic TAU (T3412) and the active time (T3324) in seconds.
+        // The values are rounded up to the nearest ones the 3GPP timer encoding can represent.
+        // The network decides which values are granted, see getGrantedPsmTimers().
+        // Also enables the URCs needed by getGrantedPsmTimers() and isInPsm().
+        bool setPsm(bool on, uint32_t periodicTau = 0, uint32_t activeTime = 0);
+
+        // Gets the periodic TAU and the active time in seconds, as granted by the network (+CEREG URC).
+        // Returns false if the network has not (yet) granted PSM.
+        bool getGrantedPsmTimers(uint32_t* periodicTau, uint32_t* activeTime) const;
+
+        // Returns true if the modem reported that it entered PSM (+NPSMR on the N2, +UUPSMR on the R4).
+        bool isInPsm() const { return _isInPsm; }
+
+        // Handles the URCs until the modem reports that it entered PSM, or until "timeout".
+        // Returns true if the modem is in PSM.
+        bool waitForPsm(uint32_t timeout);
+
+        // Requests eDRX with the given cycle, the 4 bit value of 3GPP TS 24.008 table 10.5.5.32
+        // (e.g. 5 is 81.92 seconds).
+        bool setEdrx(bool on, uint8_t cycle = 0);
+
+        // Gets the eDRX cycle and paging time window (4 bit values, see above) granted by the network.
+        // Returns false if eDRX is not used.
+        bool getGrantedEdrx(uint8_t* cycle, uint8_t* pagingTimeWindow);
+
         // Gets the Received Signal Strength Indication in dBm and Bit Error Rate.
         // Returns true if successful.
         bool getRSSIAndBER(int8_t* rssi, uint8_t* ber);
@@ -109,15 +385,65 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         int8_t getLastRSSI() const { return _lastRSSI; }
         
         int createSocket(uint16_t localPort = 0);
-        size_t socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const uint8_t* buffer, size_t size);
-        size_t socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const char* str);
+        // Sends the buffer to the remote IP and port, optionally with a Release Assistance Indication,
+        // which is only supported by the N2 (AT+NSOSTF). On the R4 it is ignored.
+        size_t socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const uint8_t* buffer, size_t size,
+                          ReleaseAssistance releaseAssistance = ReleaseAssistanceNone);
+        size_t socketSend(uint8_t socket, const char* remoteIP, const uint16_t remotePort, const char* str,
+                          ReleaseAssistance releaseAssistance = ReleaseAssistanceNone);
+        // Receives from the first socket with pending data.
         size_t socketReceiveHex(char* buffer, size_t length, SaraN2UDPPacketMetadata* p = NULL);
         size_t socketReceiveBytes(uint8_t* buffer, size_t length, SaraN2UDPPacketMetadata* p = NULL);
+        // Receives from the given socket.
+        size_t socketReceiveHex(uint8_t socketID, char* buffer, size_t length, SaraN2UDPPacketMetadata* p = NULL);
+        size_t socketReceiveBytes(uint8_t socketID, uint8_t* buffer, size_t length, SaraN2UDPPacketMetadata* p = NULL);
+        // Returns the pending bytes of the first socket with pending data.
         size_t getPendingUDPBytes();
         bool hasPendingUDPBytes();
+        // Returns the pending bytes and datagrams of the given socket, as reported by the URCs.
+        size_t getPendingUDPBytes(uint8_t socketID);
+        bool hasPendingUDPBytes(uint8_t socketID) { return getPendingUDPBytes(socketID) > 0; }
+        uint8_t getPendingDatagramCount(uint8_t socketID);
+        // Returns true if the remote closed the socket (+UUSOCL, R4 only).
+        bool isSocketClosed(uint8_t socketID);
+        // Returns the local port the socket was created with, see createSocket().
+        uint16_t getSocketLocalPort(uint8_t socketID);
         bool ping(const char* ip);
         bool closeSocket(uint8_t socket);
         bool waitForUDPResponse(uint32_t timeoutMS = SODAQ_NBIOT_DEFAULT_UDP_TIMOUT_MS);
+
+        // Sets the (optional) queue that waitForUDPResponse() and prefetchDatagrams() fill with the pending
+        // datagrams, so they can be dequeued without AT round trips. NULL removes the queue.
+        void setReceiveQueue(Sodaq_ReceiveQueue* queue) { _receiveQueue = queue; }
+
+        // Reads the pending datagrams into the receive queue, until the queue is full.
+        // This blocks for the AT round trips (the data is decoded by the blocking line reader, the
+        // line reader of poll() cannot), so poll() does not call it and the queue is not filled in the
+        // background; call it when hasPendingUDPBytes() returns true and isBusy() returns false.
+        // Returns the number of datagrams added.
+        uint8_t prefetchDatagrams();
+
+        // Sets the (optional) handler that dispatchDatagrams() passes the received datagrams to.
+        // The data is decoded straight into the input buffer (no copies), so a datagram is limited to
+        // the input buffer size minus 64 bytes (see setInputBufferSize()). On the N2, larger datagrams
+        // are passed in parts, with a "remainingLength" in the metadata. On the R4 they cannot be read
+        // in parts, they are dropped (see getDroppedDatagramCount()).
+        void setDatagramHandler(DatagramHandlerPtr handler, void* parameter = NULL)
+        {
+            _datagramHandler = handler;
+            _datagramHandlerParameter = parameter;
+        }
+
+        // Reads the pending datagrams and passes them to the datagram handler.
+        // This blocks for the AT round trips (the data is decoded by the blocking line reader, the
+        // line reader of poll() cannot), so poll() does not call it and the handler is not called in the
+        // background; call it when hasPendingUDPBytes() returns true and isBusy() returns false
+        // (it does nothing while isBusy()).
+        // Returns the number of datagrams (or parts) passed.
+        uint8_t dispatchDatagrams();
+
+        // Returns the number of datagrams dispatchDatagrams() dropped because they did not fit (R4 only).
+        uint16_t getDroppedDatagramCount() const { return _droppedDatagramCount; }
         
         
         bool sendMessage(const uint8_t* buffer, size_t size);
@@ -133,6 +459,9 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
 
         bool getIMEI(char* buffer, size_t size);
     protected:
+        // See SODAQ_NBIOT_BUILD_FAMILY.
+        explicit Sodaq_nbIOT(const uint8_t* buildFamily);
+
         // override
         ResponseTypes readResponse(char* buffer, size_t size, size_t* outSize, uint32_t timeout = SODAQ_AT_DEVICE_DEFAULT_READ_MS)
         {
@@ -166,9 +495,100 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         };
         
         void purgeAllResponsesRead();
+
+        // Handles a single response line for the command that is running.
+        // Returns true (and the response in "result") when the command has completed.
+        bool processResponseLine(char* buffer, size_t count, CallbackMethodPtr& parserMethod,
+                                 void* callbackParameter, void* callbackParameter2,
+                                 ResponseTypes& response, ResponseTypes* result);
     private:
-        //uint16_t _socketPendingBytes[SOCKET_COUNT]; // TODO add getter
-        //bool _socketClosedBit[SOCKET_COUNT];
+        // used by _cgdcontParser() to compare the APN of context "cid"
+        struct ApnMatch {
+            uint8_t cid;
+            const char* apn;
+            bool isMatch;
+        };
+
+        struct AsyncCommand {
+            const char* command;
+            bool isFlashCommand; // the command is in flash (PROGMEM)
+            CommandCompletionPtr completion;
+            void* context;
+            uint32_t timeout;
+            CallbackMethodPtr parserMethod;
+            void* parameter;
+            void* parameter2;
+        };
+
+        // The queue of asynchronous commands, the first one is the one that is running.
+        AsyncCommand _asyncQueue[SODAQ_NBIOT_ASYNC_QUEUE_SIZE];
+        uint8_t _asyncHead;
+        uint8_t _asyncCount;
+        bool _isAsyncCommandSent;
+        uint32_t _asyncCommandStart;
+        ResponseTypes _asyncResponse;
+
+        void completeAsyncCommand(ResponseTypes response);
+        bool queueAsyncCommand(const char* command, bool isFlashCommand, CommandCompletionPtr completion, void* context,
+                               uint32_t timeout, CallbackMethodPtr parserMethod, void* parameter, void* parameter2);
+
+        template<typename T>
+        bool sendCommandTable(const T* commands, uint8_t count, ResponseTypes* results, uint32_t timeout);
+
+        // The steps of the network phase of beginConnect(), advanced by poll().
+        enum ConnectSteps {
+            ConnectStepOperator,      // AT+COPS
+            ConnectStepSignalQuality, // AT+CSQ until the signal is good enough
+            ConnectStepAttach,        // the +CEREG URC or AT+CGATT? until attached
+            ConnectStepAddress        // AT+CGPADDR
+        };
+
+        ConnectStates _connectState;
+        uint8_t _connectStep;
+        uint32_t _connectStepStart;
+        // the step is checked again "delay" ms after "start", or earlier on a network URC
+        uint32_t _connectCheckStart;
+        uint32_t _connectCheckDelay;
+        int _connectCsq;
+        int _connectBer;
+        uint8_t _connectAttachState;
+        char _copsCommand[sizeof("AT+COPS=1,2,\"000000\"")];
+
+        void startConnectStep(uint8_t step);
+        void scheduleConnectCheck();
+        void advanceConnect();
+        uint32_t getPollDelay() const;
+        void onConnectCommandCompleted(ResponseTypes response);
+        static void _connectCompletion(ResponseTypes response, Sodaq_nbIOT* self);
+
+        struct UrcHandler {
+            const char* prefix;
+            uint8_t prefixLength;
+            bool isFlashPrefix; // the prefix is in flash (PROGMEM)
+            uint16_t key; // the two characters after the '+', used for a quick lookup
+            UrcHandlerPtr handler;
+            void* parameter;
+        };
+
+        // The URC handlers, looked up by handleUrc() for every line starting with '+'.
+        UrcHandler _urcHandlers[SODAQ_NBIOT_MAX_URC_HANDLERS];
+        uint8_t _urcHandlerCount;
+
+        struct SocketState {
+            uint16_t pendingBytes;  // +NSONMI adds up, +UUSORF reports the total
+            uint8_t datagramCount;  // the datagrams (partially) left to read
+            uint16_t localPort;
+            bool isOpen;
+            bool isClosed;          // closed by the remote (+UUSOCL)
+        };
+
+        SocketState _sockets[SODAQ_NBIOT_SOCKET_COUNT];
+
+        Sodaq_ReceiveQueue* _receiveQueue;
+
+        DatagramHandlerPtr _datagramHandler;
+        void* _datagramHandlerParameter;
+        uint16_t _droppedDatagramCount;
         
         // This is the value of the most recent CSQ
         // Notice that CSQ is somewhat standard. SIM800/SIM900 and Ublox
@@ -189,31 +609,84 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         int _minRSSI;
 
         bool _isSaraR4XX;
+
+        // cleared when the firmware turns out to reject chained commands
+        bool _isChainingSupported;
+
+        // the network state tracked from the +CEREG, +CSCON and +CGEV URCs
+        NetworkRegistrationStatuses _networkRegistrationStatus;
+        bool _isSignallingConnected;
+        bool _isNetworkEvent; // set by the network URCs, see waitForNetworkEvent() and advanceConnect()
+        bool _isInPsm;
+        bool _isPsmRequested; // by setPsm(), connect() then keeps the PSM URCs enabled
+
+        // the PSM timers granted by the network, encoded as in 3GPP TS 24.008 (0xFF if unknown)
+        uint8_t _grantedActiveTime;
+        uint8_t _grantedPeriodicTau;
+
+        bool _isWarmConnect;
+        uint8_t _skippedConnectPhases;
+
+        // The baud rate connect() switches to, see setUpgradeBaudrate().
+        uint32_t _upgradeBaudrate;
+
+        // The baud rate the modem stream is currently running at.
+        uint32_t _currentBaudrate;
 		
 		uint8_t _cid;
 
-        // flag indicating UDP response via URC
-        int _receivedUDPResponseSocket = 0;
-        size_t _pendingUDPBytes = 0;
+        // Socket data is exchanged as raw bytes instead of hex (R4 only), see init().
+        bool _isBinaryDataMode;
+
+        char _pin[SODAQ_NBIOT_MAX_PIN_LENGTH + 1];
 
-        char* _pin = 0;
+        // Passes the line to the matching URC handler, if there is one.
+        // Returns true if the line was handled.
+        bool handleUrc(const char* buffer, size_t size);
+        bool registerUrcHandler(const char* prefix, bool isFlashPrefix, UrcHandlerPtr handler, void* parameter);
+        static uint16_t urcKey(const char* prefix) { return (static_cast<uint8_t>(prefix[1]) << 8) | static_cast<uint8_t>(prefix[2]); }
 
-        static bool startsWith(const char* pre, const char* str);
+        void onFotaUrc(uint16_t blkRm, uint8_t transferStatus);
+        void onSocketDataUrc(uint8_t socketID, size_t dataLength);
+        void onSocketClosedUrc(uint8_t socketID);
+        void onRegistrationUrc(uint8_t status);
+        void onSignallingConnectionUrc(bool isConnected);
+        void onDetachUrc();
+        void onPsmUrc(bool isInPsm);
+        void onPsmTimersUrc(uint8_t activeTime, uint8_t periodicTau);
+
+        static void _fotaUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self);
+        static void _socketDataUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self);
+        static void _socketClosedUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self);
+        static void _networkUrcHandler(const char* buffer, size_t size, Sodaq_nbIOT* self);
+
+        static bool startsWith(const __FlashStringHelper* pre, const char* str);
         static size_t ipToString(IP_t ip, char* buffer, size_t size);
         static bool isValidIPv4(const char* str);
 
         bool setR4XXToNarrowband();
+        bool applyConnectConfig(const char* apn, const char* cdp);
+        bool isBandSet(uint8_t band);
+        bool isApnSet(const char* apn);
+        bool isCdpSet(const char* cdp);
 
-        bool waitForSignalQuality(uint32_t timeout = 5L * 60L * 1000);
-        bool attachGprs(uint32_t timeout = 10L * 60L * 1000);
-        bool setNconfigParam(const char* param, const char* value);
-        bool checkAndApplyNconfig();
+        bool waitForNetworkEvent(uint32_t timeout);
+        bool waitForPrompt(char prompt, uint32_t timeout);
+        bool setNconfigParam(const __FlashStringHelper* param, const __FlashStringHelper* value);
+        bool checkAndApplyNconfig(bool* isChanged = NULL);
         void reboot();
+        bool upgradeBaudrate();
+        void restoreDefaultBaudrate();
+        void changeStreamBaudrate(uint32_t baudrate);
         bool doSIMcheck();
         bool setSimPin(const char* simPin);
 
         // For sara R4XX, receiving in chunks does NOT work, you have to receive the full packet
-        size_t socketReceive(SaraN2UDPPacketMetadata* packet, char* buffer, size_t size);
+        size_t socketReceive(uint8_t socketID, SaraN2UDPPacketMetadata* packet, uint8_t* buffer, size_t size, bool decodeHex,
+                             size_t lineSize = 0);
+        bool dropOversizedDatagram(uint8_t socketID, uint8_t* buffer, size_t size, size_t lineSize = 0);
+        int getPendingSocket();
+        bool hasUDPResponse();
         static uint32_t convertDatetimeToEpoch(int y, int m, int d, int h, int min, int sec);
 
         static ResponseTypes _cclkParser(ResponseTypes& response, const char* buffer, size_t size, uint32_t* epoch, uint8_t* dummy);
@@ -228,11 +701,29 @@ class Sodaq_nbIOT: public Sodaq_AT_Device
         static ResponseTypes _nqmgrParser(ResponseTypes& response, const char* buffer, size_t size, ReceivedMessageStatus* status, uint8_t* dummy);
         static ResponseTypes _messageReceiveParser(ResponseTypes& response, const char* buffer, size_t size, size_t* length, char* data);
 
+        static ResponseTypes _cedrxrdpParser(ResponseTypes& response, const char* buffer, size_t size, uint8_t* cycle, uint8_t* pagingTimeWindow);
         static ResponseTypes _cgattParser(ResponseTypes& response, const char* buffer, size_t size, uint8_t* result, uint8_t* dummy);
+        static ResponseTypes _nbandParser(ResponseTypes& response, const char* buffer, size_t size, uint8_t* band, bool* isMatch);
+        static ResponseTypes _cgdcontParser(ResponseTypes& response, const char* buffer, size_t size, ApnMatch* match, uint8_t* dummy);
+        static ResponseTypes _ncdpParser(ResponseTypes& response, const char* buffer, size_t size, const char* cdp, bool* isMatch);
         static ResponseTypes _nconfigParser(ResponseTypes& response, const char* buffer, size_t size, bool* nconfigEqualsArray, uint8_t* dummy);
         static ResponseTypes _cpinParser(ResponseTypes& response, const char* buffer, size_t size, SimStatuses* parameter, uint8_t* dummy);
         static ResponseTypes _nakedStringParser(ResponseTypes& response, const char* buffer, size_t size, char* stringBuffer, size_t* stringBufferSize);
 };
 
+// A Sodaq_nbIOT with its input buffer in static storage instead of the heap, sized at compile time.
+// E.g. "Sodaq_nbIOT_Static<250> nbiot;" as a global. Do not call setInputBufferSize().
+template <size_t InputBufferSize>
+class Sodaq_nbIOT_Static : public Sodaq_nbIOT
+{
+    static_assert(InputBufferSize >= SODAQ_NBIOT_MIN_INPUT_BUFFER_SIZE, "The input buffer is too small");
+
+    public:
+        Sodaq_nbIOT_Static() { setInputBuffer(_staticInputBuffer, sizeof(_staticInputBuffer)); }
+
+    private:
+        char _staticInputBuffer[InputBufferSize];
+};
+
 #endif
 
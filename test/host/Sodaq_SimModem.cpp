@@ -0,0 +1,227 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Sodaq_SimModem.h"
+#include <algorithm>
+
+// The longest the clock is advanced by an empty available(), so the waits of the driver
+// end close to their timeouts.
+#define IDLE_ADVANCE_US 1000
+
+static bool isEarlier(const Sodaq_SimModem::Byte& a, const Sodaq_SimModem::Byte& b)
+{
+    return a.arrival < b.arrival;
+}
+
+Sodaq_SimModem::Sodaq_SimModem() :
+    _defaultResponse("\r\nOK\r\n"),
+    _lastArrival(0),
+    _dataRemaining(0),
+    _baudrate(9600),
+    _hostBaudrate(9600),
+    _commandLatency(0),
+    _txByteCount(0),
+    _rxByteCount(0),
+    _writeCallCount(0),
+    _isBufferWrite(false)
+{
+}
+
+void Sodaq_SimModem::on(const std::string& prefix, const std::string& response, bool once)
+{
+    on(prefix, [response](Sodaq_SimModem&, const std::string&) { return response; }, once);
+}
+
+void Sodaq_SimModem::on(const std::string& prefix, Handler handler, bool once)
+{
+    Rule rule = { prefix, handler, once };
+    _rules.push_back(rule);
+}
+
+void Sodaq_SimModem::send(const std::string& text, uint64_t delay)
+{
+    uint64_t arrival = max(sodaq_host_micros() + delay, _lastArrival);
+    uint64_t byteTime = getByteTime(_baudrate);
+
+    for (size_t i = 0; i < text.size(); i++) {
+        arrival += byteTime;
+
+        Byte b = { arrival, _baudrate, text[i] };
+        _rxBytes.push_back(b);
+    }
+
+    _lastArrival = arrival;
+}
+
+void Sodaq_SimModem::expectData(size_t size, Handler handler)
+{
+    _dataRemaining = size;
+    _data.clear();
+    _dataHandler = handler;
+}
+
+size_t Sodaq_SimModem::countCommands(const std::string& prefix) const
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < _commands.size(); i++) {
+        if (_commands[i].compare(0, prefix.size(), prefix) == 0) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool Sodaq_SimModem::hasCommandWith(const std::string& text) const
+{
+    for (size_t i = 0; i < _commands.size(); i++) {
+        if (_commands[i].find(text) != std::string::npos) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Sodaq_SimModem::respond(const std::string& command)
+{
+    _commands.push_back(command);
+
+    for (size_t i = _rules.size(); i-- > 0; ) {
+        if (command.compare(0, _rules[i].prefix.size(), _rules[i].prefix) == 0) {
+            Handler handler = _rules[i].handler;
+
+            if (_rules[i].once) {
+                _rules.erase(_rules.begin() + i);
+            }
+
+            send(handler(*this, command), _commandLatency);
+            return;
+        }
+    }
+
+    send(_defaultResponse, _commandLatency);
+}
+
+size_t Sodaq_SimModem::write(const uint8_t* buffer, size_t size)
+{
+    _writeCallCount++;
+    _isBufferWrite = true;
+
+    for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+    }
+
+    _isBufferWrite = false;
+
+    return size;
+}
+
+size_t Sodaq_SimModem::write(uint8_t c)
+{
+    sodaq_host_advance(getByteTime(_hostBaudrate));
+    _txByteCount++;
+
+    if (!_isBufferWrite) {
+        _writeCallCount++;
+    }
+
+    if (_hostBaudrate != _baudrate) {
+        return 1;
+    }
+
+    if (_dataRemaining > 0) {
+        _data += static_cast<char>(c);
+
+        if (--_dataRemaining == 0) {
+            send(_dataHandler(*this, _data), _commandLatency);
+        }
+
+        return 1;
+    }
+
+    if (c == '\r') {
+        respond(_line);
+        _line.clear();
+    }
+    else if (c != '\n') {
+        _line += static_cast<char>(c);
+    }
+
+    return 1;
+}
+
+// Drops the bytes that have arrived at a baud rate other than the one of the driver side.
+void Sodaq_SimModem::dropLostBytes()
+{
+    while (!_rxBytes.empty() && (_rxBytes.front().arrival <= sodaq_host_micros()) &&
+            (_rxBytes.front().baudrate != _hostBaudrate)) {
+        _rxBytes.pop_front();
+    }
+}
+
+int Sodaq_SimModem::available()
+{
+    dropLostBytes();
+
+    // the arrival times are ascending
+    Byte now = { sodaq_host_micros(), 0, 0 };
+    int count = std::upper_bound(_rxBytes.begin(), _rxBytes.end(), now, isEarlier) - _rxBytes.begin();
+
+    if (count == 0) {
+        // time passes while the driver waits
+        uint64_t advance = IDLE_ADVANCE_US;
+
+        if (!_rxBytes.empty()) {
+            advance = min(advance, _rxBytes.front().arrival - sodaq_host_micros());
+        }
+
+        sodaq_host_advance(advance);
+    }
+
+    return count;
+}
+
+int Sodaq_SimModem::read()
+{
+    dropLostBytes();
+
+    if (_rxBytes.empty() || (_rxBytes.front().arrival > sodaq_host_micros())) {
+        return -1;
+    }
+
+    char c = _rxBytes.front().c;
+    _rxBytes.pop_front();
+    _rxByteCount++;
+
+    return static_cast<uint8_t>(c);
+}
+
+int Sodaq_SimModem::peek()
+{
+    dropLostBytes();
+
+    if (_rxBytes.empty() || (_rxBytes.front().arrival > sodaq_host_micros())) {
+        return -1;
+    }
+
+    return static_cast<uint8_t>(_rxBytes.front().c);
+}
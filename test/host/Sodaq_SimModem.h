@@ -0,0 +1,131 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SODAQ_SIMMODEM_h
+#define _SODAQ_SIMMODEM_h
+
+#include "Arduino.h"
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief A scriptable modem on the other side of the modem stream, for the host tests and benchmarks.
+ *
+ * The commands written by the driver are matched by prefix against the rules ("AT+NSORF=0,"),
+ * the response of the last matching rule is sent back, "\r\nOK\r\n" if none matches.
+ * The timing is simulated on the host clock: every byte takes 10 bits at the baud rate
+ * and each response starts "command latency" microseconds after the command was received.
+ * Bytes sent at a baud rate other than the one of the other side are lost.
+ */
+class Sodaq_SimModem : public Stream
+{
+  public:
+    // Returns the response to "command" (without the line terminator).
+    typedef std::function<std::string(Sodaq_SimModem& modem, const std::string& command)> Handler;
+
+    Sodaq_SimModem();
+
+    // Responds with "response" to the commands starting with "prefix" (the last added rule wins).
+    // With "once" the rule is removed after its first match.
+    void on(const std::string& prefix, const std::string& response, bool once = false);
+    void on(const std::string& prefix, Handler handler, bool once = false);
+
+    // The response to the commands that match no rule.
+    void setDefaultResponse(const std::string& response) { _defaultResponse = response; }
+
+    // Sends "text" (e.g. a URC) "delay" microseconds from now.
+    void send(const std::string& text, uint64_t delay = 0);
+
+    // Takes the next "size" bytes written by the driver as data (e.g. after a '@' prompt) instead
+    // of commands, and responds with the result of "handler", which gets the data as the command.
+    void expectData(size_t size, Handler handler);
+
+    // The baud rate of the modem and of the driver side (see the baud rate change callback).
+    void setBaudrate(uint32_t baudrate) { _baudrate = baudrate; }
+    void setHostBaudrate(uint32_t baudrate) { _hostBaudrate = baudrate; }
+    uint32_t getBaudrate() const { return _baudrate; }
+
+    // The time between receiving a command and the start of its response.
+    void setCommandLatency(uint32_t latency) { _commandLatency = latency; }
+
+    // The commands received so far, without the line terminators.
+    const std::vector<std::string>& getCommands() const { return _commands; }
+    void clearCommands() { _commands.clear(); }
+    size_t countCommands(const std::string& prefix) const;
+    bool hasCommand(const std::string& prefix) const { return countCommands(prefix) > 0; }
+    // Returns true if "text" is part of a command, e.g. of a chained one.
+    bool hasCommandWith(const std::string& text) const;
+
+    // The number of bytes written by the driver and read by it.
+    uint64_t getTxByteCount() const { return _txByteCount; }
+    uint64_t getRxByteCount() const { return _rxByteCount; }
+    // The number of write calls of the driver, a buffer write counts once.
+    uint64_t getWriteCallCount() const { return _writeCallCount; }
+
+    // Stream
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available();
+    int read();
+    int peek();
+
+    struct Byte {
+        uint64_t arrival;
+        uint32_t baudrate;
+        char c;
+    };
+
+  private:
+    struct Rule {
+        std::string prefix;
+        Handler handler;
+        bool once;
+    };
+
+    std::vector<Rule> _rules;
+    std::string _defaultResponse;
+    std::deque<Byte> _rxBytes;
+    uint64_t _lastArrival;
+
+    std::string _line;
+    std::vector<std::string> _commands;
+
+    size_t _dataRemaining;
+    std::string _data;
+    Handler _dataHandler;
+
+    uint32_t _baudrate;
+    uint32_t _hostBaudrate;
+    uint32_t _commandLatency;
+
+    uint64_t _txByteCount;
+    uint64_t _rxByteCount;
+    uint64_t _writeCallCount;
+    bool _isBufferWrite;
+
+    uint64_t getByteTime(uint32_t baudrate) const { return 10000000ULL / baudrate; }
+    void respond(const std::string& command);
+    void dropLostBytes();
+};
+
+#endif
@@ -0,0 +1,453 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+// The benchmarks of the host build, run with: build/bench_nbiot
+// The CPU times are measured on the host, so only compare them with each other. The modem times
+// are simulated (UART bytes at the baud rate plus the command latency) and match a board.
+
+#include "Sodaq_SimModem.h"
+#include "Sodaq_nbIOT.h"
+#include "Sodaq_AT_Tokenizer.h"
+#include "Sodaq_HexCodec.h"
+#include "Sodaq_Lzss.h"
+#include "Sodaq_PayloadCodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER
+#endif
+
+#define SARA_R4_TOGGLE_PIN 5
+
+// The typical time the modem takes to answer a command.
+#define COMMAND_LATENCY_US 5000
+
+static double getCpuNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// Returns the time stamp counter, which counts at about the nominal clock of the CPU.
+static double getCycles()
+{
+#ifdef HAS_CYCLE_COUNTER
+    return static_cast<double>(__rdtsc());
+#else
+    return 0;
+#endif
+}
+
+// Keeps the compiler from dropping the benchmarked code.
+static volatile uint8_t sink;
+
+static void benchHexCodec()
+{
+    static uint8_t data[512];
+    static char hex[2 * sizeof(data)];
+    const int rounds = 20000;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+
+    double start = getCpuNanos();
+    double startCycles = getCycles();
+    for (int i = 0; i < rounds; i++) {
+        sodaq_hex_encode(data, sizeof(data), hex);
+        sink = hex[i % sizeof(hex)];
+    }
+    double encodeCycles = (getCycles() - startCycles) / rounds / sizeof(data);
+    double encode = (getCpuNanos() - start) / rounds / sizeof(data);
+
+    start = getCpuNanos();
+    startCycles = getCycles();
+    for (int i = 0; i < rounds; i++) {
+        sodaq_hex_decode(hex, sizeof(hex), data);
+        sink = data[i % sizeof(data)];
+    }
+    double decodeCycles = (getCycles() - startCycles) / rounds / sizeof(data);
+    double decode = (getCpuNanos() - start) / rounds / sizeof(data);
+
+    printf("hex codec (CPU ns/byte): encode %.2f, decode %.2f\n", encode, decode);
+
+    // 0 without a cycle counter. The cycle counts on a board are reported by the nbIOT_hex_benchmark example.
+    if (encodeCycles > 0) {
+        printf("hex codec (host cycles/byte): encode %.1f, decode %.1f\n", encodeCycles, decodeCycles);
+    }
+}
+
+static void benchLzss()
+{
+    std::string csv;
+    std::string json = "{\"imei\":\"357517080012345\",\"fw\":\"06.57\",\"rssi\":-87,\"csq\":13,\"reg\":1,"
+                       "\"psm\":{\"tau\":3600,\"act\":10},\"uptime\":86400,\"resets\":2,\"errors\":[{\"code\":51,"
+                       "\"cnt\":1},{\"code\":4,\"cnt\":3}],\"bat\":3902,\"temp\":21.4,\"sent\":1203,\"failed\":4}";
+
+    for (int i = 0; csv.size() < 256; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "%d,%.1f,%.1f,%d\n", 1525176000 + i * 60, 21.3 + (i % 5) / 10.0, 40.1, 3900 - i);
+        csv += line;
+    }
+
+    csv.resize(256);
+
+    const std::string* corpora[] = { &csv, &json };
+    const char* names[] = { "CSV log", "JSON status" };
+    const int rounds = 2000;
+
+    for (int c = 0; c < 2; c++) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(corpora[c]->data());
+        size_t size = corpora[c]->size();
+        uint8_t frame[SODAQ_NBIOT_MAX_UDP_BUFFER + 1];
+        uint8_t unpacked[SODAQ_NBIOT_MAX_UDP_BUFFER];
+        size_t frameSize = 0;
+
+        double start = getCpuNanos();
+        for (int i = 0; i < rounds; i++) {
+            frameSize = sodaq_lzss_pack_frame(data, size, frame, sizeof(frame));
+        }
+        double pack = (getCpuNanos() - start) / rounds / 1000;
+
+        start = getCpuNanos();
+        for (int i = 0; i < rounds; i++) {
+            sink = sodaq_lzss_unpack_frame(frame, frameSize, unpacked, sizeof(unpacked));
+        }
+        double unpack = (getCpuNanos() - start) / rounds / 1000;
+
+        printf("lzss %s: %u -> %u bytes (%.0f%%), pack %.1f us, unpack %.1f us (CPU)\n", names[c],
+               static_cast<unsigned>(size), static_cast<unsigned>(frameSize), 100.0 * frameSize / size, pack, unpack);
+    }
+}
+
+// Exposes the line reader of Sodaq_AT_Device.
+class LineReader : public Sodaq_AT_Device
+{
+  public:
+    LineReader(Stream& stream) { setModemStream(stream); }
+
+    uint32_t getDefaultBaudrate() { return 9600; }
+
+    using Sodaq_AT_Device::readLn;
+
+  protected:
+    bool isAlive() { return true; }
+
+    ResponseTypes readResponse(char* buffer, size_t size, size_t* outSize, uint32_t timeout)
+    {
+        return ResponseNotFound;
+    }
+};
+
+static void benchLineReader()
+{
+    Sodaq_SimModem modem;
+    LineReader reader(modem);
+    std::string lines;
+    char buffer[128];
+    const int rounds = 2000;
+
+    for (int i = 0; i < 20; i++) {
+        lines += "\r\n+NSONMI: 0,256\r\n\r\n+CSCON: 1\r\n\r\nOK\r\n";
+    }
+
+    modem.setBaudrate(1000000000);
+    modem.setHostBaudrate(1000000000);
+
+    double start = getCpuNanos();
+    for (int i = 0; i < rounds; i++) {
+        modem.send(lines);
+
+        for (int j = 0; j < 60; j++) {
+            // the empty line before each response is skipped by readLn()
+            reader.readLn(buffer, sizeof(buffer));
+        }
+    }
+    double perByte = (getCpuNanos() - start) / rounds / lines.size();
+
+    // The simulated modem stream is included, it costs about as much as the UART driver of a board.
+    printf("line reader (CPU ns/received byte, including the simulated stream): %.1f\n", perByte);
+}
+
+// The +NSORF parser of the sscanf era, for comparison.
+static bool scanNsorf(const char* line, char* ip, int* port, int* length, char* data)
+{
+    int socket;
+    int remaining;
+
+    return sscanf(line, "%d,\"%[^\"]\",%d,%d,\"%[^\"]\",%d", &socket, ip, port, length, data, &remaining) == 6;
+}
+
+static bool tokenizeNsorf(const char* line, char* ip, uint16_t* port, uint16_t* length, const char** data)
+{
+    Sodaq_AT_Tokenizer tokenizer(line, strlen(line));
+    uint8_t socket;
+    size_t dataLength;
+    uint16_t remaining;
+
+    return tokenizer.readInt(&socket) && tokenizer.skip(',') && tokenizer.readIP(ip, 16) && tokenizer.skip(',')
+           && tokenizer.readInt(port) && tokenizer.skip(',') && tokenizer.readInt(length) && tokenizer.skip(',')
+           && tokenizer.readString(data, &dataLength) && tokenizer.skip(',') && tokenizer.readInt(&remaining);
+}
+
+static void benchTokenizer()
+{
+    std::string line = "0,\"192.168.100.200\",16666,128,\"";
+    const int rounds = 200000;
+    char ip[16];
+    int port;
+    int length;
+    uint16_t shortPort;
+    uint16_t shortLength;
+    const char* data;
+
+    for (int i = 0; i < 128; i++) {
+        line += "A5";
+    }
+
+    line += "\",0";
+
+    static char copy[SODAQ_NBIOT_MAX_UDP_BUFFER * 2 + 1];
+
+    double start = getCpuNanos();
+    for (int i = 0; i < rounds; i++) {
+        sink = scanNsorf(line.c_str(), ip, &port, &length, copy);
+    }
+    double scanned = rounds / ((getCpuNanos() - start) / 1e9);
+
+    start = getCpuNanos();
+    for (int i = 0; i < rounds; i++) {
+        sink = tokenizeNsorf(line.c_str(), ip, &shortPort, &shortLength, &data);
+    }
+    double tokenized = rounds / ((getCpuNanos() - start) / 1e9);
+
+    printf("+NSORF line with 128 bytes of data (lines/s): sscanf %.0f, tokenizer %.0f\n", scanned, tokenized);
+}
+
+static void benchSocketSendWrites()
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    static uint8_t data[SODAQ_NBIOT_MAX_UDP_BUFFER];
+    const int rounds = 200;
+
+    modem.setBaudrate(1000000000);
+    modem.setHostBaudrate(1000000000);
+    nbiot.init(modem, -1);
+    modem.on("AT+NSOST=", "\r\n0,256\r\n\r\nOK\r\n");
+
+    uint64_t writeCalls = modem.getWriteCallCount();
+    uint64_t txBytes = modem.getTxByteCount();
+
+    double start = getCpuNanos();
+    for (int i = 0; i < rounds; i++) {
+        nbiot.socketSend(0, "10.0.0.1", 7, data, sizeof(data));
+    }
+    double perSend = (getCpuNanos() - start) / rounds / 1000;
+
+    printf("N2 socketSend() of 256 bytes: %u stream writes for %u bytes, %.1f us (CPU, with the response)\n",
+           static_cast<unsigned>((modem.getWriteCallCount() - writeCalls) / rounds),
+           static_cast<unsigned>((modem.getTxByteCount() - txBytes) / rounds), perSend);
+}
+
+static void benchPayloadCodec()
+{
+    // The reports of the humidity/temperature example: the text it used to send and the payload now.
+    const Sodaq_PayloadField fields[] = { { 100, true }, { 10, true } };
+    Sodaq_PayloadEncoder encoder(fields, 2);
+    const int reports = 100;
+    size_t textSize = 0;
+    size_t payloadSize = 0;
+
+    for (int i = 0; i < reports; i++) {
+        float values[] = { 21.0f + (rand() % 200) / 100.0f, 45.0f + (rand() % 50) / 10.0f };
+        char text[32];
+        uint8_t payload[16];
+
+        textSize += snprintf(text, sizeof(text), "%.2fC,  %.2f%%", values[0], values[1]);
+        payloadSize += encoder.encode(values, payload, sizeof(payload));
+    }
+
+    printf("humidity/temperature report (bytes): text %.1f, payload codec %.1f\n",
+           static_cast<double>(textSize) / reports, static_cast<double>(payloadSize) / reports);
+}
+
+static void benchRamUsage()
+{
+    // The sizes of this host, pointers and size_t are 4 bytes (not 8) on the boards.
+    printf("driver RAM (host bytes): Sodaq_nbIOT %u + %u input buffer on the heap, Sodaq_nbIOT_Static<250> %u\n",
+           static_cast<unsigned>(sizeof(Sodaq_nbIOT)), 250u, static_cast<unsigned>(sizeof(Sodaq_nbIOT_Static<250>)));
+}
+
+static void ignoreUrc(const char* buffer, size_t size, void* parameter)
+{
+}
+
+static void benchUrcDispatch()
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    std::string urcs;
+    const int rounds = 2000;
+
+    nbiot.init(modem, -1);
+    nbiot.addUrcHandler("+APP1:", ignoreUrc);
+    nbiot.addUrcHandler("+APP2:", ignoreUrc);
+
+    for (int i = 0; i < 10; i++) {
+        urcs += "\r\n+CSCON: 1\r\n\r\n+APP2: 1\r\n\r\n+NOTHANDLED: 1\r\n";
+    }
+
+    modem.setBaudrate(1000000000);
+    modem.setHostBaudrate(1000000000);
+
+    double start = getCpuNanos();
+    for (int i = 0; i < rounds; i++) {
+        modem.send(urcs);
+        nbiot.poll();
+    }
+    double perLine = (getCpuNanos() - start) / rounds / 30;
+
+    printf("URC lines (CPU ns/line, read and dispatched by poll()): %.0f\n", perLine);
+}
+
+// Returns the simulated time in ms of sending and receiving a datagram of "size" bytes.
+static double measureRoundTrip(uint32_t baudrate, bool isSaraR4XX, bool binaryDataMode, size_t size)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    static uint8_t data[SODAQ_NBIOT_MAX_UDP_BUFFER];
+    std::string reply(size, 'x');
+
+    modem.setBaudrate(baudrate);
+    modem.setHostBaudrate(baudrate);
+    modem.setCommandLatency(COMMAND_LATENCY_US);
+    nbiot.setInputBufferSize(SODAQ_NBIOT_MAX_UDP_BUFFER * 2 + 64);
+    nbiot.init(modem, -1, -1, isSaraR4XX ? SARA_R4_TOGGLE_PIN : -1, 1, binaryDataMode);
+
+    char sizeText[8];
+    snprintf(sizeText, sizeof(sizeText), "%u", static_cast<unsigned>(size));
+
+    std::string hex;
+    for (size_t i = 0; i < size; i++) {
+        hex += "78";
+    }
+
+    if (isSaraR4XX) {
+        modem.on("AT+USOCR=", "\r\n+USOCR: 0\r\n\r\nOK\r\n");
+        modem.on("AT+USOST=", [size, sizeText](Sodaq_SimModem& modem, const std::string& command) {
+            std::string response = std::string("\r\n+USOST: 0,") + sizeText + "\r\n\r\nOK\r\n";
+
+            if (command.find(",\"", command.find("\",") + 2) == std::string::npos) {
+                modem.expectData(size, [response](Sodaq_SimModem&, const std::string&) { return response; });
+                return std::string("\r\n@");
+            }
+
+            return response;
+        });
+        modem.on("AT+USORF=", "\r\n+USORF: 0,\"10.0.0.1\",7," + std::string(sizeText) + ",\"" +
+                 (binaryDataMode ? reply : hex) + "\"\r\n\r\nOK\r\n");
+    }
+    else {
+        modem.on("AT+NSOCR=", "\r\n0\r\n\r\nOK\r\n");
+        modem.on("AT+NSOST=", "\r\n0," + std::string(sizeText) + "\r\n\r\nOK\r\n");
+        modem.on("AT+NSORF=", "\r\n0,\"10.0.0.1\",7," + std::string(sizeText) + ",\"" + hex + "\",0\r\n\r\nOK\r\n");
+    }
+
+    nbiot.createSocket(7);
+
+    uint64_t start = sodaq_host_micros();
+
+    nbiot.socketSend(0, "10.0.0.1", 7, data, size);
+    modem.send(isSaraR4XX ? "\r\n+UUSORF: 0," + std::string(sizeText) + "\r\n" :
+               "\r\n+NSONMI: 0," + std::string(sizeText) + "\r\n");
+    nbiot.waitForUDPResponse(1000);
+    nbiot.socketReceiveBytes(0, data, size);
+
+    return (sodaq_host_micros() - start) / 1000.0;
+}
+
+static void benchRoundTrips()
+{
+    const size_t size = 200;
+
+    printf("socket send + receive of %u bytes (simulated ms, %u us command latency):\n",
+           static_cast<unsigned>(size), COMMAND_LATENCY_US);
+    printf("  N2 hex      9600: %7.1f\n", measureRoundTrip(9600, false, false, size));
+    printf("  N2 hex    115200: %7.1f\n", measureRoundTrip(115200, false, false, size));
+    printf("  R4 hex    115200: %7.1f\n", measureRoundTrip(115200, true, false, size));
+    printf("  R4 binary 115200: %7.1f\n", measureRoundTrip(115200, true, true, size));
+}
+
+// Returns the simulated time in ms of a cold N2 connect(), with the given command latency.
+static double measureConnect(uint32_t baudrate, uint32_t latency, bool isWarm)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    modem.setCommandLatency(latency);
+    nbiot.init(modem, -1);
+    nbiot.setWarmConnect(isWarm);
+
+    modem.on("AT+CSQ", "\r\n+CSQ: 20,99\r\n\r\nOK\r\n");
+    modem.on("AT+CGATT?", "\r\n+CGATT: 1\r\n\r\nOK\r\n");
+    modem.on("AT+NBAND?", "\r\n+NBAND:8\r\n\r\nOK\r\n");
+    modem.on("AT+CGDCONT?", "\r\n+CGDCONT:0,\"IP\",\"apn.example\",,0,0,,,,,0\r\n\r\nOK\r\n");
+    modem.on("AT+NCONFIG?", "\r\n+NCONFIG: \"AUTOCONNECT\",\"FALSE\"\r\n"
+             "+NCONFIG: \"CR_0354_0338_SCRAMBLING\",\"TRUE\"\r\n+NCONFIG: \"CR_0859_SI_AVOID\",\"FALSE\"\r\n"
+             "+NCONFIG: \"COMBINE_ATTACH\",\"FALSE\"\r\n+NCONFIG: \"CELL_RESELECTION\",\"FALSE\"\r\n"
+             "+NCONFIG: \"ENABLE_BIP\",\"FALSE\"\r\n\r\nOK\r\n");
+
+    uint64_t start = sodaq_host_micros();
+    nbiot.connect("apn.example", "", "", 8);
+
+    return (sodaq_host_micros() - start) / 1000.0;
+}
+
+static void benchConnect()
+{
+    printf("N2 connect(), modem already registered (simulated ms):\n");
+    printf("  cold, 5 ms latency:  %7.1f\n", measureConnect(9600, 5000, false));
+    printf("  warm, 5 ms latency:  %7.1f\n", measureConnect(9600, 5000, true));
+    printf("  warm, 50 ms latency: %7.1f\n", measureConnect(9600, 50000, true));
+}
+
+int main()
+{
+    benchLineReader();
+    benchTokenizer();
+    benchSocketSendWrites();
+    benchHexCodec();
+    benchLzss();
+    benchUrcDispatch();
+    benchRoundTrips();
+    benchConnect();
+    benchPayloadCodec();
+    benchRamUsage();
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "Arduino.h"
+
+// The driver allocates its input buffer once and never frees it, as on the boards,
+// so the leak check of the address sanitizer (SODAQ_HOST_SANITIZE) is turned off.
+extern "C" const char* __asan_default_options()
+{
+    return "detect_leaks=0";
+}
+
+static uint64_t hostMicros = 0;
+static uint8_t pinStates[256];
+
+uint64_t sodaq_host_micros()
+{
+    return hostMicros;
+}
+
+void sodaq_host_advance(uint64_t us)
+{
+    hostMicros += us;
+}
+
+// Every call takes a microsecond, so loops that only wait on the clock always end.
+uint32_t millis()
+{
+    hostMicros++;
+
+    return static_cast<uint32_t>(hostMicros / 1000);
+}
+
+uint32_t micros()
+{
+    hostMicros++;
+
+    return static_cast<uint32_t>(hostMicros);
+}
+
+void delay(uint32_t ms)
+{
+    hostMicros += 1000ULL * ms;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    hostMicros += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    pinStates[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pinStates[pin];
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+
+    while (size-- > 0) {
+        n += write(*buffer++);
+    }
+
+    return n;
+}
+
+size_t Print::print(long value, int base)
+{
+    if ((value < 0) && (base == DEC)) {
+        return print('-') + print(static_cast<unsigned long>(-value), base);
+    }
+
+    return print(static_cast<unsigned long>(value), base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    char digits[8 * sizeof(value) + 1];
+    char* p = &digits[sizeof(digits) - 1];
+
+    *p = '\0';
+
+    do {
+        unsigned long digit = value % base;
+        *--p = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+        value /= base;
+    } while (value > 0);
+
+    return write(p);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[48];
+
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+
+    return write(buffer);
+}
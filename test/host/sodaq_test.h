@@ -0,0 +1,57 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+// A minimal test framework for the host tests: TEST() registers a test, CHECK() and
+// CHECK_EQUAL() report a failure and go on with the next statement.
+
+#ifndef _SODAQ_TEST_h
+#define _SODAQ_TEST_h
+
+#include <stdio.h>
+
+typedef void (*Sodaq_TestPtr)();
+
+struct Sodaq_TestRegistration
+{
+    Sodaq_TestRegistration(const char* name, Sodaq_TestPtr test);
+};
+
+void sodaq_test_fail(const char* file, int line, const char* expression);
+
+#define TEST(name) \
+    static void name(); \
+    static Sodaq_TestRegistration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            sodaq_test_fail(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        if (!((expected) == (actual))) { \
+            sodaq_test_fail(__FILE__, __LINE__, #expected " == " #actual); \
+        } \
+    } while (0)
+
+#endif
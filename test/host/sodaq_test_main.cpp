@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+
+#define MAX_TESTS 128
+
+struct Test {
+    const char* name;
+    Sodaq_TestPtr test;
+};
+
+static Test tests[MAX_TESTS];
+static size_t testCount = 0;
+static size_t failureCount = 0;
+
+Sodaq_TestRegistration::Sodaq_TestRegistration(const char* name, Sodaq_TestPtr test)
+{
+    if (testCount < MAX_TESTS) {
+        tests[testCount].name = name;
+        tests[testCount].test = test;
+        testCount++;
+    }
+}
+
+void sodaq_test_fail(const char* file, int line, const char* expression)
+{
+    printf("%s:%d: check failed: %s\n", file, line, expression);
+    failureCount++;
+}
+
+int main()
+{
+    size_t failedTestCount = 0;
+
+    for (size_t i = 0; i < testCount; i++) {
+        size_t failures = failureCount;
+
+        tests[i].test();
+
+        bool isFailed = (failureCount != failures);
+        printf("%s %s\n", isFailed ? "FAIL" : "ok  ", tests[i].name);
+
+        if (isFailed) {
+            failedTestCount++;
+        }
+    }
+
+    printf("%u of %u tests failed\n", static_cast<unsigned>(failedTestCount), static_cast<unsigned>(testCount));
+
+    return (failedTestCount == 0) ? 0 : 1;
+}
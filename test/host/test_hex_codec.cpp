@@ -0,0 +1,136 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_HexCodec.h"
+#include <string.h>
+
+TEST(encodesUpperCase)
+{
+    const uint8_t data[] = { 0x00, 0x01, 0x7F, 0x80, 0xAB, 0xFF };
+    char hex[2 * sizeof(data) + 1] = { 0 };
+
+    sodaq_hex_encode(data, sizeof(data), hex);
+
+    CHECK(strcmp(hex, "00017F80ABFF") == 0);
+}
+
+TEST(encodesAllBytesAndOddSizes)
+{
+    uint8_t data[256];
+    char hex[2 * sizeof(data)];
+    char expected[3];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    // the word-at-a-time loop and the tail loop are both covered by the odd sizes
+    for (size_t size = 0; size <= sizeof(data); size += 51) {
+        sodaq_hex_encode(data, size, hex);
+
+        for (size_t i = 0; i < size; i++) {
+            snprintf(expected, sizeof(expected), "%02X", data[i]);
+            CHECK(memcmp(&hex[2 * i], expected, 2) == 0);
+        }
+    }
+}
+
+TEST(decodesUpperAndLowerCase)
+{
+    uint8_t data[4];
+
+    CHECK_EQUAL(4u, sodaq_hex_decode("aBcD0f9E", 8, data));
+    CHECK_EQUAL(0xAB, data[0]);
+    CHECK_EQUAL(0xCD, data[1]);
+    CHECK_EQUAL(0x0F, data[2]);
+    CHECK_EQUAL(0x9E, data[3]);
+}
+
+TEST(decodeIgnoresTrailingNibble)
+{
+    uint8_t data[2] = { 0, 0x55 };
+
+    CHECK_EQUAL(1u, sodaq_hex_decode("123", 3, data));
+    CHECK_EQUAL(0x12, data[0]);
+    CHECK_EQUAL(0x55, data[1]);
+}
+
+TEST(roundTrip)
+{
+    uint8_t data[257];
+    uint8_t decoded[sizeof(data)];
+    char hex[2 * sizeof(data)];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 37 + 11) & 0xFF;
+    }
+
+    for (size_t size = 0; size <= sizeof(data); size++) {
+        sodaq_hex_encode(data, size, hex);
+
+        CHECK_EQUAL(size, sodaq_hex_decode(hex, 2 * size, decoded));
+        CHECK(memcmp(data, decoded, size) == 0);
+    }
+}
+
+TEST(decodesInPlace)
+{
+    char buffer[] = "48656C6C6F2C20776F726C64";
+
+    size_t count = sodaq_hex_decode(buffer, strlen(buffer), reinterpret_cast<uint8_t*>(buffer));
+
+    CHECK_EQUAL(12u, count);
+    CHECK(memcmp(buffer, "Hello, world", count) == 0);
+}
+
+TEST(nibble)
+{
+    CHECK_EQUAL(0, sodaq_hex_nibble('0'));
+    CHECK_EQUAL(9, sodaq_hex_nibble('9'));
+    CHECK_EQUAL(10, sodaq_hex_nibble('A'));
+    CHECK_EQUAL(15, sodaq_hex_nibble('f'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble('G'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble('g'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble('@'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble('`'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble(':'));
+    CHECK_EQUAL(-1, sodaq_hex_nibble('"'));
+}
+
+TEST(span)
+{
+    CHECK_EQUAL(0u, sodaq_hex_span("", 0));
+    CHECK_EQUAL(8u, sodaq_hex_span("aBcD0f9E", 8));
+    CHECK_EQUAL(22u, sodaq_hex_span("0123456789abcdefABCDEF\"", 23));
+    CHECK_EQUAL(4u, sodaq_hex_span("1234", 4));
+
+    // the first character that is not hex, at every position of a word and after it
+    const char others[] = { '/', ':', '@', 'G', '`', 'g', '"', '\r', '\0', static_cast<char>(0xB0) };
+
+    for (size_t i = 0; i < sizeof(others); i++) {
+        for (size_t position = 0; position < 9; position++) {
+            char buffer[] = "0123456789";
+            buffer[position] = others[i];
+
+            CHECK_EQUAL(position, sodaq_hex_span(buffer, 10));
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_Lzss.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SIZE 600
+
+static bool roundTrip(const uint8_t* data, size_t size, size_t* frameSize)
+{
+    uint8_t frame[MAX_SIZE + 1];
+    uint8_t unpacked[MAX_SIZE];
+
+    *frameSize = sodaq_lzss_pack_frame(data, size, frame, size + 1);
+
+    if ((*frameSize == 0) || (*frameSize > size + 1)) {
+        return false;
+    }
+
+    return (sodaq_lzss_unpack_frame(frame, *frameSize, unpacked, sizeof(unpacked)) == size) &&
+           (memcmp(unpacked, data, size) == 0);
+}
+
+TEST(compressesRepetitiveData)
+{
+    const char* text = "temp=21.5;temp=21.5;temp=21.6;temp=21.5;temp=21.5;temp=21.7;";
+    size_t size = strlen(text);
+    uint8_t compressed[MAX_SIZE];
+    uint8_t decompressed[MAX_SIZE];
+
+    size_t compressedSize = sodaq_lzss_compress(reinterpret_cast<const uint8_t*>(text), size,
+                                                compressed, sizeof(compressed));
+
+    CHECK(compressedSize > 0);
+    CHECK(compressedSize < size / 2);
+    CHECK_EQUAL(size, sodaq_lzss_decompress(compressed, compressedSize, decompressed, sizeof(decompressed)));
+    CHECK(memcmp(decompressed, text, size) == 0);
+}
+
+TEST(packsIncompressibleDataRaw)
+{
+    uint8_t data[64];
+    uint8_t frame[sizeof(data) + 1];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 151 + 7) & 0xFF;
+    }
+
+    CHECK_EQUAL(sizeof(data) + 1, sodaq_lzss_pack_frame(data, sizeof(data), frame, sizeof(frame)));
+    CHECK_EQUAL(SODAQ_LZSS_FRAME_RAW, frame[0]);
+    CHECK(memcmp(&frame[1], data, sizeof(data)) == 0);
+}
+
+TEST(packsCompressibleDataCompressed)
+{
+    uint8_t data[128];
+    uint8_t frame[sizeof(data) + 1];
+
+    memset(data, 'x', sizeof(data));
+
+    size_t frameSize = sodaq_lzss_pack_frame(data, sizeof(data), frame, sizeof(frame));
+    CHECK(frameSize > 0);
+    CHECK(frameSize < sizeof(data) / 4);
+    CHECK_EQUAL(SODAQ_LZSS_FRAME_COMPRESSED, frame[0]);
+}
+
+TEST(roundTripsRandomData)
+{
+    uint8_t data[MAX_SIZE];
+    size_t frameSize;
+
+    srand(3);
+
+    for (int i = 0; i < 2000; i++) {
+        size_t size = rand() % MAX_SIZE;
+        int alphabet = 1 + rand() % 256;
+
+        for (size_t j = 0; j < size; j++) {
+            bool isRepeat = (j > 10) && (rand() % 4 == 0);
+            data[j] = isRepeat ? data[j - 1 - rand() % 10] : rand() % alphabet;
+        }
+
+        CHECK(roundTrip(data, size, &frameSize));
+    }
+}
+
+TEST(roundTripsEmptyAndTinyInputs)
+{
+    const uint8_t data[] = { 1, 2, 3 };
+    size_t frameSize;
+
+    for (size_t size = 0; size <= sizeof(data); size++) {
+        CHECK(roundTrip(data, size, &frameSize));
+    }
+}
+
+TEST(failsIfTheOutputDoesNotFit)
+{
+    uint8_t data[100];
+    uint8_t compressed[8];
+    uint8_t frame[sizeof(data)];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 151 + 7) & 0xFF;
+    }
+
+    CHECK_EQUAL(0u, sodaq_lzss_compress(data, sizeof(data), compressed, sizeof(compressed)));
+    CHECK_EQUAL(0u, sodaq_lzss_pack_frame(data, sizeof(data), frame, sizeof(frame)));
+
+    memset(data, 'x', sizeof(data));
+    size_t frameSize = sodaq_lzss_pack_frame(data, sizeof(data), frame, sizeof(frame));
+    CHECK(frameSize > 0);
+    CHECK_EQUAL(0u, sodaq_lzss_unpack_frame(frame, frameSize, data, sizeof(data) - 1));
+}
+
+TEST(rejectsMalformedFrames)
+{
+    uint8_t out[300];
+
+    const uint8_t unknownType[] = { 0x02, 'a' };
+    CHECK_EQUAL(0u, sodaq_lzss_unpack_frame(unknownType, sizeof(unknownType), out, sizeof(out)));
+    CHECK_EQUAL(0u, sodaq_lzss_unpack_frame(unknownType, 0, out, sizeof(out)));
+
+    // a match before the start of the data
+    const uint8_t badOffset[] = { SODAQ_LZSS_FRAME_COMPRESSED, 0x01, 0x05, 0x00 };
+    CHECK_EQUAL(0u, sodaq_lzss_unpack_frame(badOffset, sizeof(badOffset), out, sizeof(out)));
+
+    // a truncated match
+    const uint8_t truncated[] = { SODAQ_LZSS_FRAME_COMPRESSED, 0x02, 'a', 0x00 };
+    CHECK_EQUAL(0u, sodaq_lzss_unpack_frame(truncated, sizeof(truncated), out, sizeof(out)));
+}
+
+TEST(survivesGarbage)
+{
+    uint8_t garbage[64];
+    uint8_t out[300];
+
+    srand(5);
+
+    for (int i = 0; i < 5000; i++) {
+        for (size_t j = 0; j < sizeof(garbage); j++) {
+            garbage[j] = rand();
+        }
+
+        CHECK(sodaq_lzss_unpack_frame(garbage, rand() % sizeof(garbage), out, sizeof(out)) <= sizeof(out));
+    }
+}
@@ -0,0 +1,1028 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_SimModem.h"
+#include "Sodaq_nbIOT.h"
+#include "Sodaq_ReceiveQueue.h"
+#include <string.h>
+#include <string>
+
+#define SARA_R4_TOGGLE_PIN 5
+
+static const char* nconfigResponse =
+    "\r\n+NCONFIG: \"AUTOCONNECT\",\"FALSE\"\r\n"
+    "+NCONFIG: \"CR_0354_0338_SCRAMBLING\",\"TRUE\"\r\n"
+    "+NCONFIG: \"CR_0859_SI_AVOID\",\"FALSE\"\r\n"
+    "+NCONFIG: \"COMBINE_ATTACH\",\"FALSE\"\r\n"
+    "+NCONFIG: \"CELL_RESELECTION\",\"FALSE\"\r\n"
+    "+NCONFIG: \"ENABLE_BIP\",\"FALSE\"\r\n"
+    "\r\nOK\r\n";
+
+static std::string toHex(const std::string& data)
+{
+    std::string hex;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02X", static_cast<uint8_t>(data[i]));
+        hex += digits;
+    }
+
+    return hex;
+}
+
+// Scripts a N2 that is registered and has a good signal.
+static void addNetworkRules(Sodaq_SimModem& modem)
+{
+    modem.on("AT+CSQ", "\r\n+CSQ: 20,99\r\n\r\nOK\r\n");
+    modem.on("AT+CGATT?", "\r\n+CGATT: 1\r\n\r\nOK\r\n");
+    modem.on("AT+CGPADDR", "\r\n+CGPADDR: 0,10.1.1.1\r\n\r\nOK\r\n");
+}
+
+static int urcCount = 0;
+
+static void countUrc(const char* buffer, size_t size, void* parameter)
+{
+    urcCount++;
+    CHECK(strncmp(buffer, "+CUSTOM: 1", size) == 0);
+    CHECK(parameter == &urcCount);
+}
+
+TEST(handlesUrcsWhileReadingResponses)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    urcCount = 0;
+
+    CHECK(nbiot.addUrcHandler("+CUSTOM:", countUrc, &urcCount));
+    CHECK(!nbiot.addUrcHandler("CUSTOM:", countUrc));
+
+    modem.on("AT", "\r\n+CUSTOM: 1\r\n+CEREG: 5\r\n+CSCON: 1\r\n\r\nOK\r\n");
+
+    CHECK(nbiot.isAlive());
+    CHECK_EQUAL(1, urcCount);
+    CHECK_EQUAL(Sodaq_nbIOT::NetworkRegisteredRoaming, nbiot.getNetworkRegistrationStatus());
+    CHECK(nbiot.isRegistered());
+    CHECK(nbiot.isSignallingConnected());
+}
+
+TEST(acceptsTheConfiguredNumberOfAppUrcHandlers)
+{
+    Sodaq_nbIOT nbiot;
+
+    for (uint8_t i = 0; i < SODAQ_NBIOT_MAX_APP_URC_HANDLERS; i++) {
+        CHECK(nbiot.addUrcHandler("+CUSTOM:", countUrc));
+    }
+
+    CHECK(!nbiot.addUrcHandler("+CUSTOM:", countUrc));
+}
+
+static int csqUrcCount = 0;
+
+static void countCsqUrc(const char* buffer, size_t size, void* parameter)
+{
+    csqUrcCount++;
+}
+
+TEST(passesTheCommandResponseToItsParser)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    csqUrcCount = 0;
+
+    CHECK(nbiot.addUrcHandler("+CSQ:", countCsqUrc));
+    modem.on("AT+CSQ", "\r\n+CSQ: 20,99\r\n\r\nOK\r\n");
+
+    int8_t rssi = 0;
+    uint8_t ber = 0;
+
+    CHECK(nbiot.getRSSIAndBER(&rssi, &ber));
+    CHECK_EQUAL(-73, rssi);
+    CHECK_EQUAL(0, csqUrcCount);
+
+    // without a parser of the running command, the line is a URC
+    modem.on("AT", "\r\n+CSQ: 20,99\r\n\r\nOK\r\n");
+
+    CHECK(nbiot.isAlive());
+    CHECK_EQUAL(1, csqUrcCount);
+}
+
+TEST(readsTheSimStatus)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+
+    modem.on("AT+CPIN?", "\r\n+CPIN: READY\r\n\r\nOK\r\n");
+    CHECK_EQUAL(Sodaq_nbIOT::SimReady, nbiot.getSimStatus());
+
+    // a prefix of "READY" is not ready
+    modem.on("AT+CPIN?", "\r\n+CPIN: READ\r\n\r\nOK\r\n");
+    CHECK_EQUAL(Sodaq_nbIOT::SimNeedsPin, nbiot.getSimStatus());
+
+    modem.on("AT+CPIN?", "\r\n+CPIN: SIM PIN\r\n\r\nOK\r\n");
+    CHECK_EQUAL(Sodaq_nbIOT::SimNeedsPin, nbiot.getSimStatus());
+}
+
+TEST(isAliveTimesOut)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    modem.setDefaultResponse("");
+
+    uint32_t start = millis();
+    CHECK(!nbiot.isAlive());
+    CHECK(millis() - start >= 450);
+}
+
+TEST(tracksPendingDataPerSocket)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[16];
+
+    nbiot.init(modem, -1);
+    modem.on("AT+NSOCR=\"DGRAM\",17,1000", "\r\n0\r\n\r\nOK\r\n");
+    modem.on("AT+NSOCR=\"DGRAM\",17,2000", "\r\n1\r\n\r\nOK\r\n");
+    modem.on("AT+NSORF=1,3", "\r\n1,\"10.0.0.1\",9,3,\"414243\",0\r\n\r\nOK\r\n");
+    modem.on("AT+NSORF=0,2", "\r\n0,\"10.0.0.1\",7,2,\"6869\",0\r\n\r\nOK\r\n");
+    modem.on("AT+NSORF=0,4", "\r\n0,\"10.0.0.1\",7,4,\"74657374\",0\r\n\r\nOK\r\n");
+
+    CHECK_EQUAL(0, nbiot.createSocket(1000));
+    CHECK_EQUAL(1, nbiot.createSocket(2000));
+    CHECK_EQUAL(2000, nbiot.getSocketLocalPort(1));
+
+    modem.send("\r\n+NSONMI: 0,2\r\n\r\n+NSONMI: 1,3\r\n\r\n+NSONMI: 0,4\r\n");
+    CHECK(nbiot.isAlive());
+
+    CHECK_EQUAL(6u, nbiot.getPendingUDPBytes(0));
+    CHECK_EQUAL(2, nbiot.getPendingDatagramCount(0));
+    CHECK_EQUAL(3u, nbiot.getPendingUDPBytes(1));
+
+    CHECK_EQUAL(3u, nbiot.socketReceiveBytes(1, buffer, sizeof(buffer)));
+    CHECK(memcmp(buffer, "ABC", 3) == 0);
+    CHECK(!nbiot.hasPendingUDPBytes(1));
+
+    CHECK_EQUAL(2u, nbiot.socketReceiveBytes(buffer, 2));
+    CHECK(memcmp(buffer, "hi", 2) == 0);
+    CHECK_EQUAL(4u, nbiot.getPendingUDPBytes(0));
+    CHECK_EQUAL(1, nbiot.getPendingDatagramCount(0));
+
+    CHECK_EQUAL(4u, nbiot.socketReceiveBytes(buffer, sizeof(buffer)));
+    CHECK(memcmp(buffer, "test", 4) == 0);
+    CHECK(!nbiot.hasPendingUDPBytes());
+    CHECK_EQUAL(0u, nbiot.socketReceiveBytes(buffer, sizeof(buffer)));
+}
+
+TEST(clearsPendingDataWhenTheReadIsEmpty)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[16];
+
+    nbiot.init(modem, -1);
+
+    // the data was already read, or was dropped by the modem
+    modem.send("\r\n+NSONMI: 0,4\r\n");
+    CHECK(nbiot.isAlive());
+    CHECK_EQUAL(4u, nbiot.getPendingUDPBytes(0));
+
+    CHECK_EQUAL(0u, nbiot.socketReceiveBytes(0, buffer, sizeof(buffer)));
+    CHECK(!nbiot.hasPendingUDPBytes(0));
+    CHECK_EQUAL(0, nbiot.getPendingDatagramCount(0));
+}
+
+TEST(connectResetsTheSockets)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    addNetworkRules(modem);
+    modem.on("AT+NSOCR=", "\r\n0\r\n\r\nOK\r\n");
+
+    CHECK_EQUAL(0, nbiot.createSocket(1000));
+    modem.send("\r\n+NSONMI: 0,4\r\n");
+    CHECK(nbiot.isAlive());
+    CHECK(nbiot.hasPendingUDPBytes(0));
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(!nbiot.hasPendingUDPBytes(0));
+    CHECK_EQUAL(0, nbiot.getSocketLocalPort(0));
+}
+
+TEST(receivesDatagramsLargerThanTheInputBuffer)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    static uint8_t buffer[SODAQ_NBIOT_MAX_UDP_BUFFER];
+    std::string data;
+    SaraN2UDPPacketMetadata metadata;
+
+    nbiot.init(modem, -1);
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        data += static_cast<char>(i);
+    }
+
+    modem.on("AT+NSORF=0,256", "\r\n0,\"10.0.0.1\",5683,256,\"" + toHex(data) + "\",0\r\n\r\nOK\r\n");
+    modem.send("\r\n+NSONMI: 0,256\r\n");
+    nbiot.isAlive();
+
+    CHECK_EQUAL(sizeof(buffer), nbiot.socketReceiveBytes(buffer, sizeof(buffer), &metadata));
+    CHECK(memcmp(buffer, data.data(), sizeof(buffer)) == 0);
+    CHECK(strcmp(metadata.ip, "10.0.0.1") == 0);
+    CHECK_EQUAL(5683, metadata.port);
+    CHECK_EQUAL(0, metadata.remainingLength);
+}
+
+TEST(receivesHexInParts)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    char hex[5];
+    SaraN2UDPPacketMetadata metadata;
+
+    nbiot.init(modem, -1);
+    modem.on("AT+NSORF=0,2", "\r\n0,\"10.0.0.1\",7,2,\"ABCD\",2\r\n\r\nOK\r\n");
+    modem.send("\r\n+NSONMI: 0,4\r\n");
+    nbiot.isAlive();
+
+    CHECK_EQUAL(2u, nbiot.socketReceiveHex(hex, sizeof(hex), &metadata));
+    CHECK(strcmp(hex, "ABCD") == 0);
+    CHECK_EQUAL(2, metadata.remainingLength);
+    CHECK_EQUAL(2u, nbiot.getPendingUDPBytes(0));
+    CHECK_EQUAL(1, nbiot.getPendingDatagramCount(0));
+}
+
+TEST(sendsWithReleaseAssistance)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    modem.on("AT+NSOST", "\r\n0,2\r\n\r\nOK\r\n");
+
+    CHECK_EQUAL(2u, nbiot.socketSend(0, "10.0.0.1", 7, "hi", Sodaq_nbIOT::ReleaseAfterUplink));
+    CHECK_EQUAL(2u, nbiot.socketSend(0, "10.0.0.1", 7, "hi", Sodaq_nbIOT::ReleaseAfterReply));
+    CHECK_EQUAL(2u, nbiot.socketSend(0, "10.0.0.1", 7, "hi"));
+
+    CHECK(modem.hasCommand("AT+NSOSTF=0,\"10.0.0.1\",7,0x200,2,\"6869\""));
+    CHECK(modem.hasCommand("AT+NSOSTF=0,\"10.0.0.1\",7,0x400,2,\"6869\""));
+    CHECK(modem.hasCommand("AT+NSOST=0,\"10.0.0.1\",7,2,\"6869\""));
+}
+
+TEST(chainsCommandsAndFallsBack)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    const char* commands[] = { "+CMEE=1", "+CFUN=0", "+NSMI=0" };
+    ResponseTypes results[3];
+
+    nbiot.init(modem, -1);
+
+    CHECK(nbiot.sendCommands(commands, 3, results));
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK(modem.getCommands()[0] == "AT+CMEE=1;+CFUN=0;+NSMI=0");
+
+    // a firmware without chaining: the chain fails, the single commands succeed
+    modem.clearCommands();
+    modem.on("AT+CMEE=1;", "\r\nERROR\r\n");
+
+    CHECK(nbiot.sendCommands(commands, 3, results));
+    CHECK_EQUAL(ResponseOK, results[1]);
+    CHECK_EQUAL(4u, modem.getCommands().size());
+
+    // from then on the commands are sent one by one
+    modem.clearCommands();
+    CHECK(nbiot.sendCommands(commands, 3, results));
+    CHECK_EQUAL(3u, modem.getCommands().size());
+
+    // a command that fails on its own
+    modem.clearCommands();
+    modem.on("AT+CFUN=0", "\r\n+CME ERROR: 4\r\n");
+    CHECK(!nbiot.sendCommands(commands, 3, results));
+    CHECK_EQUAL(ResponseOK, results[0]);
+    CHECK_EQUAL(ResponseError, results[1]);
+}
+
+struct Completion {
+    int count;
+    ResponseTypes responses[4];
+};
+
+static void onCompletion(ResponseTypes response, void* context)
+{
+    Completion* completion = static_cast<Completion*>(context);
+
+    completion->responses[completion->count++] = response;
+}
+
+static ResponseTypes cgattParser(ResponseTypes& response, const char* buffer, size_t size, int* value, void* dummy)
+{
+    if (sscanf(buffer, "+CGATT: %d", value) == 1) {
+        return ResponseEmpty;
+    }
+
+    return ResponseError;
+}
+
+TEST(asyncCommandsCompleteInOrder)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    Completion completion = { 0 };
+    int attached = -1;
+
+    nbiot.init(modem, -1);
+    modem.setCommandLatency(20000);
+    modem.on("AT+CGATT?", "\r\n+CGATT: 1\r\n\r\nOK\r\n");
+    modem.on("AT+SLOW", "");
+
+    CHECK(nbiot.sendCommandAsync("AT+CGATT?", cgattParser, &attached, static_cast<void*>(NULL),
+                                 onCompletion, &completion));
+    CHECK(nbiot.sendCommandAsync("AT+SLOW", onCompletion, &completion, 100));
+    CHECK(nbiot.sendCommandAsync("AT", onCompletion, &completion));
+    CHECK(nbiot.isBusy());
+
+    // nothing is sent until poll() is called, and poll() does not wait for the response
+    CHECK(modem.getCommands().empty());
+    nbiot.poll();
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK_EQUAL(0, completion.count);
+
+    for (int i = 0; (i < 10000) && nbiot.isBusy(); i++) {
+        nbiot.poll();
+    }
+
+    CHECK(!nbiot.isBusy());
+    CHECK_EQUAL(3, completion.count);
+    CHECK_EQUAL(ResponseOK, completion.responses[0]);
+    CHECK_EQUAL(ResponseTimeout, completion.responses[1]);
+    CHECK_EQUAL(ResponseOK, completion.responses[2]);
+    CHECK_EQUAL(1, attached);
+}
+
+TEST(sendsCommandsFromFlash)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    Completion completion = { 0 };
+    int attached = -1;
+    const __FlashStringHelper* commands[] = { F("+CMEE=1"), F("+CFUN=0") };
+    char apnCommand[] = "+CGDCONT=1,\"IP\",\"apn\"";
+    Sodaq_nbIOT::ChainedCommand mixedCommands[] = { { PSTR("+NSMI=0"), true }, { apnCommand, false } };
+
+    nbiot.init(modem, -1);
+    modem.on("AT+CGATT?", "\r\n+CGATT: 1\r\n\r\nOK\r\n");
+
+    CHECK(nbiot.sendCommands(commands, 2));
+    CHECK(nbiot.sendCommands(mixedCommands, 2));
+    CHECK(nbiot.sendCommandAsync(F("AT+CGATT?"), cgattParser, &attached, static_cast<void*>(NULL),
+                                 onCompletion, &completion));
+
+    while (nbiot.isBusy()) {
+        nbiot.poll();
+    }
+
+    CHECK_EQUAL(3u, modem.getCommands().size());
+    CHECK(modem.getCommands()[0] == "AT+CMEE=1;+CFUN=0");
+    CHECK(modem.getCommands()[1] == "AT+NSMI=0;+CGDCONT=1,\"IP\",\"apn\"");
+    CHECK(modem.getCommands()[2] == "AT+CGATT?");
+    CHECK_EQUAL(1, completion.count);
+    CHECK_EQUAL(1, attached);
+
+    // the one by one fallback
+    modem.clearCommands();
+    modem.on("AT+NSMI=0;", "\r\nERROR\r\n");
+
+    CHECK(nbiot.sendCommands(mixedCommands, 2));
+    CHECK_EQUAL(3u, modem.getCommands().size());
+    CHECK(modem.getCommands()[1] == "AT+NSMI=0");
+    CHECK(modem.getCommands()[2] == "AT+CGDCONT=1,\"IP\",\"apn\"");
+}
+
+TEST(asyncQueueIsBounded)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+
+    for (int i = 0; i < SODAQ_NBIOT_ASYNC_QUEUE_SIZE; i++) {
+        CHECK(nbiot.sendCommandAsync("AT"));
+    }
+
+    CHECK(!nbiot.sendCommandAsync("AT"));
+}
+
+TEST(connectsN2)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    addNetworkRules(modem);
+
+    CHECK(nbiot.connect("apn.example", "10.0.0.2", "20416", 8));
+    CHECK(modem.hasCommand("AT+NBAND=8"));
+    CHECK(modem.hasCommand("AT+NRB"));
+    CHECK(modem.hasCommandWith("+CGDCONT=0,\"IP\",\"apn.example\""));
+    CHECK(modem.hasCommand("AT+CFUN=1"));
+    CHECK(modem.hasCommand("AT+COPS=1,2,\"20416\""));
+    CHECK_EQUAL(0, nbiot.getSkippedConnectPhases());
+}
+
+static int idleCount = 0;
+
+static void countIdle()
+{
+    idleCount++;
+}
+
+TEST(connectWaitsInTheIdleCallback)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    int csqIdleCounts[2] = { -1, -1 };
+    int csqCount = 0;
+
+    nbiot.init(modem, -1);
+    nbiot.setIdleCallback(countIdle);
+    addNetworkRules(modem);
+    idleCount = 0;
+
+    // no signal on the first check
+    modem.on("AT+CSQ", [&](Sodaq_SimModem& m, const std::string& command) -> std::string {
+        if (csqCount < 2) {
+            csqIdleCounts[csqCount] = idleCount;
+        }
+
+        return (csqCount++ == 0) ? "\r\n+CSQ: 99,99\r\n\r\nOK\r\n" : "\r\n+CSQ: 20,99\r\n\r\nOK\r\n";
+    });
+
+    CHECK(nbiot.connect("apn.example", "10.0.0.2", "", 8));
+    CHECK_EQUAL(2, csqCount);
+
+    // the wait for the next check is spent in the idle callback, not in a busy loop
+    CHECK(csqIdleCounts[1] > csqIdleCounts[0]);
+}
+
+TEST(connectIgnoresRejectedUrcEnables)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    // a firmware without +CGEREP, also when it is chained
+    modem.on("AT", [](Sodaq_SimModem&, const std::string& command) {
+        return std::string((command.find("+CGEREP") != std::string::npos) ? "\r\nERROR\r\n" : "\r\nOK\r\n");
+    });
+    addNetworkRules(modem);
+
+    CHECK(nbiot.connect("apn.example", "10.0.0.2", "", 8));
+    CHECK(modem.hasCommand("AT+CMEE=1;"));
+    // the required commands are not repeated one by one
+    CHECK(!modem.hasCommand("AT+NSMI=0"));
+    CHECK(modem.hasCommand("AT+CSCON=1"));
+}
+
+TEST(warmConnectSkipsWhatIsSet)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    nbiot.setWarmConnect(true);
+    addNetworkRules(modem);
+    modem.on("AT+NCONFIG?", nconfigResponse);
+    modem.on("AT+NBAND?", "\r\n+NBAND:8\r\n\r\nOK\r\n");
+    modem.on("AT+CGDCONT?", "\r\n+CGDCONT:0,\"IP\",\"apn.example\",,0,0,,,,,0\r\n\r\nOK\r\n");
+    modem.on("AT+NCDP?", "\r\n+NCDP:10.0.0.2,5683\r\n\r\nOK\r\n");
+
+    CHECK(nbiot.connect("apn.example", "10.0.0.2", "", 8));
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectPhaseBand | Sodaq_nbIOT::ConnectPhaseNconfig | Sodaq_nbIOT::ConnectPhaseReboot |
+                Sodaq_nbIOT::ConnectPhaseApn | Sodaq_nbIOT::ConnectPhaseCdp, nbiot.getSkippedConnectPhases());
+    CHECK(!modem.hasCommand("AT+NRB"));
+    CHECK(!modem.hasCommandWith("+NBAND="));
+    CHECK(!modem.hasCommandWith("+CGDCONT="));
+
+    modem.clearCommands();
+    CHECK(nbiot.connect("other.apn", "10.0.0.2", "", 20));
+    CHECK(modem.hasCommand("AT+NBAND=20"));
+    CHECK(modem.hasCommand("AT+NRB"));
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectPhaseNconfig | Sodaq_nbIOT::ConnectPhaseCdp, nbiot.getSkippedConnectPhases());
+}
+
+TEST(connectEndsTheWaitOnTheRegistrationUrc)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    nbiot.setWarmConnect(true);
+    addNetworkRules(modem);
+    modem.on("AT+NCONFIG?", nconfigResponse);
+    modem.on("AT+NBAND?", "\r\n+NBAND:8\r\n\r\nOK\r\n");
+    modem.on("AT+CGATT?", "\r\n+CGATT: 0\r\n\r\nOK\r\n");
+    modem.on("AT+CFUN=1", [](Sodaq_SimModem& modem, const std::string&) {
+        modem.send("\r\n+CSCON: 1\r\n\r\n+CEREG: 1\r\n", 3000000);
+        return std::string("\r\nOK\r\n");
+    });
+
+    uint32_t start = millis();
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(millis() - start < 5000);
+    CHECK(nbiot.isRegistered());
+    CHECK(nbiot.isSignallingConnected());
+}
+
+TEST(beginConnectDoesNotWaitForTheNetwork)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    addNetworkRules(modem);
+    // registers after the fourth check
+    modem.on("AT+CGATT?", [](Sodaq_SimModem& modem, const std::string&) {
+        std::string response = "\r\n+CGATT: 0\r\n\r\nOK\r\n";
+
+        if (modem.countCommands("AT+CGATT?") == 4) {
+            modem.send(response);
+            modem.send("\r\n+CEREG: 1\r\n", 1000000);
+            return std::string();
+        }
+
+        return response;
+    });
+
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectIdle, nbiot.getConnectState());
+    CHECK(nbiot.beginConnect("apn.example", "", "20416", 8));
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectBusy, nbiot.getConnectState());
+    CHECK(!modem.hasCommand("AT+COPS="));
+
+    // every poll() returns right away, while the modem is not registered yet
+    uint32_t start = millis();
+    uint32_t longestPoll = 0;
+
+    while ((nbiot.getConnectState() == Sodaq_nbIOT::ConnectBusy) && (millis() - start < 60000)) {
+        uint32_t pollStart = millis();
+        nbiot.poll();
+        longestPoll = max(longestPoll, millis() - pollStart);
+    }
+
+    // the checks are 0.5, 1.5 and 2.5 s apart, the URC ends the fourth wait early
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectSucceeded, nbiot.getConnectState());
+    CHECK(millis() - start >= 5500);
+    CHECK(millis() - start < 7000);
+    CHECK(longestPoll < 100);
+    CHECK(nbiot.isRegistered());
+    CHECK(modem.hasCommand("AT+COPS=1,2,\"20416\""));
+    CHECK_EQUAL(4u, modem.countCommands("AT+CGATT?"));
+    CHECK(modem.hasCommand("AT+CGPADDR"));
+}
+
+TEST(beginConnectFailsWhenTheOperatorIsRejected)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    addNetworkRules(modem);
+    modem.on("AT+COPS=", "\r\n+CME ERROR: 3\r\n");
+
+    CHECK(nbiot.beginConnect("apn.example", "", "20416", 8));
+
+    while (nbiot.getConnectState() == Sodaq_nbIOT::ConnectBusy) {
+        nbiot.poll();
+    }
+
+    CHECK_EQUAL(Sodaq_nbIOT::ConnectFailed, nbiot.getConnectState());
+    CHECK(!modem.hasCommand("AT+CSQ"));
+    CHECK(!nbiot.connect("apn.example", "", "20416", 8));
+}
+
+TEST(tracksTheGrantedPsmTimers)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint32_t periodicTau = 0;
+    uint32_t activeTime = 0;
+    uint8_t cycle;
+    uint8_t pagingTimeWindow;
+
+    nbiot.init(modem, -1);
+    modem.on("AT+CEDRXRDP", "\r\n+CEDRXRDP: 5,\"0101\",\"1001\",\"0011\"\r\n\r\nOK\r\n");
+
+    CHECK(nbiot.setPsm(true, 24 * 3600, 60));
+    CHECK(modem.hasCommand("AT+CPSMS=1,,,\"00111000\",\"00011110\";+CEREG=4;+NPSMR=1"));
+    CHECK(!nbiot.getGrantedPsmTimers(&periodicTau, &activeTime));
+
+    modem.send("\r\n+CEREG: 1,\"1A2B\",\"01A2D101\",9,,,\"00100001\",\"00100001\"\r\n");
+    nbiot.isAlive();
+
+    CHECK(nbiot.getGrantedPsmTimers(&periodicTau, &activeTime));
+    CHECK_EQUAL(3600u, periodicTau);
+    CHECK_EQUAL(60u, activeTime);
+
+    CHECK(nbiot.setEdrx(true, 5));
+    CHECK(nbiot.getGrantedEdrx(&cycle, &pagingTimeWindow));
+    CHECK_EQUAL(9, cycle);
+    CHECK_EQUAL(3, pagingTimeWindow);
+
+    modem.send("\r\n+NPSMR: 1\r\n", 100000);
+    CHECK(nbiot.waitForPsm(1000));
+    CHECK(nbiot.isInPsm());
+}
+
+TEST(connectKeepsThePsmUrcs)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    addNetworkRules(modem);
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(modem.hasCommand("AT+CEREG=1;+CSCON=1;+CGEREP=1"));
+
+    CHECK(nbiot.setPsm(true, 3600, 60));
+    modem.clearCommands();
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(modem.hasCommand("AT+CEREG=4;+CSCON=1;+CGEREP=1;+NPSMR=1"));
+    CHECK(!modem.hasCommandWith("+CEREG=1"));
+}
+
+TEST(blockingCommandsContinueTheLineCutByPoll)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    nbiot.init(modem, -1);
+    modem.on("AT", "\r\nOK\r\n");
+
+    // poll() gets only the start of the URC
+    modem.send("\r\n+NSONMI: 0,");
+    delay(100);
+    nbiot.poll();
+
+    modem.send("4\r\n");
+    CHECK(nbiot.isAlive());
+    CHECK_EQUAL(4u, nbiot.getPendingUDPBytes(0));
+
+    // and the next URC is read whole by poll()
+    modem.send("\r\n+CSCON: 1\r\n");
+    delay(100);
+    nbiot.poll();
+    CHECK(nbiot.isSignallingConnected());
+}
+
+TEST(prefetchesIntoTheReceiveQueue)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t storage[2 * (sizeof(SaraN2UDPPacketMetadata) + 4)];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), 4);
+    uint8_t buffer[8];
+    SaraN2UDPPacketMetadata metadata;
+
+    nbiot.init(modem, -1);
+    nbiot.setReceiveQueue(&queue);
+    modem.on("AT+NSORF=0,4", "\r\n0,\"10.0.0.1\",7,4,\"61626364\",2\r\n\r\nOK\r\n");
+    modem.on("AT+NSORF=0,2", "\r\n0,\"10.0.0.1\",7,2,\"6566\",0\r\n\r\nOK\r\n");
+    modem.on("AT+NSORF=1,", "\r\n1,\"10.0.0.3\",9,3,\"414243\",0\r\n\r\nOK\r\n");
+    modem.send("\r\n+NSONMI: 0,6\r\n\r\n+NSONMI: 1,3\r\n\r\n+NSONMI: 1,3\r\n\r\n+NSONMI: 1,3\r\n");
+    nbiot.isAlive();
+
+    // poll() does not block for the reads
+    nbiot.poll();
+    CHECK(!modem.hasCommand("AT+NSORF="));
+    CHECK(queue.isEmpty());
+
+    // the 6 byte datagram does not fit a slot and is dropped
+    CHECK_EQUAL(2, nbiot.prefetchDatagrams());
+    CHECK_EQUAL(1u, queue.getDroppedCount());
+    CHECK_EQUAL(1u, queue.getOverflowCount());
+    CHECK(queue.isFull());
+
+    CHECK_EQUAL(3u, queue.dequeue(buffer, sizeof(buffer), &metadata));
+    CHECK(memcmp(buffer, "ABC", 3) == 0);
+    CHECK_EQUAL(1, metadata.socketID);
+    CHECK(strcmp(metadata.ip, "10.0.0.3") == 0);
+
+    CHECK(nbiot.waitForUDPResponse(10));
+    CHECK_EQUAL(2, queue.getCount());
+}
+
+// Responds to AT+USORF=<socket>,<length> with <length> bytes of "c", as hex.
+static Sodaq_SimModem::Handler usorfResponse(char c)
+{
+    return [c](Sodaq_SimModem&, const std::string& command) {
+        size_t length = atoi(command.substr(command.find(',') + 1).c_str());
+        std::string socket = command.substr(strlen("AT+USORF="), 1);
+
+        return "\r\n+USORF: " + socket + ",\"10.0.0.1\",7," + std::to_string(length) + ",\"" +
+               toHex(std::string(length, c)) + "\"\r\n\r\nOK\r\n";
+    };
+}
+
+TEST(prefetchDropsDatagramsThatDoNotFitOnR4)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t storage[2 * (sizeof(SaraN2UDPPacketMetadata) + 4)];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), 4);
+    uint8_t buffer[8];
+    SaraN2UDPPacketMetadata metadata;
+
+    nbiot.init(modem, -1, -1, SARA_R4_TOGGLE_PIN);
+    nbiot.setReceiveQueue(&queue);
+    modem.on("AT+USORF=", usorfResponse('A'));
+    modem.on("AT+USORF=1,", usorfResponse('B'));
+
+    // the R4 reads no "remainingLength", the 10 byte datagram would be cut to 4 bytes
+    modem.send("\r\n+UUSORF: 0,10\r\n\r\n+UUSORF: 1,3\r\n");
+    nbiot.isAlive();
+
+    CHECK_EQUAL(1, nbiot.prefetchDatagrams());
+    CHECK_EQUAL(1u, queue.getDroppedCount());
+    CHECK(!nbiot.hasPendingUDPBytes());
+
+    CHECK_EQUAL(3u, queue.dequeue(buffer, sizeof(buffer), &metadata));
+    CHECK(memcmp(buffer, "BBB", 3) == 0);
+    CHECK_EQUAL(1, metadata.socketID);
+}
+
+struct Datagrams {
+    int count;
+    size_t lengths[4];
+    int remainingLengths[4];
+    uint8_t sockets[4];
+};
+
+static void onDatagram(uint8_t socketID, const SaraN2UDPPacketMetadata& metadata, const uint8_t* data,
+                       size_t length, void* parameter)
+{
+    Datagrams* datagrams = static_cast<Datagrams*>(parameter);
+
+    if (datagrams->count < 4) {
+        datagrams->sockets[datagrams->count] = socketID;
+        datagrams->lengths[datagrams->count] = length;
+        datagrams->remainingLengths[datagrams->count] = metadata.remainingLength;
+    }
+
+    datagrams->count++;
+}
+
+TEST(dispatchesToTheDatagramHandler)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    Datagrams datagrams = { 0 };
+
+    nbiot.init(modem, -1);
+    nbiot.setDatagramHandler(onDatagram, &datagrams);
+
+    // the default input buffer (250) takes a datagram of 186 bytes, the rest comes in a second part
+    std::string data(300, 'A');
+    modem.on("AT+NSORF=0,", "\r\n0,\"10.0.0.1\",7,186,\"" + toHex(data.substr(0, 186)) + "\",114\r\n\r\nOK\r\n", true);
+    modem.on("AT+NSORF=2,", "\r\n2,\"10.0.0.1\",7,2,\"6869\",0\r\n\r\nOK\r\n");
+    modem.send("\r\n+NSONMI: 0,186\r\n\r\n+NSONMI: 2,2\r\n");
+    nbiot.isAlive();
+
+    // poll() does not block for the reads, nor does dispatching while a command is running
+    nbiot.poll();
+    CHECK(nbiot.sendCommandAsync("AT"));
+    CHECK_EQUAL(0, nbiot.dispatchDatagrams());
+    CHECK_EQUAL(0, datagrams.count);
+
+    while (nbiot.isBusy()) {
+        nbiot.poll();
+    }
+
+    CHECK(!modem.hasCommand("AT+NSORF="));
+    CHECK_EQUAL(2, nbiot.dispatchDatagrams());
+    CHECK_EQUAL(2, datagrams.count);
+    CHECK_EQUAL(0, datagrams.sockets[0]);
+    CHECK_EQUAL(186u, datagrams.lengths[0]);
+    CHECK_EQUAL(114, datagrams.remainingLengths[0]);
+    CHECK_EQUAL(2, datagrams.sockets[1]);
+    CHECK_EQUAL(2u, datagrams.lengths[1]);
+}
+
+TEST(dispatchDropsDatagramsThatDoNotFitOnR4)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    Datagrams datagrams = { 0 };
+
+    nbiot.init(modem, -1, -1, SARA_R4_TOGGLE_PIN);
+    nbiot.setDatagramHandler(onDatagram, &datagrams);
+    modem.on("AT+USORF=", usorfResponse('A'));
+
+    // the default input buffer (250) takes a datagram of 186 bytes, the R4 cannot read the rest later
+    modem.send("\r\n+UUSORF: 0,200\r\n");
+    nbiot.isAlive();
+
+    CHECK_EQUAL(0, nbiot.dispatchDatagrams());
+    CHECK_EQUAL(0, datagrams.count);
+    CHECK_EQUAL(1u, nbiot.getDroppedDatagramCount());
+    CHECK(!nbiot.hasPendingUDPBytes());
+
+    modem.send("\r\n+UUSORF: 0,186\r\n");
+    nbiot.isAlive();
+
+    CHECK_EQUAL(1, nbiot.dispatchDatagrams());
+    CHECK_EQUAL(186u, datagrams.lengths[0]);
+    CHECK_EQUAL(1u, nbiot.getDroppedDatagramCount());
+}
+
+TEST(exchangesRawBytesInBinaryDataMode)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    const char raw[] = { 'a', '"', '\r', '\n', '\0', 'z' };
+    std::string data(raw, sizeof(raw));
+    std::string received;
+    uint8_t buffer[16];
+    char hex[16];
+
+    modem.setBaudrate(115200);
+    modem.setHostBaudrate(115200);
+    nbiot.init(modem, -1, -1, SARA_R4_TOGGLE_PIN, 1, true);
+    CHECK(nbiot.isBinaryDataMode());
+
+    modem.on("AT+USOCR=17,", "\r\n+USOCR: 0\r\n\r\nOK\r\n");
+    modem.on("AT+USOST=0,\"10.0.0.1\",7,6", [&received](Sodaq_SimModem& modem, const std::string&) {
+        modem.expectData(6, [&received](Sodaq_SimModem&, const std::string& data) {
+            received = data;
+            return std::string("\r\n+USOST: 0,6\r\n\r\nOK\r\n");
+        });
+        return std::string("\r\n@");
+    });
+    modem.on("AT+USORF=0,6", "\r\n+USORF: 0,\"10.0.0.1\",7,6,\"" + data + "\"\r\n\r\nOK\r\n");
+    modem.on("AT+USORF=0,3", "\r\n+USORF: 0,\"10.0.0.1\",7,3,\"" + data.substr(0, 3) + "\"\r\n\r\nOK\r\n");
+
+    CHECK_EQUAL(0, nbiot.createSocket(7));
+    CHECK_EQUAL(6u, nbiot.socketSend(0, "10.0.0.1", 7, reinterpret_cast<const uint8_t*>(raw), sizeof(raw)));
+    CHECK(received == data);
+
+    modem.send("\r\n+UUSORF: 0,6\r\n");
+    nbiot.isAlive();
+    CHECK_EQUAL(6u, nbiot.socketReceiveBytes(0, buffer, sizeof(buffer)));
+    CHECK(memcmp(buffer, raw, sizeof(raw)) == 0);
+
+    modem.send("\r\n+UUSORF: 0,3\r\n");
+    nbiot.isAlive();
+    CHECK_EQUAL(3u, nbiot.socketReceiveHex(0, hex, sizeof(hex)));
+    CHECK(strcmp(hex, "61220D") == 0);
+    CHECK(nbiot.isAlive());
+}
+
+TEST(resyncsAfterAMissingDataPrompt)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    const uint8_t data[] = { 1, 2, 3 };
+
+    modem.setBaudrate(115200);
+    modem.setHostBaudrate(115200);
+    nbiot.init(modem, -1, -1, SARA_R4_TOGGLE_PIN, 1, true);
+
+    modem.on("AT+USOCR=17,", "\r\n+USOCR: 0\r\n\r\nOK\r\n");
+    // the prompt comes too late, the modem then gives up waiting for the data
+    modem.on("AT+USOST=0,\"10.0.0.1\",7,3", [](Sodaq_SimModem& modem, const std::string&) {
+        modem.send("\r\n@", 2000000);
+        modem.send("\r\nERROR\r\n", 8000000);
+        return std::string();
+    });
+
+    CHECK_EQUAL(0, nbiot.createSocket(7));
+    CHECK_EQUAL(0u, nbiot.socketSend(0, "10.0.0.1", 7, data, sizeof(data)));
+    // nothing was sent in the data, the resync came after the error
+    CHECK(!modem.hasCommandWith(std::string(1, '\x01')));
+    CHECK_EQUAL(1u, modem.countCommands("AT+USOST="));
+    CHECK(nbiot.isAlive());
+}
+
+static Sodaq_SimModem* baudrateModem;
+
+static void onBaudrateChange(uint32_t baudrate)
+{
+    baudrateModem->setHostBaudrate(baudrate);
+}
+
+// Answers AT+NATSPEED=<baudrate>,... and switches to the baud rate if "isSupported".
+static void addNatspeedRule(Sodaq_SimModem& modem, bool isSupported)
+{
+    modem.on("AT+NATSPEED=", [isSupported](Sodaq_SimModem& modem, const std::string& command) {
+        modem.send("\r\nOK\r\n");
+
+        if (isSupported) {
+            modem.setBaudrate(atoi(command.c_str() + strlen("AT+NATSPEED=")));
+        }
+
+        return std::string();
+    });
+}
+
+TEST(upgradesTheBaudrate)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    baudrateModem = &modem;
+    nbiot.init(modem, -1);
+    nbiot.enableBaudrateChange(onBaudrateChange);
+    nbiot.setUpgradeBaudrate(57600);
+    addNetworkRules(modem);
+    addNatspeedRule(modem, true);
+    modem.on("AT+NRB", [](Sodaq_SimModem& modem, const std::string&) {
+        modem.send("\r\nREBOOTING\r\n\r\nOK\r\n");
+        modem.setBaudrate(9600);
+        return std::string();
+    });
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(modem.hasCommand("AT+NATSPEED=57600,3,0,2"));
+    CHECK_EQUAL(57600u, nbiot.getCurrentBaudrate());
+    CHECK_EQUAL(57600u, modem.getBaudrate());
+
+    nbiot.off();
+    CHECK_EQUAL(9600u, nbiot.getCurrentBaudrate());
+}
+
+TEST(keepsTheBaudrateUnlessAnUpgradeIsSet)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    baudrateModem = &modem;
+    nbiot.init(modem, -1);
+    nbiot.enableBaudrateChange(onBaudrateChange);
+    addNetworkRules(modem);
+    addNatspeedRule(modem, true);
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK(!modem.hasCommand("AT+NATSPEED="));
+    CHECK_EQUAL(9600u, modem.getBaudrate());
+}
+
+TEST(fallsBackIfTheBaudrateIsNotSupported)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+
+    baudrateModem = &modem;
+    nbiot.init(modem, -1);
+    nbiot.enableBaudrateChange(onBaudrateChange);
+    nbiot.setUpgradeBaudrate(57600);
+    addNetworkRules(modem);
+    addNatspeedRule(modem, false);
+
+    CHECK(nbiot.connect("apn.example", "", "", 8));
+    CHECK_EQUAL(9600u, nbiot.getCurrentBaudrate());
+    CHECK(nbiot.isAlive());
+}
+
+TEST(staticInputBuffer)
+{
+    Sodaq_SimModem modem;
+    static Sodaq_nbIOT_Static<200> nbiot;
+
+    nbiot.init(modem, -1);
+    nbiot.setInputBufferSize(999);
+
+    modem.on("AT+CGSN", "\r\n123456789012345\r\n\r\nOK\r\n");
+
+    char imei[16];
+    CHECK(nbiot.getIMEI(imei, sizeof(imei)));
+    CHECK(strcmp(imei, "123456789012345") == 0);
+}
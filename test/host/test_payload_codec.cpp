@@ -0,0 +1,188 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_PayloadCodec.h"
+#include <math.h>
+#include <stdint.h>
+
+static const Sodaq_PayloadField fields[] = {
+    { 100, true },  // temperature, 2 decimals
+    { 10, true },   // humidity, 1 decimal
+    { 1, false },   // battery voltage in mV
+};
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+static bool isClose(float a, float b, float tolerance)
+{
+    return fabs(a - b) <= tolerance;
+}
+
+TEST(varintRoundTrip)
+{
+    const int32_t values[] = { 0, 1, -1, 63, -64, 64, 8191, -8192, 1000000, INT32_MAX, INT32_MIN };
+    uint8_t buffer[5];
+    int32_t decoded;
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        size_t size = sodaq_varint_encode(values[i], buffer);
+
+        CHECK(size >= 1 && size <= 5);
+        CHECK_EQUAL(size, sodaq_varint_decode(buffer, size, &decoded));
+        CHECK_EQUAL(values[i], decoded);
+    }
+}
+
+TEST(varintSizes)
+{
+    uint8_t buffer[5];
+
+    CHECK_EQUAL(1u, sodaq_varint_encode(0, buffer));
+    CHECK_EQUAL(1u, sodaq_varint_encode(-64, buffer));
+    CHECK_EQUAL(2u, sodaq_varint_encode(64, buffer));
+    CHECK_EQUAL(5u, sodaq_varint_encode(INT32_MIN, buffer));
+}
+
+TEST(varintRejectsTruncatedInput)
+{
+    uint8_t buffer[5];
+    int32_t decoded;
+
+    size_t size = sodaq_varint_encode(100000, buffer);
+
+    CHECK_EQUAL(0u, sodaq_varint_decode(buffer, size - 1, &decoded));
+    CHECK_EQUAL(0u, sodaq_varint_decode(buffer, 0, &decoded));
+
+    const uint8_t tooLong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+    CHECK_EQUAL(0u, sodaq_varint_decode(tooLong, sizeof(tooLong), &decoded));
+}
+
+TEST(encodesAndDecodesReports)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    Sodaq_PayloadDecoder decoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float decoded[FIELD_COUNT];
+
+    for (int i = 0; i < 25; i++) {
+        float values[FIELD_COUNT] = { 21.5f + i * 0.03f, 55.0f - i * 0.2f, 3600.0f - i };
+
+        size_t size = encoder.encode(values, buffer, sizeof(buffer));
+        CHECK(size > 0);
+        CHECK(decoder.decode(buffer, size, decoded));
+
+        CHECK(isClose(values[0], decoded[0], 0.005f));
+        CHECK(isClose(values[1], decoded[1], 0.05f));
+        CHECK(isClose(values[2], decoded[2], 0.5f));
+    }
+}
+
+TEST(deltasMakeSlowlyChangingReportsSmaller)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float values[FIELD_COUNT] = { 21.5f, 55.0f, 3600.0f };
+
+    size_t keyFrameSize = encoder.encode(values, buffer, sizeof(buffer));
+
+    values[0] += 0.01f;
+    size_t deltaSize = encoder.encode(values, buffer, sizeof(buffer));
+
+    CHECK(deltaSize < keyFrameSize);
+    CHECK_EQUAL(1, buffer[0] & 0x01);
+}
+
+TEST(sendsKeyFramesAtTheInterval)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float values[FIELD_COUNT] = { 21.5f, 55.0f, 3600.0f };
+
+    encoder.setKeyFrameInterval(3);
+
+    for (int i = 0; i < 7; i++) {
+        encoder.encode(values, buffer, sizeof(buffer));
+        CHECK_EQUAL((i % 3) != 0, (buffer[0] & 0x01) != 0);
+    }
+
+    encoder.reset();
+    encoder.encode(values, buffer, sizeof(buffer));
+    CHECK_EQUAL(0, buffer[0] & 0x01);
+}
+
+TEST(decoderWaitsForKeyFrameAfterLoss)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    Sodaq_PayloadDecoder decoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float values[FIELD_COUNT] = { 21.5f, 55.0f, 3600.0f };
+    float decoded[FIELD_COUNT];
+
+    encoder.setKeyFrameInterval(4);
+
+    size_t size = encoder.encode(values, buffer, sizeof(buffer));
+    CHECK(decoder.decode(buffer, size, decoded));
+
+    encoder.encode(values, buffer, sizeof(buffer)); // lost
+
+    size = encoder.encode(values, buffer, sizeof(buffer));
+    CHECK(!decoder.decode(buffer, size, decoded));
+
+    size = encoder.encode(values, buffer, sizeof(buffer));
+    CHECK(!decoder.decode(buffer, size, decoded));
+
+    size = encoder.encode(values, buffer, sizeof(buffer)); // key frame
+    CHECK(decoder.decode(buffer, size, decoded));
+    CHECK(isClose(values[0], decoded[0], 0.005f));
+}
+
+TEST(rejectsMalformedPayloads)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    Sodaq_PayloadDecoder decoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float values[FIELD_COUNT] = { 21.5f, 55.0f, 3600.0f };
+    float decoded[FIELD_COUNT];
+
+    size_t size = encoder.encode(values, buffer, sizeof(buffer));
+
+    CHECK(!decoder.decode(buffer, 0, decoded));
+    CHECK(!decoder.decode(buffer, size - 1, decoded));
+
+    buffer[size] = 0;
+    CHECK(!decoder.decode(buffer, size + 1, decoded));
+}
+
+TEST(encodeFailsIfItDoesNotFit)
+{
+    Sodaq_PayloadEncoder encoder(fields, FIELD_COUNT);
+    Sodaq_PayloadDecoder decoder(fields, FIELD_COUNT);
+    uint8_t buffer[32];
+    float values[FIELD_COUNT] = { 21.5f, 55.0f, 3600.0f };
+    float decoded[FIELD_COUNT];
+
+    CHECK_EQUAL(0u, encoder.encode(values, buffer, 2));
+
+    // the failed report did not advance the encoder, the next one is still the key frame
+    size_t size = encoder.encode(values, buffer, sizeof(buffer));
+    CHECK_EQUAL(0, buffer[0]);
+    CHECK(decoder.decode(buffer, size, decoded));
+}
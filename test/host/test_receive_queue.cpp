@@ -0,0 +1,161 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_ReceiveQueue.h"
+#include <string.h>
+
+#define DATAGRAM_SIZE 8
+#define SLOT_SIZE (sizeof(SaraN2UDPPacketMetadata) + DATAGRAM_SIZE)
+
+static bool enqueue(Sodaq_ReceiveQueue& queue, uint8_t socketID, const char* data)
+{
+    uint8_t* slot = queue.reserve();
+
+    if (!slot) {
+        queue.onOverflow();
+        return false;
+    }
+
+    SaraN2UDPPacketMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.socketID = socketID;
+    strcpy(metadata.ip, "10.0.0.1");
+    metadata.port = 5683;
+    metadata.length = strlen(data);
+
+    memcpy(slot, data, metadata.length);
+    queue.commit(metadata);
+
+    return true;
+}
+
+TEST(capacityFollowsTheStorage)
+{
+    uint8_t storage[3 * SLOT_SIZE + SLOT_SIZE - 1];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), DATAGRAM_SIZE);
+
+    CHECK_EQUAL(3, queue.getCapacity());
+    CHECK(queue.isEmpty());
+    CHECK(!queue.isFull());
+    CHECK_EQUAL(static_cast<size_t>(DATAGRAM_SIZE), queue.getMaxDatagramSize());
+
+    Sodaq_ReceiveQueue none(NULL, sizeof(storage), DATAGRAM_SIZE);
+    CHECK_EQUAL(0, none.getCapacity());
+    CHECK(none.isFull());
+    CHECK(none.reserve() == NULL);
+}
+
+TEST(firstInFirstOut)
+{
+    uint8_t storage[3 * SLOT_SIZE];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), DATAGRAM_SIZE);
+    uint8_t buffer[DATAGRAM_SIZE];
+    SaraN2UDPPacketMetadata metadata;
+
+    CHECK(enqueue(queue, 1, "one"));
+    CHECK(enqueue(queue, 2, "two!"));
+    CHECK_EQUAL(2, queue.getCount());
+
+    CHECK_EQUAL(3u, queue.dequeue(buffer, sizeof(buffer), &metadata));
+    CHECK(memcmp(buffer, "one", 3) == 0);
+    CHECK_EQUAL(1, metadata.socketID);
+    CHECK(strcmp(metadata.ip, "10.0.0.1") == 0);
+    CHECK_EQUAL(5683, metadata.port);
+
+    CHECK_EQUAL(4u, queue.dequeue(buffer, sizeof(buffer), &metadata));
+    CHECK(memcmp(buffer, "two!", 4) == 0);
+    CHECK_EQUAL(2, metadata.socketID);
+
+    CHECK(queue.isEmpty());
+    CHECK_EQUAL(0u, queue.dequeue(buffer, sizeof(buffer)));
+}
+
+TEST(wrapsAround)
+{
+    uint8_t storage[2 * SLOT_SIZE];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), DATAGRAM_SIZE);
+    uint8_t buffer[DATAGRAM_SIZE];
+    char data[2] = { 0, 0 };
+
+    for (int i = 0; i < 10; i++) {
+        data[0] = 'a' + i;
+        CHECK(enqueue(queue, 0, data));
+
+        CHECK_EQUAL(1u, queue.dequeue(buffer, sizeof(buffer)));
+        CHECK_EQUAL('a' + i, buffer[0]);
+    }
+
+    CHECK(queue.isEmpty());
+}
+
+TEST(countsOverflowsAndKeepsTheHighWaterMark)
+{
+    uint8_t storage[2 * SLOT_SIZE];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), DATAGRAM_SIZE);
+
+    CHECK(enqueue(queue, 0, "a"));
+    CHECK(enqueue(queue, 0, "b"));
+    CHECK(queue.isFull());
+    CHECK(!enqueue(queue, 0, "c"));
+    CHECK_EQUAL(1u, queue.getOverflowCount());
+    CHECK_EQUAL(2, queue.getHighWaterMark());
+
+    queue.pop();
+    queue.onDropped();
+    CHECK_EQUAL(1u, queue.getDroppedCount());
+    CHECK_EQUAL(2, queue.getHighWaterMark());
+
+    queue.resetCounters();
+    CHECK_EQUAL(0u, queue.getOverflowCount());
+    CHECK_EQUAL(0u, queue.getDroppedCount());
+    CHECK_EQUAL(1, queue.getHighWaterMark());
+}
+
+TEST(dequeueTruncatesToTheBuffer)
+{
+    uint8_t storage[SLOT_SIZE];
+    Sodaq_ReceiveQueue queue(storage, sizeof(storage), DATAGRAM_SIZE);
+    uint8_t buffer[DATAGRAM_SIZE] = { 0 };
+    SaraN2UDPPacketMetadata metadata;
+
+    CHECK(enqueue(queue, 0, "abcdef"));
+    CHECK_EQUAL(2u, queue.dequeue(buffer, 2, &metadata));
+    CHECK(memcmp(buffer, "ab", 2) == 0);
+    CHECK_EQUAL(0, buffer[2]);
+    CHECK_EQUAL(6, metadata.length);
+    CHECK(queue.isEmpty());
+}
+
+TEST(worksWithUnalignedStorage)
+{
+    uint8_t storage[2 * SLOT_SIZE + 1];
+    Sodaq_ReceiveQueue queue(&storage[1], sizeof(storage) - 1, DATAGRAM_SIZE);
+    SaraN2UDPPacketMetadata metadata;
+
+    CHECK(enqueue(queue, 3, "xy"));
+
+    const uint8_t* data = queue.peek(&metadata);
+    CHECK(data != NULL);
+    CHECK_EQUAL(3, metadata.socketID);
+    CHECK_EQUAL(2, metadata.length);
+    CHECK(memcmp(data, "xy", 2) == 0);
+    CHECK_EQUAL(1, queue.getCount());
+}
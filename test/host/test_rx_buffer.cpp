@@ -0,0 +1,359 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_AT_Device.h"
+#include "Sodaq_SimModem.h"
+#include <string.h>
+#include <string>
+
+// Exposes the receive and transmit paths of Sodaq_AT_Device.
+class TestDevice : public Sodaq_AT_Device
+{
+  public:
+    TestDevice(Stream& stream) { setModemStream(stream); }
+
+    uint32_t getDefaultBaudrate() { return 9600; }
+
+    using Sodaq_AT_Device::fillRxBuffer;
+    using Sodaq_AT_Device::rxAvailable;
+    using Sodaq_AT_Device::clearRxBuffer;
+    using Sodaq_AT_Device::timedRead;
+    using Sodaq_AT_Device::readBytes;
+    using Sodaq_AT_Device::readBytesUntil;
+    using Sodaq_AT_Device::readLn;
+    using Sodaq_AT_Device::readLnAsync;
+    using Sodaq_AT_Device::armRxFieldSink;
+    using Sodaq_AT_Device::armRxRawFieldSink;
+    using Sodaq_AT_Device::disarmRxFieldSink;
+    using Sodaq_AT_Device::isRxFieldSinkFailed;
+
+    size_t writeCommand(const char* prefix, uint32_t value, const uint8_t* data, size_t size)
+    {
+        CommandWriter writer(*this);
+
+        writer.print(prefix);
+        writer.print(value);
+        writer.print(',');
+        writer.printHex(data, size);
+
+        return writer.println();
+    }
+
+  protected:
+    bool isAlive() { return true; }
+
+    ResponseTypes readResponse(char* buffer, size_t size, size_t* outSize, uint32_t timeout)
+    {
+        return ResponseNotFound;
+    }
+};
+
+TEST(readsLinesLongerThanTheRingBuffer)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    std::string line(3 * SODAQ_AT_DEVICE_RX_BUFFER_SIZE + 5, 'x');
+    char buffer[4 * SODAQ_AT_DEVICE_RX_BUFFER_SIZE];
+
+    for (size_t i = 0; i < line.size(); i++) {
+        line[i] = 'a' + i % 26;
+    }
+
+    modem.send(line + "\r\nnext\r\n");
+
+    CHECK_EQUAL(line.size(), device.readLn(buffer, sizeof(buffer)));
+    CHECK(line == buffer);
+    CHECK_EQUAL(4u, device.readLn(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "next") == 0);
+}
+
+TEST(readLnStopsAtTheBufferSize)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[8];
+
+    modem.send("0123456789\r\n");
+
+    CHECK_EQUAL(7u, device.readLn(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "0123456") == 0);
+    CHECK_EQUAL(3u, device.readLn(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "789") == 0);
+}
+
+TEST(readLnTimesOut)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[16];
+
+    modem.send("par");
+    uint32_t start = millis();
+
+    CHECK_EQUAL(3u, device.readLn(buffer, sizeof(buffer), 100));
+    CHECK(strcmp(buffer, "par") == 0);
+
+    uint32_t elapsed = millis() - start;
+    CHECK(elapsed >= 100);
+    CHECK(elapsed < 110);
+}
+
+TEST(readLnWaitsForSlowBytes)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[16];
+
+    // 10 ms per byte, the timeout is between characters
+    modem.setBaudrate(1000);
+    modem.setHostBaudrate(1000);
+    modem.send("slow\r\n");
+
+    CHECK_EQUAL(4u, device.readLn(buffer, sizeof(buffer), 20));
+    CHECK(strcmp(buffer, "slow") == 0);
+}
+
+TEST(timedReadAndReadBytes)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    uint8_t buffer[4 * SODAQ_AT_DEVICE_RX_BUFFER_SIZE];
+    std::string data;
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        data += static_cast<char>(i);
+    }
+
+    modem.send("A" + data);
+
+    CHECK_EQUAL('A', device.timedRead());
+    CHECK_EQUAL(sizeof(buffer), device.readBytes(buffer, sizeof(buffer)));
+    CHECK(memcmp(buffer, data.data(), sizeof(buffer)) == 0);
+    CHECK_EQUAL(-1, device.timedRead(10));
+}
+
+TEST(fillRxBufferStopsWhenFull)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+
+    modem.send(std::string(2 * SODAQ_AT_DEVICE_RX_BUFFER_SIZE, 'x'));
+    sodaq_host_advance(1000000);
+
+    CHECK_EQUAL(static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE), device.fillRxBuffer());
+    CHECK_EQUAL(static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE), device.rxAvailable());
+
+    device.clearRxBuffer();
+    CHECK_EQUAL(0u, device.rxAvailable());
+    CHECK_EQUAL(static_cast<size_t>(SODAQ_AT_DEVICE_RX_BUFFER_SIZE), device.fillRxBuffer());
+}
+
+TEST(readLnAsyncCollectsPartialLines)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[32];
+    size_t length = 0;
+
+    CHECK(!device.readLnAsync(buffer, sizeof(buffer), &length));
+
+    modem.send("+CEREG");
+    sodaq_host_advance(100000);
+    CHECK(!device.readLnAsync(buffer, sizeof(buffer), &length));
+
+    modem.send(": 1\r\n");
+    sodaq_host_advance(100000);
+    CHECK(device.readLnAsync(buffer, sizeof(buffer), &length));
+    CHECK_EQUAL(9u, length);
+    CHECK(strcmp(buffer, "+CEREG: 1") == 0);
+}
+
+TEST(hexFieldSinkDecodesIntoTheCallersBuffer)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[8];
+
+    modem.send("0,\"10.0.0.1\",7,4,\"48692122\",0\r\n");
+    device.armRxFieldSink(data, sizeof(data), 1, true);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK_EQUAL(4u, device.disarmRxFieldSink());
+    CHECK(memcmp(data, "Hi!\"", 4) == 0);
+    CHECK(strcmp(buffer, "0,\"10.0.0.1\",7,4,\"\",0") == 0);
+}
+
+TEST(hexFieldSinkTruncatesToItsSize)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[2];
+
+    modem.send("\"414243\",1\r\n");
+    device.armRxFieldSink(data, sizeof(data), 0, true);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK_EQUAL(2u, device.disarmRxFieldSink());
+    CHECK(memcmp(data, "AB", 2) == 0);
+    CHECK(strcmp(buffer, "\"\",1") == 0);
+}
+
+TEST(hexFieldSinkFailsOnCharactersThatAreNotHex)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[8];
+
+    modem.send("0,\"10.0.0.1\",7,4,\"4869ZZ22\",0\r\nOK\r\n");
+    device.armRxFieldSink(data, sizeof(data), 1, true);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK(device.isRxFieldSinkFailed());
+    CHECK_EQUAL(0u, device.disarmRxFieldSink());
+
+    device.readLn(buffer, sizeof(buffer));
+    CHECK(strcmp(buffer, "OK") == 0);
+
+    // an odd number of digits
+    modem.send("\"41424\"\r\n");
+    device.armRxFieldSink(data, sizeof(data), 0, true);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK(device.isRxFieldSinkFailed());
+    CHECK_EQUAL(0u, device.disarmRxFieldSink());
+}
+
+TEST(hexFieldSinkDecodesAcrossTheRingBuffer)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[3 * SODAQ_AT_DEVICE_RX_BUFFER_SIZE / 4];
+    std::string hex;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", static_cast<uint8_t>(i * 7));
+        hex += digits;
+    }
+
+    // an odd offset, so that the runs split the digit pairs
+    modem.send("1,\"" + hex + "\"\r\n");
+    device.armRxFieldSink(data, sizeof(data), 0, true);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK(!device.isRxFieldSinkFailed());
+    CHECK_EQUAL(sizeof(data), device.disarmRxFieldSink());
+    CHECK(strcmp(buffer, "1,\"\"") == 0);
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        CHECK_EQUAL(static_cast<uint8_t>(i * 7), data[i]);
+    }
+}
+
+TEST(rawFieldSinkTakesQuotesAndTerminatorsAsData)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[8];
+    const char raw[] = { 'a', '"', '\r', '\n', '\0', 'z' };
+
+    modem.send("+USORF: 0,\"10.0.0.1\",7,6,\"" + std::string(raw, sizeof(raw)) + "\"\r\nOK\r\n");
+    device.armRxRawFieldSink(data, sizeof(data), 1);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK_EQUAL(sizeof(raw), device.disarmRxFieldSink());
+    CHECK(memcmp(data, raw, sizeof(raw)) == 0);
+    CHECK(strcmp(buffer, "+USORF: 0,\"10.0.0.1\",7,6,\"\"") == 0);
+
+    device.readLn(buffer, sizeof(buffer));
+    CHECK(strcmp(buffer, "OK") == 0);
+}
+
+TEST(rawFieldSinkFailsWhenTheDataDoesNotMatchItsLength)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[8];
+
+    modem.send("+USORF: 0,\"10.0.0.1\",7,3,\"abcd\"\r\nOK\r\n");
+    device.armRxRawFieldSink(data, sizeof(data), 1);
+
+    device.readLn(buffer, sizeof(buffer));
+
+    CHECK(device.isRxFieldSinkFailed());
+    CHECK_EQUAL(0u, device.disarmRxFieldSink());
+    CHECK(strcmp(buffer, "+USORF: 0,\"10.0.0.1\",7,3,\"d\"") == 0);
+
+    device.readLn(buffer, sizeof(buffer));
+    CHECK(strcmp(buffer, "OK") == 0);
+}
+
+TEST(sinkStaysArmedForLinesWithoutTheField)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    char buffer[64];
+    uint8_t data[8];
+
+    modem.send("+NSONMI: 0,4\r\n0,\"10.0.0.1\",7,2,\"4142\",0\r\n");
+    device.armRxFieldSink(data, sizeof(data), 1, true);
+
+    device.readLn(buffer, sizeof(buffer));
+    CHECK(strcmp(buffer, "+NSONMI: 0,4") == 0);
+
+    device.readLn(buffer, sizeof(buffer));
+    CHECK_EQUAL(2u, device.disarmRxFieldSink());
+    CHECK(memcmp(data, "AB", 2) == 0);
+}
+
+TEST(commandWriterWritesInChunks)
+{
+    Sodaq_SimModem modem;
+    TestDevice device(modem);
+    uint8_t data[100];
+    std::string expected = "AT+NSOST=42,";
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        char hex[3];
+
+        data[i] = i * 3;
+        snprintf(hex, sizeof(hex), "%02X", data[i]);
+        expected += hex;
+    }
+
+    size_t written = device.writeCommand("AT+NSOST=", 42, data, sizeof(data));
+
+    CHECK_EQUAL(expected.size() + 1, written);
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK(modem.getCommands()[0] == expected);
+}
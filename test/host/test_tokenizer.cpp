@@ -0,0 +1,196 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_AT_Tokenizer.h"
+#include <Arduino.h>
+#include <string.h>
+
+#define TOKENIZER(line) Sodaq_AT_Tokenizer tokenizer(line, strlen(line))
+
+TEST(parsesSocketReadLine)
+{
+    const char* line = "0,\"10.0.0.1\",5683,4,\"AABBCCDD\",12";
+    TOKENIZER(line);
+    uint8_t socket;
+    char ip[16];
+    uint16_t port;
+    int32_t length;
+    const char* data;
+    size_t dataLength;
+    int32_t remaining;
+
+    CHECK(tokenizer.readInt(&socket) && tokenizer.skip(',') &&
+          tokenizer.readIP(ip, sizeof(ip)) && tokenizer.skip(',') &&
+          tokenizer.readInt(&port) && tokenizer.skip(',') &&
+          tokenizer.readInt(&length) && tokenizer.skip(',') &&
+          tokenizer.readString(&data, &dataLength) && tokenizer.skip(',') &&
+          tokenizer.readInt(&remaining));
+    CHECK(tokenizer.atEnd());
+    CHECK_EQUAL(0, socket);
+    CHECK(strcmp(ip, "10.0.0.1") == 0);
+    CHECK_EQUAL(5683, port);
+    CHECK_EQUAL(4, length);
+    CHECK_EQUAL(8u, dataLength);
+    CHECK(memcmp(data, "AABBCCDD", dataLength) == 0);
+    CHECK_EQUAL(12, remaining);
+}
+
+TEST(skipsPrefix)
+{
+    TOKENIZER("+CEREG: 1,5");
+    int32_t n;
+    int32_t stat;
+
+    CHECK(!tokenizer.skip("+CSCON:"));
+    CHECK(tokenizer.skip(F("+CEREG:")));
+    CHECK(tokenizer.readInt(&n) && tokenizer.skip(',') && tokenizer.readInt(&stat));
+    CHECK_EQUAL(1, n);
+    CHECK_EQUAL(5, stat);
+}
+
+TEST(readsSignedIntegers)
+{
+    TOKENIZER("-12,+7, 3");
+    int32_t a;
+    int32_t b;
+    int32_t c;
+
+    CHECK(tokenizer.readInt(&a) && tokenizer.skip(',') && tokenizer.readInt(&b) &&
+          tokenizer.skip(',') && tokenizer.readInt(&c));
+    CHECK_EQUAL(-12, a);
+    CHECK_EQUAL(7, b);
+    CHECK_EQUAL(3, c);
+}
+
+TEST(rejectsOutOfRangeIntegers)
+{
+    uint8_t u8;
+    int8_t s8;
+
+    {
+        TOKENIZER("256");
+        CHECK(!tokenizer.readInt(&u8));
+    }
+    {
+        TOKENIZER("-1");
+        CHECK(!tokenizer.readInt(&u8));
+    }
+    {
+        TOKENIZER("-128");
+        CHECK(tokenizer.readInt(&s8));
+        CHECK_EQUAL(-128, s8);
+    }
+    {
+        TOKENIZER("x");
+        CHECK(!tokenizer.readInt(&u8));
+    }
+}
+
+TEST(rejectsIntegerOverflow)
+{
+    int32_t value;
+
+    {
+        TOKENIZER("2147483647");
+        CHECK(tokenizer.readInt(&value));
+        CHECK_EQUAL(2147483647, value);
+    }
+    {
+        TOKENIZER("-2147483648");
+        CHECK(tokenizer.readInt(&value));
+        CHECK(value == INT32_MIN);
+    }
+    {
+        TOKENIZER("2147483648");
+        CHECK(!tokenizer.readInt(&value));
+    }
+    {
+        TOKENIZER("-2147483649");
+        CHECK(!tokenizer.readInt(&value));
+    }
+    {
+        // wraps to 0 without the check
+        TOKENIZER("4294967296");
+        CHECK(!tokenizer.readInt(&value));
+    }
+}
+
+TEST(readsUnquotedAndEmptyFields)
+{
+    TOKENIZER("abc,,\"\"");
+    char buffer[8];
+
+    CHECK(tokenizer.readString(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "abc") == 0);
+    CHECK(tokenizer.skip(','));
+    CHECK(tokenizer.readString(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "") == 0);
+    CHECK(tokenizer.skip(','));
+    CHECK(tokenizer.readString(buffer, sizeof(buffer)));
+    CHECK(strcmp(buffer, "") == 0);
+    CHECK(tokenizer.atEnd());
+}
+
+TEST(rejectsUnterminatedAndTooLongStrings)
+{
+    char buffer[4];
+
+    {
+        TOKENIZER("\"abc");
+        CHECK(!tokenizer.readString(buffer, sizeof(buffer)));
+    }
+    {
+        TOKENIZER("\"abcd\"");
+        CHECK(!tokenizer.readString(buffer, sizeof(buffer)));
+    }
+}
+
+TEST(readIPRejectsNonAddresses)
+{
+    char ip[16];
+
+    {
+        TOKENIZER("\"host.example\"");
+        CHECK(!tokenizer.readIP(ip, sizeof(ip)));
+    }
+    {
+        TOKENIZER("\"\"");
+        CHECK(!tokenizer.readIP(ip, sizeof(ip)));
+    }
+    {
+        TOKENIZER("255.255.255.255");
+        CHECK(tokenizer.readIP(ip, sizeof(ip)));
+        CHECK(strcmp(ip, "255.255.255.255") == 0);
+    }
+}
+
+TEST(doesNotReadPastTheEnd)
+{
+    const char line[] = "12,\"ab\"";
+    Sodaq_AT_Tokenizer tokenizer(line, 2);
+    int32_t value;
+
+    CHECK(tokenizer.readInt(&value));
+    CHECK_EQUAL(12, value);
+    CHECK(tokenizer.atEnd());
+    CHECK(!tokenizer.skip(','));
+    CHECK(!tokenizer.peek(','));
+}
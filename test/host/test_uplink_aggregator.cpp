@@ -0,0 +1,178 @@
+/*
+    Copyright (c) 2015-2016 Sodaq.  All rights reserved.
+
+    This file is part of Sodaq_nbIOT.
+
+    Sodaq_nbIOT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or(at your option) any later version.
+
+    Sodaq_nbIOT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Sodaq_nbIOT.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "sodaq_test.h"
+#include "Sodaq_SimModem.h"
+#include "Sodaq_UplinkAggregator.h"
+#include <string>
+
+static const uint8_t record[] = { 0xAA, 0xBB, 0xCC };
+
+// Sets up a N2 that acknowledges every datagram and message.
+static void initModem(Sodaq_SimModem& modem, Sodaq_nbIOT& nbiot)
+{
+    nbiot.init(modem, -1);
+
+    modem.on("AT+NSOST=", [](Sodaq_SimModem&, const std::string& command) {
+        // AT+NSOST=<socket>,"<ip>",<port>,<length>,"<data>"
+        size_t end = command.rfind(",\"");
+        size_t start = command.rfind(',', end - 1) + 1;
+
+        return "\r\n0," + command.substr(start, end - start) + "\r\n\r\nOK\r\n";
+    });
+}
+
+TEST(packsRecordsIntoOneMessage)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[16];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+
+    CHECK(aggregator.add(record, 3));
+    CHECK(aggregator.add(record, 2));
+    CHECK_EQUAL(7u, aggregator.getBufferedSize());
+    CHECK_EQUAL(2, aggregator.getBufferedRecordCount());
+    CHECK(modem.getCommands().empty());
+
+    CHECK(aggregator.flush());
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK(modem.getCommands()[0] == "AT+NMGS=7,\"03AABBCC02AABB\"");
+
+    CHECK_EQUAL(0u, aggregator.getBufferedSize());
+    CHECK_EQUAL(2u, aggregator.getRecordCount());
+    CHECK_EQUAL(1u, aggregator.getDatagramCount());
+    CHECK_EQUAL(7u, aggregator.getByteCount());
+    CHECK(aggregator.getPackingRatio() == 2.0f);
+}
+
+TEST(flushesWhenTheNextRecordDoesNotFit)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[10];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+    aggregator.setSocketTarget(0, "10.0.0.1", 5683);
+
+    CHECK(aggregator.add(record, 3));
+    CHECK(aggregator.add(record, 3));
+    CHECK(modem.getCommands().empty());
+
+    CHECK(aggregator.add(record, 3));
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK(modem.getCommands()[0] == "AT+NSOST=0,\"10.0.0.1\",5683,8,\"03AABBCC03AABBCC\"");
+    CHECK_EQUAL(4u, aggregator.getBufferedSize());
+}
+
+TEST(rejectsRecordsThatCanNeverFit)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[4];
+    uint8_t large[256] = { 0 };
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+
+    CHECK(!aggregator.add(large, 4));
+    CHECK(aggregator.add(large, 3));
+
+    uint8_t largeBuffer[300];
+    Sodaq_UplinkAggregator largeAggregator(nbiot, largeBuffer, sizeof(largeBuffer));
+    CHECK(!largeAggregator.add(large, sizeof(large)));
+}
+
+TEST(flushesAtTheFlushSize)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[32];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+    aggregator.setFlushSize(8);
+
+    CHECK(aggregator.add(record, 3));
+    CHECK(modem.getCommands().empty());
+    CHECK(aggregator.add(record, 3));
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK_EQUAL(0u, aggregator.getBufferedSize());
+}
+
+TEST(flushesAtTheFlushAge)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[32];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+    aggregator.setFlushAge(1000);
+
+    CHECK(aggregator.add(record, 3));
+    delay(500);
+    CHECK(aggregator.poll());
+    CHECK(modem.getCommands().empty());
+
+    delay(600);
+    CHECK(aggregator.poll());
+    CHECK_EQUAL(1u, modem.getCommands().size());
+    CHECK_EQUAL(0u, aggregator.getBufferedSize());
+}
+
+TEST(keepsTheRecordsIfSendingFails)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[32];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+    modem.on("AT+NMGS=", "\r\nERROR\r\n", true);
+
+    CHECK(aggregator.add(record, 3));
+    CHECK(!aggregator.flush());
+    CHECK_EQUAL(4u, aggregator.getBufferedSize());
+    CHECK_EQUAL(0u, aggregator.getDatagramCount());
+
+    CHECK(aggregator.flush());
+    CHECK_EQUAL(2u, modem.countCommands("AT+NMGS=4,\"03AABBCC\""));
+    CHECK_EQUAL(1u, aggregator.getDatagramCount());
+}
+
+TEST(passesTheReleaseAssistance)
+{
+    Sodaq_SimModem modem;
+    Sodaq_nbIOT nbiot;
+    uint8_t buffer[32];
+    Sodaq_UplinkAggregator aggregator(nbiot, buffer, sizeof(buffer));
+
+    initModem(modem, nbiot);
+    modem.on("AT+NSOSTF=", "\r\n0,4\r\n\r\nOK\r\n");
+    aggregator.setSocketTarget(1, "10.0.0.1", 7);
+
+    CHECK(aggregator.add(record, 3));
+    CHECK(aggregator.flush(Sodaq_nbIOT::ReleaseAfterUplink));
+    CHECK(modem.hasCommand("AT+NSOSTF=1,\"10.0.0.1\",7,0x200,4,\"03AABBCC\""));
+}